@@ -0,0 +1,558 @@
+// Headless benchmarks of Polished Map's loading, editing, and printing code
+//
+// polishedmapbench [--iterations=N] [--work=DIR] [--json=FILE] [--csv=FILE] MapName.WxH.tileset.blk...
+//
+// Each map is benchmarked with its project's tileset, followed by a generated
+// 255x255 map using the first map's tileset. Results go to the --json and --csv
+// files (JSON on stdout if neither is given) so runs can be compared between
+// versions.
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#pragma warning(push, 0)
+#include <FL/filename.H>
+#include <FL/fl_utf8.h>
+#pragma warning(pop)
+
+#include "version.h"
+#include "utils.h"
+#include "config.h"
+#include "parallel.h"
+#include "tiled-image.h"
+#include "palette-map.h"
+#include "tileset.h"
+#include "metatileset.h"
+#include "map.h"
+#include "dependency-index.h"
+#include "event-script.h"
+#include "image.h"
+
+#define DEFAULT_ITERATIONS 10
+#define SYNTHETIC_SIZE 255
+#define SYNTHETIC_EVENTS 512
+// one screen of a Game Boy, in event squares
+#define BENCH_SCREEN_W 20
+#define BENCH_SCREEN_H 18
+
+typedef std::chrono::steady_clock Clock;
+
+struct Bench_Map {
+	std::string label, blk, directory, tileset;
+	uint16_t width, height;
+};
+
+struct Bench_Result {
+	std::string map, name;
+	uint16_t width, height;
+	size_t iterations;
+	double min_ms, median_ms, mean_ms, max_ms;
+};
+
+struct Bench_State {
+	const Bench_Map *bm;
+	std::string png_path, twobpp_path, lz_path, palette_map_path, metatileset_path, collisions_path, lighting_path, events_path,
+		image_path;
+	bool bin_collisions;
+	Metatileset *metatileset;
+	Map *map;
+	Dependency_Index *dependencies;
+	Event_Script *events;
+	std::vector<uint8_t> ids;
+	std::vector<std::string> blk_names;
+	uint8_t common_id, other_id;
+	size_t common_cell;
+};
+
+// A benchmark step returns false on failure; its reset (if any) runs untimed after each iteration
+typedef bool (*Bench_Step)(Bench_State &state);
+
+struct Bench {
+	const char *name;
+	Bench_Step run, reset;
+};
+
+static void restore_ids(Bench_State &state) {
+	uint16_t w = state.map->width(), h = state.map->height();
+	for (uint16_t y = 0; y < h; y++) {
+		for (uint16_t x = 0; x < w; x++) {
+			state.map->id(x, y, state.ids[(size_t)y * w + x]);
+		}
+	}
+}
+
+static bool decode_png(Bench_State &state) {
+	Tiled_Image ti(state.png_path.c_str());
+	return ti.result() == Tiled_Image::Result::IMG_OK;
+}
+
+static bool decode_2bpp(Bench_State &state) {
+	Tiled_Image ti(state.twobpp_path.c_str());
+	return ti.result() == Tiled_Image::Result::IMG_OK;
+}
+
+static bool decode_lz(Bench_State &state) {
+	Tiled_Image ti(state.lz_path.c_str());
+	return ti.result() == Tiled_Image::Result::IMG_OK;
+}
+
+static bool read_palette_map(Bench_State &state) {
+	Palette_Map pm;
+	return pm.read_from(state.palette_map_path.c_str()) == Palette_Map::Result::PALETTE_OK;
+}
+
+static bool read_metatiles(Bench_State &state) {
+	state.metatileset->size(0);
+	Metatileset::Result r = state.metatileset->read_metatiles(state.metatileset_path.c_str());
+	return r == Metatileset::Result::META_OK || r == Metatileset::Result::META_TOO_LONG;
+}
+
+static bool read_collisions(Bench_State &state) {
+	state.metatileset->bin_collisions(state.bin_collisions);
+	return state.metatileset->read_collisions(state.collisions_path.c_str()) == Metatileset::Result::META_OK;
+}
+
+static bool read_lighting(Bench_State &state) {
+	return !Color::parse_lighting(state.lighting_path.c_str()).empty();
+}
+
+static bool read_events(Bench_State &state) {
+	Event_Script es;
+	return es.read_events(state.events_path.c_str()) == Event_Script::Result::EVENTS_OK;
+}
+
+static bool query_events(Bench_State &state) {
+	// the lookups done by Main_Window::draw_events for each screen of the map,
+	// and by Main_Window::refresh_status for each event square hovered over
+	std::vector<const Event *> found;
+	int w = (int)state.bm->width * 2, h = (int)state.bm->height * 2;
+	size_t n = 0;
+	for (int y = 0; y < h; y += BENCH_SCREEN_H) {
+		for (int x = 0; x < w; x += BENCH_SCREEN_W) {
+			state.events->query(x, y, x + BENCH_SCREEN_W, y + BENCH_SCREEN_H, found);
+			n += found.size();
+		}
+	}
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			if (state.events->event_at(x, y)) { n++; }
+		}
+	}
+	return n > 0;
+}
+
+static bool read_blocks(Bench_State &state) {
+	Map map;
+	map.size(state.bm->width, state.bm->height);
+	Map::Result r = map.read_blocks(state.bm->blk.c_str());
+	map.clear();
+	return r == Map::Result::MAP_OK;
+}
+
+static bool print_indexed(Bench_State &state) {
+	uchar *buffer = state.metatileset->print_indexed(*state.map);
+	delete [] buffer;
+	return true;
+}
+
+static bool write_image(Bench_State &state, Image::Encoder e) {
+	Image::encoder(e);
+	return Image::write_map_image(state.image_path.c_str(), *state.map, *state.metatileset) == Image::Result::IMAGE_OK;
+}
+
+static bool write_image_fast(Bench_State &state) { return write_image(state, Image::Encoder::PNG_FAST); }
+static bool write_image_balanced(Bench_State &state) { return write_image(state, Image::Encoder::PNG_BALANCED); }
+static bool write_image_smallest(Bench_State &state) { return write_image(state, Image::Encoder::PNG_SMALLEST); }
+
+static bool undo_redo(Bench_State &state) {
+	state.map->remember();
+	state.map->undo();
+	state.map->redo();
+	return true;
+}
+
+static bool flood_fill(Bench_State &state) {
+	uint16_t w = state.map->width();
+	state.map->flood_fill((uint16_t)(state.common_cell % w), (uint16_t)(state.common_cell / w), state.other_id);
+	return true;
+}
+
+static bool substitute(Bench_State &state) {
+	// the same as Main_Window::substitute_block, which reindexes via the map's change callback
+	std::vector<size_t> cells = state.dependencies->cells(state.common_id);
+	for (size_t i : cells) {
+		state.map->cell_id(i, state.other_id);
+		state.dependencies->move_cell(i, state.common_id, state.other_id);
+	}
+	return true;
+}
+
+static bool parse_blk_names(Bench_State &state) {
+	// the filename guessing done when opening maps and finding a tileset's maps
+	Blk_Name bn;
+	for (const std::string &f : state.blk_names) {
+		if (!parse_blk_name(f.c_str(), bn)) { return false; }
+	}
+	return true;
+}
+
+static bool reset_blocks(Bench_State &state) {
+	restore_ids(state);
+	return true;
+}
+
+static bool reset_dependencies(Bench_State &state) {
+	restore_ids(state);
+	state.dependencies->index(*state.metatileset, *state.map);
+	return true;
+}
+
+static const Bench benches[] = {
+	{"decode_png", decode_png, NULL},
+	{"decode_2bpp", decode_2bpp, NULL},
+	{"decode_lz", decode_lz, NULL},
+	{"read_palette_map", read_palette_map, NULL},
+	{"read_metatiles", read_metatiles, NULL},
+	{"read_collisions", read_collisions, NULL},
+	{"read_lighting", read_lighting, NULL},
+	{"read_blocks", read_blocks, NULL},
+	{"read_events", read_events, NULL},
+	{"query_events", query_events, NULL},
+	{"parse_blk_names", parse_blk_names, NULL},
+	{"print_indexed", print_indexed, NULL},
+	{"write_image_fast", write_image_fast, NULL},
+	{"write_image_balanced", write_image_balanced, NULL},
+	{"write_image_smallest", write_image_smallest, NULL},
+	{"undo_redo", undo_redo, NULL},
+	{"flood_fill", flood_fill, reset_blocks},
+	{"substitute", substitute, reset_dependencies},
+};
+
+static bool read_bench_map(const char *f, Bench_Map &bm) {
+	// MapName.WxH.tileset.blk
+	const char *name = fl_filename_name(f);
+	Blk_Name bn;
+	if (!parse_blk_name(name, bn) || !bn.dimensions || bn.tileset == bn.dimensions) { return false; }
+	bm.label.assign(name, (size_t)(bn.dimensions - name - 1));
+	bm.blk = f;
+	bm.tileset.assign(bn.tileset, bn.tileset_length);
+	bm.width = bn.width;
+	bm.height = bn.height;
+	char directory[FL_PATH_MAX] = {};
+	if (!Config::project_path_from_blk_path(f, directory)) { return false; }
+	bm.directory = directory;
+	return true;
+}
+
+static bool write_file(const std::string &f, const std::vector<uchar> &data) {
+	FILE *file = fl_fopen(f.c_str(), "wb");
+	if (!file) { return false; }
+	size_t n = fwrite(data.data(), 1, data.size(), file);
+	fclose(file);
+	return n == data.size();
+}
+
+static void put_lz_command(std::vector<uchar> &lz, int cmd, size_t n) {
+	if (n > 32) {
+		lz.push_back((uchar)(0xe0 | (cmd << 2) | ((n - 1) >> 8)));
+		lz.push_back((uchar)(n - 1));
+	}
+	else {
+		lz.push_back((uchar)((cmd << 5) | (n - 1)));
+	}
+}
+
+static void put_lz_literals(std::vector<uchar> &lz, const std::vector<uchar> &data, size_t start, size_t end) {
+	while (start < end) {
+		size_t n = MIN(end - start, (size_t)1024);
+		put_lz_command(lz, 0, n); // LZ_LITERAL
+		lz.insert(lz.end(), data.begin() + start, data.begin() + start + n);
+		start += n;
+	}
+}
+
+static bool write_tileset_copies(const Bench_State &state) {
+	// Convert the tileset's PNG to .2bpp and .2bpp.lz for the other decoders
+	Tiled_Image ti(state.png_path.c_str());
+	if (ti.result() != Tiled_Image::Result::IMG_OK) { return false; }
+	std::vector<uchar> twobpp;
+	for (size_t i = 0; i < ti.num_tiles(); i++) {
+		for (size_t y = 0; y < TILE_SIZE; y++) {
+			uchar b1 = 0, b2 = 0;
+			for (size_t x = 0; x < TILE_SIZE; x++) {
+				int h = (int)ti.tile_hue(i, x, y);
+				b1 = (uchar)(b1 << 1 | (h >> 1));
+				b2 = (uchar)(b2 << 1 | (h & 1));
+			}
+			twobpp.push_back(b1);
+			twobpp.push_back(b2);
+		}
+	}
+	if (!write_file(state.twobpp_path, twobpp)) { return false; }
+	// Compress runs of one byte (like pokecrystal's blank and iterate commands)
+	// and store everything else as literals
+	std::vector<uchar> lz;
+	size_t n = twobpp.size(), i = 0, literal = 0;
+	while (i < n) {
+		size_t run = 1;
+		while (i + run < n && twobpp[i + run] == twobpp[i] && run < 1024) { run++; }
+		if (run < 3) { i++; continue; }
+		put_lz_literals(lz, twobpp, literal, i);
+		if (twobpp[i]) {
+			put_lz_command(lz, 1, run); // LZ_ITERATE
+			lz.push_back(twobpp[i]);
+		}
+		else {
+			put_lz_command(lz, 3, run); // LZ_BLANK
+		}
+		i += run;
+		literal = i;
+	}
+	put_lz_literals(lz, twobpp, literal, n);
+	lz.push_back(0xff); // LZ_END
+	return write_file(state.lz_path, lz);
+}
+
+static bool write_synthetic_events(const char *f, uint16_t width, uint16_t height) {
+	// Every kind of event scattered over the part of the map that event coordinates reach
+	static const char *macros[] = {"warp_event", "coord_event", "bg_event", "object_event"};
+	FILE *file = fl_fopen(f, "wb");
+	if (!file) { return false; }
+	uint32_t w = MIN((uint32_t)width * 2, (uint32_t)256), h = MIN((uint32_t)height * 2, (uint32_t)256);
+	uint32_t seed = 0x6d2b79f5;
+	for (size_t i = 0; i < SYNTHETIC_EVENTS; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		fprintf(file, "\t%s %u, %u, EVENT_%u\n", macros[i % 4], seed % w, (seed >> 16) % h, (unsigned int)i);
+	}
+	fclose(file);
+	return true;
+}
+
+static bool write_synthetic_map(const char *f, size_t num_metatiles) {
+	// Patches of repeated blocks with some noise, so fills have regions to spread through
+	std::vector<uchar> blk(SYNTHETIC_SIZE * SYNTHETIC_SIZE);
+	uint32_t seed = 0x2c9277b5;
+	for (size_t y = 0; y < SYNTHETIC_SIZE; y++) {
+		for (size_t x = 0; x < SYNTHETIC_SIZE; x++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			size_t patch = (y / 16) * 131 + (x / 16) * 31;
+			size_t id = seed % 8 ? patch : seed >> 8;
+			blk[y * SYNTHETIC_SIZE + x] = (uchar)(id % num_metatiles);
+		}
+	}
+	return write_file(f, blk);
+}
+
+static double median(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	size_t n = v.size();
+	return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+static bool run_map(const Bench_Map &bm, const std::string &work, size_t iterations, std::vector<Bench_Result> &results) {
+	char buffer[FL_PATH_MAX] = {};
+	const char *directory = bm.directory.c_str(), *tileset_name = bm.tileset.c_str();
+	Bench_State state;
+	state.bm = &bm;
+	Config::tileset_png_path(buffer, directory, tileset_name);
+	state.png_path = buffer;
+	state.twobpp_path = work + bm.tileset + ".2bpp";
+	state.lz_path = work + bm.tileset + ".2bpp.lz";
+	Config::palette_map_path(buffer, directory, tileset_name);
+	state.palette_map_path = buffer;
+	Config::metatileset_path(buffer, directory, tileset_name);
+	state.metatileset_path = buffer;
+	state.bin_collisions = Config::collisions_path(buffer, directory, tileset_name);
+	state.collisions_path = buffer;
+	Config::bg_tiles_pal_path(buffer, directory);
+	state.lighting_path = buffer;
+	state.events_path = work + bm.label + ".events.asm";
+	state.image_path = work + bm.label + ".png";
+	std::string maps_directory = bm.directory + Config::maps_dir();
+	dirent **list;
+	int m = fl_filename_list(maps_directory.c_str(), &list);
+	for (int i = 0; i < m; i++) {
+		if (fl_filename_match(list[i]->d_name, "*.[Bb][Ll][Kk]")) { state.blk_names.push_back(maps_directory + list[i]->d_name); }
+	}
+	if (m >= 0) { fl_filename_free_list(&list, m); }
+	if (!write_tileset_copies(state)) {
+		fprintf(stderr, "%s: cannot convert %s\n", bm.label.c_str(), state.png_path.c_str());
+		return false;
+	}
+	if (!write_synthetic_events(state.events_path.c_str(), bm.width, bm.height)) {
+		fprintf(stderr, "%s: cannot write %s\n", bm.label.c_str(), state.events_path.c_str());
+		return false;
+	}
+
+	// Load everything once, as Main_Window::open_map does
+	Metatileset metatileset;
+	Map map;
+	Dependency_Index *dependencies = new Dependency_Index();
+	Event_Script events;
+	state.metatileset = &metatileset;
+	state.map = &map;
+	state.dependencies = dependencies;
+	state.events = &events;
+	Tileset *tileset = metatileset.tileset();
+	tileset->name(tileset_name);
+	bool ok = !tileset->read_palette_map(state.palette_map_path.c_str()) &&
+		!tileset->read_graphics(state.png_path.c_str(), Lighting::DAY) &&
+		read_metatiles(state) && metatileset.size();
+	map.size(bm.width, bm.height);
+	ok = ok && map.read_blocks(bm.blk.c_str()) == Map::Result::MAP_OK;
+	if (!ok) {
+		fprintf(stderr, "%s: cannot load %s\n", bm.label.c_str(), bm.blk.c_str());
+		map.clear();
+		delete dependencies;
+		return false;
+	}
+	dependencies->index(metatileset, map);
+	events.read_events(state.events_path.c_str());
+	events.index(bm.width, bm.height);
+	state.ids.resize(map.size());
+	map.copy_ids(state.ids.data());
+	// Fill and substitute the most common block
+	state.common_id = 0;
+	for (size_t i = 1; i < metatileset.size(); i++) {
+		if (dependencies->cells((uint8_t)i).size() > dependencies->cells(state.common_id).size()) {
+			state.common_id = (uint8_t)i;
+		}
+	}
+	state.other_id = (uint8_t)((state.common_id + 1) % metatileset.size());
+	state.common_cell = dependencies->cells(state.common_id)[0];
+
+	for (const Bench &b : benches) {
+		fprintf(stderr, "%s: %s...\n", bm.label.c_str(), b.name);
+		std::vector<double> times;
+		for (size_t k = 0; k < iterations; k++) {
+			Clock::time_point start = Clock::now();
+			ok = b.run(state);
+			Clock::time_point end = Clock::now();
+			if (!ok) { break; }
+			times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+			if (b.reset) { b.reset(state); }
+		}
+		if (!ok) {
+			fprintf(stderr, "%s: %s failed\n", bm.label.c_str(), b.name);
+			break;
+		}
+		Bench_Result r;
+		r.map = bm.label;
+		r.name = b.name;
+		r.width = bm.width;
+		r.height = bm.height;
+		r.iterations = iterations;
+		r.min_ms = *std::min_element(times.begin(), times.end());
+		r.max_ms = *std::max_element(times.begin(), times.end());
+		r.median_ms = median(times);
+		double sum = 0.0;
+		for (double t : times) { sum += t; }
+		r.mean_ms = sum / times.size();
+		results.push_back(r);
+	}
+
+	map.clear();
+	delete dependencies;
+	return ok;
+}
+
+static void write_json(FILE *file, const std::vector<Bench_Result> &results, size_t iterations) {
+	fprintf(file, "{\n\t\"program\": \"%s\",\n\t\"version\": \"%s\",\n", PROGRAM_NAME, PROGRAM_VERSION_STRING);
+	fprintf(file, "\t\"cores\": %u,\n\t\"iterations\": %u,\n\t\"results\": [", num_cores(), (unsigned int)iterations);
+	for (size_t i = 0; i < results.size(); i++) {
+		const Bench_Result &r = results[i];
+		fprintf(file, "%s\n\t\t{\"map\": \"%s\", \"width\": %u, \"height\": %u, \"benchmark\": \"%s\", "
+			"\"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, \"max_ms\": %.4f}",
+			i ? "," : "", r.map.c_str(), r.width, r.height, r.name.c_str(),
+			r.min_ms, r.median_ms, r.mean_ms, r.max_ms);
+	}
+	fprintf(file, "\n\t]\n}\n");
+}
+
+static void write_csv(FILE *file, const std::vector<Bench_Result> &results) {
+	fprintf(file, "version,map,width,height,benchmark,iterations,min_ms,median_ms,mean_ms,max_ms\n");
+	for (const Bench_Result &r : results) {
+		fprintf(file, "%s,%s,%u,%u,%s,%u,%.4f,%.4f,%.4f,%.4f\n", PROGRAM_VERSION_STRING, r.map.c_str(),
+			r.width, r.height, r.name.c_str(), (unsigned int)r.iterations, r.min_ms, r.median_ms, r.mean_ms, r.max_ms);
+	}
+}
+
+int main(int argc, char **argv) {
+	size_t iterations = DEFAULT_ITERATIONS;
+	std::string work, json, csv;
+	std::vector<Bench_Map> maps;
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg.compare(0, 13, "--iterations=") == 0) { iterations = (size_t)MAX(atoi(argv[i] + 13), 1); }
+		else if (arg.compare(0, 7, "--work=") == 0) { work = argv[i] + 7; }
+		else if (arg.compare(0, 7, "--json=") == 0) { json = argv[i] + 7; }
+		else if (arg.compare(0, 6, "--csv=") == 0) { csv = argv[i] + 6; }
+		else {
+			Bench_Map bm;
+			if (!read_bench_map(argv[i], bm)) {
+				fprintf(stderr, "%s: expected MapName.WxH.tileset.blk in a project\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			maps.push_back(bm);
+		}
+	}
+	if (maps.empty()) {
+		fprintf(stderr, "Usage: %s [--iterations=N] [--work=DIR] [--json=FILE] [--csv=FILE] "
+			"MapName.WxH.tileset.blk...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!work.empty() && !ends_with(work, DIR_SEP)) { work += DIR_SEP; }
+
+	// A generated map spanning several block chunks in each direction
+	Bench_Map synthetic = maps[0];
+	synthetic.label = "Synthetic";
+	synthetic.blk = work + "Synthetic.255x255." + synthetic.tileset + ".blk";
+	synthetic.width = synthetic.height = SYNTHETIC_SIZE;
+	{
+		char buffer[FL_PATH_MAX] = {};
+		Config::metatileset_path(buffer, synthetic.directory.c_str(), synthetic.tileset.c_str());
+		FILE *file = fl_fopen(buffer, "rb");
+		size_t n = 0;
+		if (file) {
+			fseek(file, 0, SEEK_END);
+			n = (size_t)ftell(file) / (METATILE_SIZE * METATILE_SIZE);
+			fclose(file);
+		}
+		if (!n || !write_synthetic_map(synthetic.blk.c_str(), MIN(n, (size_t)MAX_NUM_METATILES))) {
+			fprintf(stderr, "Cannot write %s\n", synthetic.blk.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	maps.push_back(synthetic);
+
+	std::vector<Bench_Result> results;
+	bool ok = true;
+	for (const Bench_Map &bm : maps) {
+		ok = run_map(bm, work, iterations, results) && ok;
+	}
+
+	if (json.empty() && csv.empty()) {
+		write_json(stdout, results, iterations);
+	}
+	if (!json.empty()) {
+		FILE *file = fl_fopen(json.c_str(), "w");
+		if (!file) { fprintf(stderr, "Cannot write %s\n", json.c_str()); return EXIT_FAILURE; }
+		write_json(file, results, iterations);
+		fclose(file);
+	}
+	if (!csv.empty()) {
+		FILE *file = fl_fopen(csv.c_str(), "w");
+		if (!file) { fprintf(stderr, "Cannot write %s\n", csv.c_str()); return EXIT_FAILURE; }
+		write_csv(file, results);
+		fclose(file);
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
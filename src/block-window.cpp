@@ -123,7 +123,8 @@ void Block_Window::tileset(const Tileset *t) {
 	}
 }
 
-void Block_Window::metatile(const Metatile *mt, bool has_collisions, bool bin_collisions) {
+void Block_Window::metatile(const Metatile *mt, const Symbol_Table &collision_names, bool has_collisions,
+	bool bin_collisions) {
 	_metatile_id = mt->id();
 	for (int y = 0; y < METATILE_SIZE; y++) {
 		for (int x = 0; x < METATILE_SIZE; x++) {
@@ -153,7 +154,7 @@ void Block_Window::metatile(const Metatile *mt, bool has_collisions, bool bin_co
 			bin->deactivate();
 			cin->show();
 			if (has_collisions) {
-				cin->value(mt->collision((Quadrant)i).c_str());
+				cin->value(collision_names.name(mt->collision((Quadrant)i)));
 				cin->activate();
 			}
 			else {
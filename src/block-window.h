@@ -12,6 +12,7 @@
 #include "map-buttons.h"
 #include "palette-map.h"
 #include "metatile.h"
+#include "symbol-table.h"
 #include "widgets.h"
 
 class Block_Window {
@@ -38,7 +39,8 @@ private:
 	void refresh(void);
 public:
 	void tileset(const Tileset *t);
-	void metatile(const Metatile *mt, bool has_collisions, bool bin_collisions);
+	void metatile(const Metatile *mt, const Symbol_Table &collision_names, bool has_collisions,
+		bool bin_collisions);
 	inline Chip *chip(int x, int y) { return _chips[y * METATILE_SIZE + x]; }
 	inline uint8_t tile_id(int x, int y) { return _chips[y * METATILE_SIZE + x]->id(); }
 	inline const char *collision(Quadrant q) { return _collision_inputs[q]->value(); }
@@ -0,0 +1,148 @@
+#include <cstring>
+
+#include "tile.h"
+#include "collision-overlay.h"
+
+#define OVERLAY_ALPHA 112 // out of 256
+#define GLYPH_ALPHA 208 // out of 256
+
+struct Collision_Style {
+	uchar rgb[NUM_CHANNELS];
+	uint8_t glyph[COLLISION_GLYPH_SIZE]; // one bit per pixel, high bit on the left
+};
+
+static const Collision_Style collision_styles[NUM_COLLISION_KINDS] = {
+	{{0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0}}, // NONE
+	{{208, 32, 32}, {0x00, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x00}}, // WALL: X
+	{{32, 96, 240}, {0x00, 0x00, 0x32, 0x4C, 0x00, 0x32, 0x4C, 0x00}}, // WATER: waves
+	{{16, 48, 168}, {0x00, 0x10, 0x38, 0x7C, 0x10, 0x10, 0x10, 0x00}}, // CURRENT: arrow
+	{{40, 192, 56}, {0x00, 0x00, 0x44, 0x54, 0x54, 0x00, 0x00, 0x00}}, // GRASS: tufts
+	{{16, 104, 32}, {0x00, 0x18, 0x3C, 0x7E, 0x18, 0x18, 0x00, 0x00}}, // TREE
+	{{128, 232, 248}, {0x00, 0x54, 0x38, 0x7C, 0x38, 0x54, 0x00, 0x00}}, // ICE: snowflake
+	{{72, 48, 24}, {0x00, 0x3C, 0x42, 0x42, 0x42, 0x42, 0x3C, 0x00}}, // PIT: O
+	{{176, 64, 232}, {0x00, 0x3C, 0x24, 0x24, 0x2C, 0x24, 0x24, 0x00}}, // WARP: door
+	{{240, 224, 40}, {0x00, 0x18, 0x18, 0x18, 0x18, 0x00, 0x18, 0x00}}, // INTERACT: !
+	{{240, 152, 24}, {0x00, 0x00, 0x7E, 0x3C, 0x18, 0x00, 0x00, 0x00}}, // LEDGE_DOWN
+	{{240, 152, 24}, {0x00, 0x00, 0x18, 0x3C, 0x7E, 0x00, 0x00, 0x00}}, // LEDGE_UP
+	{{240, 152, 24}, {0x00, 0x08, 0x18, 0x38, 0x38, 0x18, 0x08, 0x00}}, // LEDGE_LEFT
+	{{240, 152, 24}, {0x00, 0x10, 0x18, 0x1C, 0x1C, 0x18, 0x10, 0x00}}, // LEDGE_RIGHT
+	{{128, 128, 128}, {0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00}}, // OTHER: dot
+};
+
+static inline uchar blend(uchar d, uchar s, int a) {
+	return (uchar)((d * (256 - a) + s * a) >> 8);
+}
+
+Collision_Overlay::Collision_Overlay() : _name_kinds(), _bin_kinds() {
+	for (int i = 0; i < 256; i++) {
+		_bin_kinds[i] = (uint8_t)bin_kind((uint8_t)i);
+	}
+}
+
+void Collision_Overlay::update(const Symbol_Table &names) {
+	// Names are only ever added to a table, so classify the new ones
+	if (_name_kinds.size() > names.size()) { _name_kinds.clear(); }
+	for (size_t i = _name_kinds.size(); i < names.size(); i++) {
+		_name_kinds.push_back((uint8_t)name_kind(names.name((uint16_t)i)));
+	}
+}
+
+Collision_Kind Collision_Overlay::kind(const Metatile *mt, Quadrant q, bool bin) const {
+	if (bin) { return (Collision_Kind)_bin_kinds[mt->bin_collision(q)]; }
+	uint16_t c = mt->collision(q);
+	return c < _name_kinds.size() ? (Collision_Kind)_name_kinds[c] : COLL_KIND_NONE;
+}
+
+void Collision_Overlay::composite(uchar *dst, size_t line_bytes, int ms, const Metatile *mt, bool bin) const {
+	int qs = ms / 2, scale = MAX(qs / (COLLISION_GLYPH_SIZE * 2), 1);
+	int pad = (qs - COLLISION_GLYPH_SIZE * scale) / 2;
+	for (int i = 0; i < NUM_QUADRANTS; i++) {
+		Collision_Kind k = kind(mt, (Quadrant)i, bin);
+		if (k == COLL_KIND_NONE) { continue; }
+		const Collision_Style &style = collision_styles[k];
+		uchar *quadrant = dst + (size_t)(i / 2) * qs * line_bytes + (size_t)(i % 2) * qs * NUM_CHANNELS;
+		for (int y = 0; y < qs; y++) {
+			uchar *px = quadrant + y * line_bytes;
+			int gy = (y - pad) / scale;
+			uint8_t row = y >= pad && gy < COLLISION_GLYPH_SIZE ? style.glyph[gy] : 0;
+			for (int x = 0; x < qs; x++, px += NUM_CHANNELS) {
+				int gx = (x - pad) / scale;
+				if (row && x >= pad && gx < COLLISION_GLYPH_SIZE && (row & (0x80 >> gx))) {
+					// dark glyphs on light tints, light glyphs on dark ones
+					uchar g = style.rgb[0] + style.rgb[1] + style.rgb[2] > 384 ? 0 : 255;
+					for (int c = 0; c < NUM_CHANNELS; c++) { px[c] = blend(px[c], g, GLYPH_ALPHA); }
+				}
+				else {
+					for (int c = 0; c < NUM_CHANNELS; c++) { px[c] = blend(px[c], style.rgb[c], OVERLAY_ALPHA); }
+				}
+			}
+		}
+	}
+}
+
+static bool has(const char *name, const char *part) {
+	return strstr(name, part) != NULL;
+}
+
+Collision_Kind Collision_Overlay::name_kind(const char *name) {
+	// Guess from the words in a collision constant, e.g. "COLL_HOP_DOWN_LEFT"
+	if (!*name || has(name, "FLOOR")) { return COLL_KIND_NONE; }
+	if (has(name, "HOP") || has(name, "LEDGE")) {
+		if (has(name, "DOWN")) { return COLL_KIND_LEDGE_DOWN; }
+		if (has(name, "UP")) { return COLL_KIND_LEDGE_UP; }
+		if (has(name, "LEFT")) { return COLL_KIND_LEDGE_LEFT; }
+		if (has(name, "RIGHT")) { return COLL_KIND_LEDGE_RIGHT; }
+	}
+	if (has(name, "CURRENT") || has(name, "WATERFALL") || has(name, "WHIRLPOOL")) { return COLL_KIND_CURRENT; }
+	if (has(name, "WATER") || has(name, "BUOY")) { return COLL_KIND_WATER; }
+	if (has(name, "GRASS")) { return COLL_KIND_GRASS; }
+	if (has(name, "TREE")) { return COLL_KIND_TREE; }
+	if (has(name, "ICE")) { return COLL_KIND_ICE; }
+	if (has(name, "PIT") || has(name, "HOLE")) { return COLL_KIND_PIT; }
+	if (has(name, "WARP") || has(name, "DOOR") || has(name, "STAIR") || has(name, "LADDER") || has(name, "CAVE") ||
+		has(name, "CARPET")) {
+		return COLL_KIND_WARP;
+	}
+	if (has(name, "WALL")) { return COLL_KIND_WALL; }
+	if (has(name, "COUNTER") || has(name, "BOOKSHELF") || has(name, "PC") || has(name, "RADIO") ||
+		has(name, "TOWN_MAP") || has(name, "SHELF") || has(name, "TV") || has(name, "WINDOW") ||
+		has(name, "INCENSE") || has(name, "SIGN")) {
+		return COLL_KIND_INTERACT;
+	}
+	return COLL_KIND_OTHER;
+}
+
+Collision_Kind Collision_Overlay::bin_kind(uint8_t c) {
+	// pokecrystal's collision values are grouped by their high nybble
+	switch (c & 0xF0) {
+	case 0x00:
+		return c == 0x00 ? COLL_KIND_NONE : c == 0x07 ? COLL_KIND_WALL : COLL_KIND_OTHER;
+	case 0x10:
+		return c == 0x12 || c == 0x15 || c == 0x1A || c == 0x1D ? COLL_KIND_TREE : COLL_KIND_GRASS;
+	case 0x20:
+		return c == 0x23 ? COLL_KIND_ICE : c == 0x24 ? COLL_KIND_CURRENT : COLL_KIND_WATER;
+	case 0x30:
+	case 0x40:
+		return COLL_KIND_CURRENT;
+	case 0x60:
+		return COLL_KIND_PIT;
+	case 0x70:
+		return COLL_KIND_WARP;
+	case 0x90:
+		return COLL_KIND_INTERACT;
+	case 0xA0:
+		switch (c) {
+		case 0xA0: return COLL_KIND_LEDGE_RIGHT;
+		case 0xA1: return COLL_KIND_LEDGE_LEFT;
+		case 0xA2: case 0xA6: case 0xA7: return COLL_KIND_LEDGE_UP;
+		case 0xA3: case 0xA4: case 0xA5: return COLL_KIND_LEDGE_DOWN;
+		default: return COLL_KIND_OTHER;
+		}
+	case 0xB0:
+	case 0xC0:
+	case 0xF0:
+		return COLL_KIND_WALL;
+	default:
+		return COLL_KIND_OTHER;
+	}
+}
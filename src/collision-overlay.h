@@ -0,0 +1,37 @@
+#ifndef COLLISION_OVERLAY_H
+#define COLLISION_OVERLAY_H
+
+#include <vector>
+
+#pragma warning(push, 0)
+#include <FL/fl_types.h>
+#pragma warning(pop)
+
+#include "utils.h"
+#include "metatile.h"
+#include "symbol-table.h"
+
+#define COLLISION_GLYPH_SIZE 8
+
+// Classes of collision that the overlay tells apart
+enum Collision_Kind { COLL_KIND_NONE, COLL_KIND_WALL, COLL_KIND_WATER, COLL_KIND_CURRENT, COLL_KIND_GRASS,
+	COLL_KIND_TREE, COLL_KIND_ICE, COLL_KIND_PIT, COLL_KIND_WARP, COLL_KIND_INTERACT, COLL_KIND_LEDGE_DOWN,
+	COLL_KIND_LEDGE_UP, COLL_KIND_LEDGE_LEFT, COLL_KIND_LEDGE_RIGHT, COLL_KIND_OTHER, NUM_COLLISION_KINDS };
+
+// Tints each quadrant of a rendered block by its collision and marks it with
+// a glyph, looking both up by interned collision name or .bin collision byte
+class Collision_Overlay {
+private:
+	std::vector<uint8_t> _name_kinds;
+	uint8_t _bin_kinds[256];
+public:
+	Collision_Overlay();
+	inline void clear(void) { _name_kinds.clear(); }
+	void update(const Symbol_Table &names);
+	Collision_Kind kind(const Metatile *mt, Quadrant q, bool bin) const;
+	void composite(uchar *dst, size_t line_bytes, int ms, const Metatile *mt, bool bin) const;
+	static Collision_Kind name_kind(const char *name);
+	static Collision_Kind bin_kind(uint8_t c);
+};
+
+#endif
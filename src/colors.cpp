@@ -1,6 +1,5 @@
 #include <cstdio>
-#include <fstream>
-#include <sstream>
+#include <cstring>
 
 #pragma warning(push, 0)
 #include <FL/Fl.H>
@@ -9,6 +8,8 @@
 #include "colors.h"
 #include "utils.h"
 #include "config.h"
+#include "mapped-file.h"
+#include "tokenizer.h"
 
 #define RGB5(r, g, b) {RGB5C(r), RGB5C(g), RGB5C(b)}
 #define RGBX(rgb) {(((rgb) & 0xFF0000) >> 16), (((rgb) & 0xFF00) >> 8), ((rgb) & 0xFF)}
@@ -94,6 +95,15 @@ const uchar *Color::color(Lighting l, Palette p, Hue h) {
 	return p == Palette::UNDEFINED ? undefined_colors[h] : tileset_colors[l][c][h];
 }
 
+const uchar *Color::color(const Palette_Colors &colors, Palette p, Hue h) {
+	int c = (int)p & 0xf;
+	return p == Palette::UNDEFINED ? undefined_colors[h] : colors[c][h];
+}
+
+void Color::copy_colors(Lighting l, Palette_Colors &colors) {
+	memcpy(colors, tileset_colors[l], sizeof(Palette_Colors));
+}
+
 void Color::color(Lighting l, Palette p, Hue h, ColorArray v) {
 	int c = (int)p & 0xf;
 	for (int i = 0; i < NUM_CHANNELS; i++) {
@@ -124,19 +134,18 @@ Fl_Color Color::fl_color(Lighting l, Palette p, Hue h) {
 PalVec Color::parse_lighting(const char *f) {
 	PalVec colors;
 	int palette = 0, hue = 0, channel = 0;
-	std::ifstream ifs(f);
-	while (ifs.good()) {
-		std::string line;
-		std::getline(ifs, line);
-		trim(line);
-		if (!starts_with(line, "RGB")) { continue; }
-		line.erase(0, strlen("RGB") + 1); // include next whitespace character
-		line += ";"; // ensure trailing separator
-		std::istringstream lss(line);
-		while (lss.good()) {
+	Mapped_File file(f);
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, value;
+	while (tokenizer.next_line(line)) {
+		line.trim();
+		if (!line.starts_with("RGB")) { continue; }
+		line.skip(strlen("RGB") + 1); // include next whitespace character
+		line.remove_comment();
+		while (line.split(',', value)) {
+			value.trim();
 			unsigned int v;
-			char sep;
-			lss >> v >> sep;
+			if (!value.to_uint(v)) { continue; }
 			if (hue == 0 && channel == 0) {
 				colors.emplace_back();
 			}
@@ -148,7 +157,6 @@ PalVec Color::parse_lighting(const char *f) {
 					palette++;
 				}
 			}
-			if (sep == ';') { break; }
 		}
 	}
 	return colors;
@@ -29,6 +29,8 @@ enum Hue { WHITE, DARK, LIGHT, BLACK };
 typedef std::array<uchar, NUM_CHANNELS> ColorArray;
 typedef std::array<ColorArray, NUM_HUES> HueArray;
 typedef std::vector<HueArray> PalVec;
+// One lighting's colors, copied so other threads can use them while the originals change
+typedef uchar Palette_Colors[NUM_GAME_PALETTES+1][NUM_HUES][NUM_CHANNELS];
 
 class Color {
 private:
@@ -37,6 +39,8 @@ private:
 public:
 	static Hue ordered_hue(int i);
 	static const uchar *color(Lighting l, Palette p, Hue h);
+	static const uchar *color(const Palette_Colors &colors, Palette p, Hue h);
+	static void copy_colors(Lighting l, Palette_Colors &colors);
 	static void color(Lighting l, Palette p, Hue h, Fl_Color c);
 	static Fl_Color fl_color(Lighting l, Palette p, Hue h);
 	static PalVec parse_lighting(const char *f);
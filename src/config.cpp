@@ -1,5 +1,7 @@
 #include <cstdio>
 #include <cstring>
+#include <string>
+#include <unordered_map>
 
 #pragma warning(push, 0)
 #include <FL/filename.H>
@@ -8,19 +10,176 @@
 #include "utils.h"
 #include "config.h"
 
-static char *trim_suffix(const char *s) {
+static void trim_suffix(char *dest, const char *s) {
 	// remove trailing ".t#", e.g. tileset "overworld.t2" -> name "overworld"
-#ifdef _WIN32
-	char *t = _strdup(s);
-#else
-	char *t = strdup(s);
-#endif
-	char *dot = strchr(t, '.');
-	if (dot) { *dot = '\0'; }
-	return t;
+	const char *dot = strchr(s, '.');
+	size_t n = dot ? (size_t)(dot - s) : strlen(s);
+	memcpy(dest, s, n);
+	dest[n] = '\0';
 }
 
-bool Config::_monochrome = false, Config::_256_tiles = false;
+// Lookups are resolved once per project and then served from these caches
+// until the project directory changes or a save adds new files.
+// The caches are not locked, so Config's path functions must only be called
+// from the main thread; worker jobs get paths resolved beforehand (see
+// World_Map::add_tileset)
+struct Resolved_Path {
+	std::string path;
+	bool result;
+};
+
+static std::unordered_map<std::string, Resolved_Path> resolved_paths;
+static std::unordered_map<std::string, bool> candidate_dirs;
+
+static bool candidate_exists(const char *f) {
+	// A missing directory rules out every candidate inside it, so each
+	// layout's directories (data/tilesets, gfx/blocksets, color/tilesets...)
+	// are only checked once
+	const char *sep = strrchr(f, *DIR_SEP);
+	if (sep) {
+		std::string dir(f, (size_t)(sep - f));
+		auto it = candidate_dirs.find(dir);
+		if (it == candidate_dirs.end()) {
+			it = candidate_dirs.emplace(dir, !!fl_filename_isdir(dir.c_str())).first;
+		}
+		if (!it->second) { return false; }
+	}
+	return file_exists(f);
+}
+
+typedef bool (*Path_Resolver)(char *dest, const char *root, const char *name);
+
+static bool resolve_path(char kind, Path_Resolver resolver, char *dest, const char *root, const char *name = "") {
+	std::string key(1, kind);
+	key.append(root).append(1, '\0').append(name);
+	auto it = resolved_paths.find(key);
+	if (it == resolved_paths.end()) {
+		Resolved_Path rp;
+		rp.result = resolver(dest, root, name);
+		rp.path = dest;
+		resolved_paths.emplace(key, rp);
+		return rp.result;
+	}
+	strcpy(dest, it->second.path.c_str());
+	return it->second.result;
+}
+
+static bool resolve_palette_map(char *dest, const char *root, const char *tileset) {
+	// try gfx/tilesets/*_palette_map.asm (pokecrystal)
+	sprintf(dest, "%sgfx" DIR_SEP "tilesets" DIR_SEP "%s_palette_map.asm", root, tileset);
+	if (candidate_exists(dest)) { return true; }
+	// try color/tilesets/*.asm (Red++ 3)
+	char name[FL_PATH_MAX] = {};
+	trim_suffix(name, tileset);
+	sprintf(dest, "%scolor" DIR_SEP "tilesets" DIR_SEP "%s.asm", root, name);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: tilesets/*_palette_map.asm (old pokecrystal)
+	sprintf(dest, "%stilesets" DIR_SEP "%s_palette_map.asm", root, tileset);
+	return true;
+}
+
+static bool resolve_tileset(char *dest, const char *root, const char *tileset) {
+	// try gfx/tilesets/*.png (pokecrystal)
+	sprintf(dest, "%s%s%s.png", root, Config::gfx_tileset_dir(), tileset);
+	if (candidate_exists(dest)) { return true; }
+	// try gfx/tilesets/*.2bpp
+	sprintf(dest, "%s%s%s.2bpp", root, Config::gfx_tileset_dir(), tileset);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: gfx/tilesets/*.2bpp.lz
+	sprintf(dest, "%s%s%s.2bpp.lz", root, Config::gfx_tileset_dir(), tileset);
+	return true;
+}
+
+static bool resolve_roof(char *dest, const char *root, const char *roof) {
+	// try gfx/tilesets/roofs/*.png
+	sprintf(dest, "%s%s%s.png", root, Config::gfx_roof_dir(), roof);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: gfx/tilesets/roofs/*.2bpp
+	sprintf(dest, "%s%s%s.2bpp", root, Config::gfx_roof_dir(), roof);
+	return true;
+}
+
+static bool resolve_metatileset(char *dest, const char *root, const char *tileset) {
+	// try data/tilesets/*_metatiles.bin (pokecrystal)
+	sprintf(dest, "%sdata" DIR_SEP "tilesets" DIR_SEP "%s_metatiles.bin", root, tileset);
+	if (candidate_exists(dest)) { return true; }
+	// try gfx/blocksets/*.bst (pokered)
+	char name[FL_PATH_MAX] = {};
+	trim_suffix(name, tileset);
+	sprintf(dest, "%sgfx" DIR_SEP "blocksets" DIR_SEP "%s.bst", root, name);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: tilesets/*_metatiles.bin (old pokecrystal)
+	sprintf(dest, "%stilesets" DIR_SEP "%s_metatiles.bin", root, tileset);
+	return true;
+}
+
+static bool resolve_collisions(char *dest, const char *root, const char *tileset) {
+	// try data/tilesets/*_collision.asm (pokecrystal)
+	sprintf(dest, "%sdata" DIR_SEP "tilesets" DIR_SEP "%s_collision.asm", root, tileset);
+	if (candidate_exists(dest)) { return false; }
+	// try tilesets/*_collision.asm (old pokecrystal, converted from .bin)
+	sprintf(dest, "%stilesets" DIR_SEP "%s_collision.asm", root, tileset);
+	if (candidate_exists(dest)) { return false; }
+	// last resort: tilesets/*_collision.bin (old pokecrystal)
+	sprintf(dest, "%stilesets" DIR_SEP "%s_collision.bin", root, tileset);
+	return true;
+}
+
+static bool resolve_map_constants(char *dest, const char *root, const char *) {
+	// try constants/map_dimension_constants.asm (Prism)
+	sprintf(dest, "%sconstants" DIR_SEP "map_dimension_constants.asm", root);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: constants/map_constants.asm (pokecrystal, pokered)
+	sprintf(dest, "%sconstants" DIR_SEP "map_constants.asm", root);
+	return true;
+}
+
+static bool resolve_map_headers(char *dest, const char *root, const char *) {
+	// try data/maps/maps.asm (pokecrystal)
+	sprintf(dest, "%sdata" DIR_SEP "maps" DIR_SEP "maps.asm", root);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: maps/map_headers.asm (old pokecrystal)
+	sprintf(dest, "%smaps" DIR_SEP "map_headers.asm", root);
+	return candidate_exists(dest);
+}
+
+static bool resolve_map_attributes(char *dest, const char *root, const char *map_name) {
+	// try data/maps/attributes.asm (pokecrystal)
+	sprintf(dest, "%sdata" DIR_SEP "maps" DIR_SEP "attributes.asm", root);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: data/maps/headers/*.asm (pokered)
+	sprintf(dest, "%sdata" DIR_SEP "maps" DIR_SEP "headers" DIR_SEP "%s.asm", root, map_name);
+	return candidate_exists(dest);
+}
+
+static bool resolve_tileset_constants(char *dest, const char *root, const char *) {
+	// try constants/tileset_constants.asm (pokecrystal)
+	sprintf(dest, "%sconstants" DIR_SEP "tileset_constants.asm", root);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: constants/tilemap_constants.asm (old pokecrystal)
+	sprintf(dest, "%sconstants" DIR_SEP "tilemap_constants.asm", root);
+	return true;
+}
+
+static bool resolve_bg_tiles_pal(char *dest, const char *root, const char *) {
+	// try gfx/tilesets/bg_tiles.pal (pokecrystal)
+	sprintf(dest, "%sgfx" DIR_SEP "tilesets" DIR_SEP "bg_tiles.pal", root);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: tilesets/bg.pal (old pokecrystal)
+	sprintf(dest, "%stilesets" DIR_SEP "bg.pal", root);
+	return true;
+}
+
+static bool resolve_roofs_pal(char *dest, const char *root, const char *) {
+	// try gfx/tilesets/roofs.pal (pokecrystal)
+	sprintf(dest, "%sgfx" DIR_SEP "tilesets" DIR_SEP "roofs.pal", root);
+	if (candidate_exists(dest)) { return true; }
+	// last resort: tilesets/roof.pal (old pokecrystal)
+	sprintf(dest, "%stilesets" DIR_SEP "roof.pal", root);
+	return true;
+}
+
+std::atomic<bool> Config::_monochrome(false), Config::_256_tiles(false);
 
 const char *Config::gfx_tileset_dir() {
 	return "gfx" DIR_SEP "tilesets" DIR_SEP;
@@ -30,10 +189,19 @@ const char *Config::gfx_roof_dir() {
 	return "gfx" DIR_SEP "tilesets" DIR_SEP "roofs" DIR_SEP;
 }
 
+const char *Config::maps_dir() {
+	return "maps" DIR_SEP;
+}
+
 const char *Config::palette_macro() {
 	return "\ttilepal";
 }
 
+void Config::invalidate_paths() {
+	resolved_paths.clear();
+	candidate_dirs.clear();
+}
+
 bool Config::project_path_from_blk_path(const char *blk_path, char *project_path) {
 	char scratch_path[FL_PATH_MAX] = {};
 	fl_filename_absolute(scratch_path, blk_path);
@@ -56,27 +224,11 @@ bool Config::project_path_from_blk_path(const char *blk_path, char *project_path
 
 void Config::palette_map_path(char *dest, const char *root, const char *tileset) {
 	if (monochrome()) { return; }
-	// try gfx/tilesets/*_palette_map.asm (pokecrystal)
-	sprintf(dest, "%sgfx" DIR_SEP "tilesets" DIR_SEP "%s_palette_map.asm", root, tileset);
-	if (file_exists(dest)) { return; }
-	// try color/tilesets/*.asm (Red++ 3)
-	char *name = trim_suffix(tileset);
-	sprintf(dest, "%scolor" DIR_SEP "tilesets" DIR_SEP "%s.asm", root, name);
-	free(name);
-	if (file_exists(dest)) { return; }
-	// last resort: tilesets/*_palette_map.asm (old pokecrystal)
-	sprintf(dest, "%stilesets" DIR_SEP "%s_palette_map.asm", root, tileset);
+	resolve_path('p', resolve_palette_map, dest, root, tileset);
 }
 
 void Config::tileset_path(char *dest, const char *root, const char *tileset) {
-	// try gfx/tilesets/*.png (pokecrystal)
-	sprintf(dest, "%s%s%s.png", root, gfx_tileset_dir(), tileset);
-	if (file_exists(dest)) { return; }
-	// try gfx/tilesets/*.2bpp
-	sprintf(dest, "%s%s%s.2bpp", root, gfx_tileset_dir(), tileset);
-	if (file_exists(dest)) { return; }
-	// last resort: gfx/tilesets/*.2bpp.lz
-	sprintf(dest, "%s%s%s.2bpp.lz", root, gfx_tileset_dir(), tileset);
+	resolve_path('t', resolve_tileset, dest, root, tileset);
 }
 
 void Config::tileset_png_path(char *dest, const char *root, const char *tileset) {
@@ -84,11 +236,7 @@ void Config::tileset_png_path(char *dest, const char *root, const char *tileset)
 }
 
 void Config::roof_path(char *dest, const char *root, const char *roof) {
-	// try gfx/tilesets/roofs/*.png
-	sprintf(dest, "%s%s%s.png", root, gfx_roof_dir(), roof);
-	if (file_exists(dest)) { return; }
-	// last resort: gfx/tilesets/roofs/*.2bpp
-	sprintf(dest, "%s%s%s.2bpp", root, gfx_roof_dir(), roof);
+	resolve_path('r', resolve_roof, dest, root, roof);
 }
 
 void Config::roof_png_path(char *dest, const char *root, const char *roof) {
@@ -96,45 +244,19 @@ void Config::roof_png_path(char *dest, const char *root, const char *roof) {
 }
 
 void Config::metatileset_path(char *dest, const char *root, const char *tileset) {
-	// try data/tilesets/*_metatiles.bin (pokecrystal)
-	sprintf(dest, "%sdata" DIR_SEP "tilesets" DIR_SEP "%s_metatiles.bin", root, tileset);
-	if (file_exists(dest)) { return; }
-	// try gfx/blocksets/*.bst (pokered)
-	char *name = trim_suffix(tileset);
-	sprintf(dest, "%sgfx" DIR_SEP "blocksets" DIR_SEP "%s.bst", root, name);
-	free(name);
-	if (file_exists(dest)) { return; }
-	// last resort: tilesets/*_metatiles.bin (old pokecrystal)
-	sprintf(dest, "%stilesets" DIR_SEP "%s_metatiles.bin", root, tileset);
+	resolve_path('m', resolve_metatileset, dest, root, tileset);
 }
 
 bool Config::collisions_path(char *dest, const char *root, const char *tileset) {
-	// try data/tilesets/*_collision.asm (pokecrystal)
-	sprintf(dest, "%sdata" DIR_SEP "tilesets" DIR_SEP "%s_collision.asm", root, tileset);
-	if (file_exists(dest)) { return false; }
-	// try tilesets/*_collision.asm (old pokecrystal, converted from .bin)
-	sprintf(dest, "%stilesets" DIR_SEP "%s_collision.asm", root, tileset);
-	if (file_exists(dest)) { return false; }
-	// last resort: tilesets/*_collision.bin (old pokecrystal)
-	sprintf(dest, "%stilesets" DIR_SEP "%s_collision.bin", root, tileset);
-	return true;
+	return resolve_path('c', resolve_collisions, dest, root, tileset);
 }
 
 void Config::map_constants_path(char *dest, const char *root) {
-	// try constants/map_dimension_constants.asm (Prism)
-	sprintf(dest, "%sconstants" DIR_SEP "map_dimension_constants.asm", root);
-	if (file_exists(dest)) { return; }
-	// last resort: constants/map_constants.asm (pokecrystal, pokered)
-	sprintf(dest, "%sconstants" DIR_SEP "map_constants.asm", root);
+	resolve_path('M', resolve_map_constants, dest, root);
 }
 
 bool Config::map_headers_path(char *dest, const char *root) {
-	// try data/maps/maps.asm (pokecrystal)
-	sprintf(dest, "%sdata" DIR_SEP "maps" DIR_SEP "maps.asm", root);
-	if (file_exists(dest)) { return true; }
-	// last resort: maps/map_headers.asm (old pokecrystal)
-	sprintf(dest, "%smaps" DIR_SEP "map_headers.asm", root);
-	return file_exists(dest);
+	return resolve_path('H', resolve_map_headers, dest, root);
 }
 
 void Config::map_header_path(char *dest, const char *root, const char *map_name) {
@@ -142,26 +264,18 @@ void Config::map_header_path(char *dest, const char *root, const char *map_name)
 	sprintf(dest, "%sdata" DIR_SEP "mapHeaders" DIR_SEP "%s.asm", root, map_name);
 }
 
+bool Config::map_attributes_path(char *dest, const char *root, const char *map_name) {
+	return resolve_path('A', resolve_map_attributes, dest, root, map_name);
+}
+
 void Config::tileset_constants_path(char *dest, const char *root) {
-	// try constants/tileset_constants.asm (pokecrystal)
-	sprintf(dest, "%sconstants" DIR_SEP "tileset_constants.asm", root);
-	if (file_exists(dest)) { return; }
-	// last resort: constants/tilemap_constants.asm (old pokecrystal)
-	sprintf(dest, "%sconstants" DIR_SEP "tilemap_constants.asm", root);
+	resolve_path('T', resolve_tileset_constants, dest, root);
 }
 
 void Config::bg_tiles_pal_path(char *dest, const char *root) {
-	// try gfx/tilesets/bg_tiles.pal (pokecrystal)
-	sprintf(dest, "%sgfx" DIR_SEP "tilesets" DIR_SEP "bg_tiles.pal", root);
-	if (file_exists(dest)) { return; }
-	// last resort: tilesets/bg.pal (old pokecrystal)
-	sprintf(dest, "%stilesets" DIR_SEP "bg.pal", root);
+	resolve_path('b', resolve_bg_tiles_pal, dest, root);
 }
 
 void Config::roofs_pal_path(char *dest, const char *root) {
-	// try gfx/tilesets/roofs.pal (pokecrystal)
-	sprintf(dest, "%sgfx" DIR_SEP "tilesets" DIR_SEP "roofs.pal", root);
-	if (file_exists(dest)) { return; }
-	// last resort: tilesets/roof.pal (old pokecrystal)
-	sprintf(dest, "%stilesets" DIR_SEP "roof.pal", root);
+	resolve_path('R', resolve_roofs_pal, dest, root);
 }
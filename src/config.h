@@ -1,13 +1,19 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <atomic>
+
 class Config {
 private:
-	static bool _monochrome, _256_tiles;
+	// Also read when background threads load tilesets
+	static std::atomic<bool> _monochrome, _256_tiles;
 public:
 	static const char *gfx_tileset_dir(void);
 	static const char *gfx_roof_dir(void);
+	static const char *maps_dir(void);
 	static const char *palette_macro(void);
+	// Path lookups share an unlocked cache, so call them from the main thread only
+	static void invalidate_paths(void);
 	static bool project_path_from_blk_path(const char *blk_path, char *project_path);
 	static void palette_map_path(char *dest, const char *root, const char *tileset);
 	static void tileset_path(char *dest, const char *root, const char *tileset);
@@ -20,6 +26,7 @@ public:
 	static void tileset_constants_path(char *dest, const char *root);
 	static bool map_headers_path(char *dest, const char *root);
 	static void map_header_path(char *dest, const char *root, const char *map_name);
+	static bool map_attributes_path(char *dest, const char *root, const char *map_name);
 	static void bg_tiles_pal_path(char *dest, const char *root);
 	static void roofs_pal_path(char *dest, const char *root);
 	inline static bool monochrome(void) { return _monochrome; }
@@ -0,0 +1,83 @@
+#include <cstring>
+
+#include "dependency-index.h"
+
+Dependency_Index::Dependency_Index() : _tile_uses(), _cells(), _cell_slots() {}
+
+void Dependency_Index::clear() {
+	memset(_tile_uses, 0, sizeof(_tile_uses));
+	for (size_t i = 0; i < MAX_NUM_METATILES; i++) {
+		_cells[i].clear();
+	}
+	_cell_slots.clear();
+}
+
+void Dependency_Index::index(const Metatileset &ms, const Map &map) {
+	clear();
+	for (size_t i = 0; i < ms.size(); i++) {
+		index_metatile(ms.const_metatile((uint8_t)i));
+	}
+	size_t n = map.size();
+	_cell_slots.resize(n);
+	std::vector<uint8_t> ids(n);
+	map.copy_ids(ids.data());
+	for (size_t i = 0; i < n; i++) {
+		add_cell(i, ids[i]);
+	}
+}
+
+void Dependency_Index::index_metatile(const Metatile *mt) {
+	uint8_t mid = mt->id();
+	for (int y = 0; y < METATILE_SIZE; y++) {
+		for (int x = 0; x < METATILE_SIZE; x++) {
+			_tile_uses[mt->tile_id(x, y)][mid]++;
+		}
+	}
+}
+
+void Dependency_Index::unindex_metatile(const Metatile *mt) {
+	uint8_t mid = mt->id();
+	for (int y = 0; y < METATILE_SIZE; y++) {
+		for (int x = 0; x < METATILE_SIZE; x++) {
+			uint8_t &uses = _tile_uses[mt->tile_id(x, y)][mid];
+			if (uses) { uses--; }
+		}
+	}
+}
+
+void Dependency_Index::move_cell(size_t i, uint8_t from, uint8_t to) {
+	if (from == to || i >= _cell_slots.size()) { return; }
+	remove_cell(i, from);
+	add_cell(i, to);
+}
+
+std::vector<uint8_t> Dependency_Index::metatiles_using(const std::vector<uint8_t> &tids) const {
+	std::vector<uint8_t> mids;
+	if (tids.empty()) { return mids; }
+	for (size_t mid = 0; mid < MAX_NUM_METATILES; mid++) {
+		for (uint8_t tid : tids) {
+			if (_tile_uses[tid][mid]) {
+				mids.push_back((uint8_t)mid);
+				break;
+			}
+		}
+	}
+	return mids;
+}
+
+void Dependency_Index::add_cell(size_t i, uint8_t id) {
+	std::vector<size_t> &cells = _cells[id];
+	_cell_slots[i] = cells.size();
+	cells.push_back(i);
+}
+
+void Dependency_Index::remove_cell(size_t i, uint8_t id) {
+	// swap with the last cell so removal is constant-time
+	std::vector<size_t> &cells = _cells[id];
+	size_t slot = _cell_slots[i];
+	if (slot >= cells.size() || cells[slot] != i) { return; }
+	size_t last = cells.back();
+	cells[slot] = last;
+	_cell_slots[last] = slot;
+	cells.pop_back();
+}
@@ -0,0 +1,34 @@
+#ifndef DEPENDENCY_INDEX_H
+#define DEPENDENCY_INDEX_H
+
+#include <vector>
+
+#include "utils.h"
+#include "tileset.h"
+#include "metatileset.h"
+#include "map.h"
+
+class Dependency_Index {
+private:
+	// how many times each metatile uses each tile
+	uint8_t _tile_uses[MAX_NUM_TILES][MAX_NUM_METATILES];
+	// map cells (y * width + x) showing each metatile
+	std::vector<size_t> _cells[MAX_NUM_METATILES];
+	// position of each map cell within its metatile's list
+	std::vector<size_t> _cell_slots;
+public:
+	Dependency_Index();
+	void clear(void);
+	void index(const Metatileset &ms, const Map &map);
+	void index_metatile(const Metatile *mt);
+	void unindex_metatile(const Metatile *mt);
+	void move_cell(size_t i, uint8_t from, uint8_t to);
+	inline bool uses_tile(uint8_t mid, uint8_t tid) const { return _tile_uses[tid][mid] > 0; }
+	inline const std::vector<size_t> &cells(uint8_t mid) const { return _cells[mid]; }
+	std::vector<uint8_t> metatiles_using(const std::vector<uint8_t> &tids) const;
+private:
+	void add_cell(size_t i, uint8_t id);
+	void remove_cell(size_t i, uint8_t id);
+};
+
+#endif
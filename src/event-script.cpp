@@ -0,0 +1,196 @@
+#include "mapped-file.h"
+#include "tokenizer.h"
+#include "event-script.h"
+
+struct Event_Macro {
+	const char *name;
+	Event_Kind kind;
+	size_t x_arg, y_arg;
+};
+
+static const Event_Macro event_macros[] = {
+	// pokecrystal and pokered
+	{"warp_event", WARP_EVENT, 0, 1},
+	{"coord_event", COORD_EVENT, 0, 1},
+	{"bg_event", BG_EVENT, 0, 1},
+	{"object_event", OBJECT_EVENT, 0, 1},
+	// older pokecrystal, which put Y before X
+	{"warp_def", WARP_EVENT, 1, 0},
+	{"xy_trigger", COORD_EVENT, 2, 1},
+	{"signpost", BG_EVENT, 1, 0},
+	{"person_event", OBJECT_EVENT, 2, 1},
+	// older pokered
+	{"warp", WARP_EVENT, 0, 1},
+	{"sign", BG_EVENT, 0, 1},
+	{"object", OBJECT_EVENT, 1, 2},
+};
+
+static const Event_Macro *find_macro(const Token &name) {
+	if (name.size() < 4) { return NULL; }
+	for (const Event_Macro &m : event_macros) {
+		if (name == m.name) { return &m; }
+	}
+	return NULL;
+}
+
+static bool parse_coord(const Token &t, int &v) {
+	// Decimal or $hex; anything else (like an expression) is not understood
+	if (t.empty() || t[0] != '$') {
+		unsigned int n;
+		if (!t.to_uint(n) || n > 0xFF) { return false; }
+		v = (int)n;
+		return true;
+	}
+	if (t.size() < 2 || t.size() > 3) { return false; }
+	int n = 0;
+	for (size_t i = 1; i < t.size(); i++) {
+		char c = t[i];
+		int d = c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 :
+			c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+		if (d < 0) { return false; }
+		n = n * 16 + d;
+	}
+	v = n;
+	return true;
+}
+
+Event_Script::Event_Script() : _events(), _cell_starts(), _cell_events(), _grid_cols(0), _grid_rows(0),
+	_result(EVENTS_NULL) {}
+
+void Event_Script::clear() {
+	_events.clear();
+	_cell_starts.clear();
+	_cell_events.clear();
+	_grid_cols = _grid_rows = 0;
+	_result = EVENTS_NULL;
+}
+
+Event_Script::Result Event_Script::read_events(const char *f) {
+	clear();
+
+	Mapped_File file(f);
+	if (!file.is_open()) { return (_result = BAD_EVENTS_FILE); }
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, macro, field;
+	size_t n = 0;
+	while (tokenizer.next_line(line)) {
+		n++;
+		line.remove_comment();
+		line.trim();
+		Token text(line);
+		if (!line.split_word(macro)) { continue; }
+		const Event_Macro *m = find_macro(macro);
+		if (!m) { continue; }
+		Event e;
+		e.kind = m->kind;
+		e.x = e.y = -1;
+		e.line = n;
+		e.macro = text.str();
+		size_t last = MAX(m->x_arg, m->y_arg);
+		bool ok = true;
+		for (size_t i = 0; ok && i <= last; i++) {
+			if (!line.split(',', field)) { ok = false; break; }
+			field.trim();
+			if (i == m->x_arg) { ok = parse_coord(field, e.x); }
+			else if (i == m->y_arg) { ok = parse_coord(field, e.y); }
+		}
+		if (ok) { _events.push_back(e); }
+	}
+	return (_result = _events.empty() ? NO_EVENTS : EVENTS_OK);
+}
+
+void Event_Script::index(uint16_t map_w, uint16_t map_h) {
+	// Event coordinates are bytes, so the grid only has to reach the farthest
+	// event on the map, however large the map is
+	int w = (int)map_w * 2, h = (int)map_h * 2;
+	int max_x = -1, max_y = -1;
+	for (const Event &e : _events) {
+		if (e.x < w && e.y < h) {
+			max_x = MAX(max_x, e.x);
+			max_y = MAX(max_y, e.y);
+		}
+	}
+	_grid_cols = (max_x + EVENT_CELL_SIZE) / EVENT_CELL_SIZE;
+	_grid_rows = (max_y + EVENT_CELL_SIZE) / EVENT_CELL_SIZE;
+	size_t num_cells = (size_t)_grid_cols * _grid_rows;
+	_cell_starts.assign(num_cells + 1, 0);
+	_cell_events.clear();
+	if (!num_cells) { return; }
+	// Counting sort of the events by cell
+	size_t n = _events.size();
+	std::vector<size_t> cells(n, num_cells);
+	for (size_t i = 0; i < n; i++) {
+		const Event &e = _events[i];
+		if (e.x >= w || e.y >= h) { continue; }
+		cells[i] = (size_t)(e.y / EVENT_CELL_SIZE) * _grid_cols + (size_t)(e.x / EVENT_CELL_SIZE);
+		_cell_starts[cells[i] + 1]++;
+	}
+	for (size_t c = 0; c < num_cells; c++) {
+		_cell_starts[c + 1] += _cell_starts[c];
+	}
+	_cell_events.resize(_cell_starts[num_cells]);
+	std::vector<size_t> next(_cell_starts.begin(), _cell_starts.end() - 1);
+	for (size_t i = 0; i < n; i++) {
+		if (cells[i] < num_cells) { _cell_events[next[cells[i]]++] = i; }
+	}
+}
+
+const Event *Event_Script::event_at(int x, int y) const {
+	if (x < 0 || y < 0) { return NULL; }
+	int cx = x / EVENT_CELL_SIZE, cy = y / EVENT_CELL_SIZE;
+	if (cx >= _grid_cols || cy >= _grid_rows) { return NULL; }
+	size_t c = (size_t)cy * _grid_cols + (size_t)cx;
+	for (size_t i = _cell_starts[c]; i < _cell_starts[c + 1]; i++) {
+		const Event &e = _events[_cell_events[i]];
+		if (e.x == x && e.y == y) { return &e; }
+	}
+	return NULL;
+}
+
+void Event_Script::query(int x0, int y0, int x1, int y1, std::vector<const Event *> &found) const {
+	// Find the events with x0 <= x < x1 and y0 <= y < y1, checking only the cells that overlap them
+	found.clear();
+	if (x1 <= 0 || y1 <= 0) { return; }
+	int c0 = MAX(x0, 0) / EVENT_CELL_SIZE, r0 = MAX(y0, 0) / EVENT_CELL_SIZE;
+	int c1 = MIN((x1 + EVENT_CELL_SIZE - 1) / EVENT_CELL_SIZE, _grid_cols);
+	int r1 = MIN((y1 + EVENT_CELL_SIZE - 1) / EVENT_CELL_SIZE, _grid_rows);
+	for (int r = r0; r < r1; r++) {
+		for (int c = c0; c < c1; c++) {
+			size_t k = (size_t)r * _grid_cols + (size_t)c;
+			for (size_t i = _cell_starts[k]; i < _cell_starts[k + 1]; i++) {
+				const Event &e = _events[_cell_events[i]];
+				if (e.x >= x0 && e.x < x1 && e.y >= y0 && e.y < y1) { found.push_back(&e); }
+			}
+		}
+	}
+}
+
+const char *Event_Script::kind_name(Event_Kind k) {
+	switch (k) {
+	case WARP_EVENT:
+		return "Warp";
+	case COORD_EVENT:
+		return "Coord";
+	case BG_EVENT:
+		return "BG";
+	case OBJECT_EVENT:
+		return "Object";
+	default:
+		return "Event";
+	}
+}
+
+const char *Event_Script::error_message(Result result) {
+	switch (result) {
+	case EVENTS_OK:
+		return "OK.";
+	case BAD_EVENTS_FILE:
+		return "Cannot open file.";
+	case NO_EVENTS:
+		return "No warps, coord events, bg events, or object events found.";
+	case EVENTS_NULL:
+		return "No event script file chosen.";
+	default:
+		return "Unspecified error.";
+	}
+}
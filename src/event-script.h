@@ -0,0 +1,46 @@
+#ifndef EVENT_SCRIPT_H
+#define EVENT_SCRIPT_H
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Events are bucketed into square cells of this many event squares (two to a block)
+#define EVENT_CELL_SIZE 8
+
+enum Event_Kind { WARP_EVENT, COORD_EVENT, BG_EVENT, OBJECT_EVENT, NUM_EVENT_KINDS };
+
+struct Event {
+	Event_Kind kind;
+	int x, y;
+	size_t line;
+	std::string macro;
+};
+
+class Event_Script {
+public:
+	enum Result { EVENTS_OK, BAD_EVENTS_FILE, NO_EVENTS, EVENTS_NULL };
+private:
+	std::vector<Event> _events;
+	// Uniform grid over the map, stored like a sparse matrix: the events in
+	// cell i are _cell_events[_cell_starts[i]] up to _cell_events[_cell_starts[i+1]]
+	std::vector<size_t> _cell_starts, _cell_events;
+	int _grid_cols, _grid_rows;
+	Result _result;
+public:
+	Event_Script(void);
+	inline size_t size(void) const { return _events.size(); }
+	inline const Event &event(size_t i) const { return _events[i]; }
+	inline bool loaded(void) const { return _result == EVENTS_OK; }
+	inline Result result(void) const { return _result; }
+	void clear(void);
+	Result read_events(const char *f);
+	void index(uint16_t map_w, uint16_t map_h);
+	const Event *event_at(int x, int y) const;
+	void query(int x0, int y0, int x1, int y1, std::vector<const Event *> &found) const;
+	static const char *kind_name(Event_Kind k);
+	static const char *error_message(Result result);
+};
+
+#endif
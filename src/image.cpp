@@ -1,7 +1,8 @@
 #include <cstdio>
+#include <cstring>
+#include <chrono>
 #include <string>
 #include <sstream>
-#include <png.h>
 #include <zlib.h>
 
 #pragma warning(push, 0)
@@ -13,12 +14,35 @@
 #include "tile.h"
 #include "image.h"
 #include "config.h"
+#include "colors.h"
+#include "png-encoder.h"
 
 Image::Result Image::write_map_image(const char *f, const Map &map, const Metatileset &mt) {
 	size_t w = map.width() * METATILE_SIZE * TILE_SIZE;
 	size_t h = map.height() * METATILE_SIZE * TILE_SIZE;
-	uchar *buffer = mt.print_rgb(map);
-	return write_image(f, w, h, buffer);
+	uchar *buffer = mt.print_indexed(map);
+	// Give each (palette, hue) slot that is actually used a palette index
+	const size_t num_slots = (UNDEFINED + 1) * NUM_HUES;
+	uchar index[num_slots] = {};
+	bool used[num_slots] = {};
+	size_t n = w * h;
+	for (size_t i = 0; i < n; i++) {
+		used[buffer[i]] = true;
+	}
+	uchar palette[num_slots * NUM_CHANNELS];
+	size_t num_colors = 0;
+	Lighting l = mt.const_tileset()->lighting();
+	for (size_t i = 0; i < num_slots; i++) {
+		if (!used[i]) { continue; }
+		const uchar *rgb = Color::color(l, (Palette)(i / NUM_HUES), (Hue)(i % NUM_HUES));
+		memcpy(palette + num_colors * NUM_CHANNELS, rgb, NUM_CHANNELS);
+		index[i] = (uchar)num_colors++;
+	}
+	for (size_t i = 0; i < n; i++) {
+		buffer[i] = index[buffer[i]];
+	}
+	int depth = num_colors <= 2 ? 1 : num_colors <= 4 ? 2 : num_colors <= 16 ? 4 : 8;
+	return write_image(f, w, h, depth, false, palette, num_colors, buffer);
 }
 
 Image::Result Image::write_tileset_image(const char *f, const Tileset &tileset) {
@@ -28,66 +52,92 @@ Image::Result Image::write_tileset_image(const char *f, const Tileset &tileset)
 	size_t h = ((n + TILES_PER_ROW - 1) / TILES_PER_ROW) * TILE_SIZE;
 	bool allow_256 = Config::allow_256_tiles();
 	if (!allow_256 && h > 6 * TILE_SIZE) { h -= 2 * TILE_SIZE; } // skip tiles $60 to $7F
-	uchar *buffer = tileset.print_rgb(w, h, n);
-	return write_image(f, w, h, buffer);
+	uchar *buffer = tileset.print_gray(w, h, n);
+	return write_image(f, w, h, 2, true, NULL, 0, buffer);
 }
 
 Image::Result Image::write_roof_image(const char *f, const Tileset &tileset) {
 	size_t w = ROOF_TILES_PER_ROW * TILE_SIZE;
 	size_t h = ROOF_TILES_PER_COL * TILE_SIZE;
-	uchar *buffer = tileset.print_roof_rgb(w, h);
-	return write_image(f, w, h, buffer);
+	uchar *buffer = tileset.print_roof_gray(w, h);
+	return write_image(f, w, h, 2, true, NULL, 0, buffer);
 }
 
-Image::Result Image::write_image(const char *f, size_t w, size_t h, uchar *buffer) {
+Image::Encoder Image::_encoder = Image::Encoder::PNG_BALANCED;
+double Image::_encode_time = 0.0;
+size_t Image::_encoded_size = 0;
+
+Image::Result Image::write_image(const char *f, size_t w, size_t h, int depth, bool gray, const uchar *palette,
+	size_t num_colors, uchar *buffer) {
+	// buffer holds one gray level or palette index per byte
+	auto start = std::chrono::steady_clock::now();
 	Result result = IMAGE_OK;
+	std::vector<uchar> best, data;
 	FILE *file = fl_fopen(f, "wb");
 	if (!file) { result = IMAGE_BAD_FILE; goto cleanup1; }
-	{ // new scope avoids gcc "jump to label crosses initialization" error
-		// Create the necessary PNG structures
-		png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-		if (!png) { result = IMAGE_BAD_PNG; goto cleanup2; }
-		png_infop info = png_create_info_struct(png);
-		if (!info) { result = IMAGE_BAD_PNG; goto cleanup2; }
-		png_init_io(png, file);
-		// Set compression options
-		png_set_compression_level(png, Z_BEST_COMPRESSION);
-		png_set_compression_mem_level(png, Z_BEST_COMPRESSION);
-		png_set_compression_strategy(png, Z_DEFAULT_STRATEGY);
-		png_set_compression_window_bits(png, 15);
-		png_set_compression_method(png, Z_DEFLATED);
-		png_set_compression_buffer_size(png, 8192);
-		// Write the PNG IHDR chunk
-		png_set_IHDR(png, info, (png_uint_32)w, (png_uint_32)h, 8, PNG_COLOR_TYPE_RGB,
-			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-		// Write the other PNG header chunks
-		png_write_info(png, info);
-		// Write the RGB pixels in row-major order from top to bottom
-		size_t row_size = NUM_CHANNELS * w;
-		png_bytep png_row = new png_byte[row_size];
-		for (size_t i = 0; i < h; i++) {
-			size_t row = row_size * i;
-			for (size_t j = 0; j < w; j++) {
-				size_t col = NUM_CHANNELS * j;
-				size_t px = row + col;
-				png_row[col] = buffer[px];
-				png_row[col+1] = buffer[px+1];
-				png_row[col+2] = buffer[px+2];
+	switch (_encoder) {
+	case Encoder::PNG_FAST:
+		if (!encode(best, w, h, depth, gray, palette, num_colors, buffer, 1, Z_RLE,
+			Png_Encoder::Filter::FILTER_NONE)) {
+			result = IMAGE_BAD_PNG;
+		}
+		break;
+	case Encoder::PNG_BALANCED:
+		if (!encode(best, w, h, depth, gray, palette, num_colors, buffer, 6, Z_DEFAULT_STRATEGY,
+			Png_Encoder::Filter::FILTER_ADAPTIVE)) {
+			result = IMAGE_BAD_PNG;
+		}
+		break;
+	case Encoder::PNG_SMALLEST:
+	default:
+		{ // new scope avoids gcc "jump to label crosses initialization" error
+			// Try each filter and strategy and keep the smallest result
+			const int strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE};
+			for (int fs = Png_Encoder::Filter::FILTER_NONE; fs <= Png_Encoder::Filter::FILTER_ADAPTIVE; fs++) {
+				for (int zs : strategies) {
+					if (!encode(data, w, h, depth, gray, palette, num_colors, buffer, Z_BEST_COMPRESSION, zs,
+						(Png_Encoder::Filter)fs)) {
+						result = IMAGE_BAD_PNG;
+						goto cleanup2;
+					}
+					if (best.empty() || data.size() < best.size()) { best.swap(data); }
+				}
 			}
-			png_write_row(png, png_row);
 		}
-		png_write_end(png, NULL);
-		delete [] png_row;
-		png_destroy_write_struct(&png, &info);
-		png_free_data(png, info, PNG_FREE_ALL, -1);
 	}
+	if (result == IMAGE_OK && fwrite(best.data(), 1, best.size(), file) != best.size()) { result = IMAGE_BAD_FILE; }
 cleanup2:
 	fclose(file);
 cleanup1:
 	delete [] buffer;
+	_encoded_size = result == IMAGE_OK ? best.size() : 0;
+	_encode_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 	return result;
 }
 
+bool Image::encode(std::vector<uchar> &data, size_t w, size_t h, int depth, bool gray, const uchar *palette,
+	size_t num_colors, const uchar *buffer, int level, int strategy, Png_Encoder::Filter filter) {
+	// Compresses on all available cores; see Png_Encoder
+	Png_Encoder encoder(w, h, depth, gray, palette, num_colors);
+	encoder.level(level);
+	encoder.strategy(strategy);
+	encoder.filter(filter);
+	return encoder.encode(buffer, data);
+}
+
+const char *Image::encoder_name(Encoder e) {
+	switch (e) {
+	case Encoder::PNG_FAST:
+		return "Fast";
+	case Encoder::PNG_BALANCED:
+		return "Balanced";
+	case Encoder::PNG_SMALLEST:
+		return "Smallest";
+	default:
+		return "Unknown";
+	}
+}
+
 const char *Image::error_message(Result result) {
 	switch (result) {
 	case IMAGE_OK:
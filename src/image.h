@@ -1,6 +1,9 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <vector>
+
+#include "png-encoder.h"
 #include "map.h"
 #include "metatileset.h"
 #include "tileset.h"
@@ -8,12 +11,27 @@
 class Image {
 public:
 	enum Result { IMAGE_OK, IMAGE_BAD_FILE, IMAGE_BAD_PNG };
+	enum Encoder { PNG_FAST, PNG_BALANCED, PNG_SMALLEST };
+private:
+	static Encoder _encoder;
+	static double _encode_time;
+	static size_t _encoded_size;
+public:
+	inline static Encoder encoder(void) { return _encoder; }
+	inline static void encoder(Encoder e) { _encoder = e; }
+	// Statistics for the last written image
+	inline static double encode_time(void) { return _encode_time; }
+	inline static size_t encoded_size(void) { return _encoded_size; }
+	static const char *encoder_name(Encoder e);
 	static Result write_map_image(const char *f, const Map &map, const Metatileset &mt);
 	static Result write_tileset_image(const char *f, const Tileset &tileset);
 	static Result write_roof_image(const char *f, const Tileset &tileset);
 	static const char *error_message(Result result);
 private:
-	static Result write_image(const char *f, size_t w, size_t h, uchar *buffer);
+	static Result write_image(const char *f, size_t w, size_t h, int depth, bool gray, const uchar *palette,
+		size_t num_colors, uchar *buffer);
+	static bool encode(std::vector<uchar> &data, size_t w, size_t h, int depth, bool gray, const uchar *palette,
+		size_t num_colors, const uchar *buffer, int level, int strategy, Png_Encoder::Filter filter);
 };
 
 #endif
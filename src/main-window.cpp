@@ -1,6 +1,7 @@
 #include <cstdlib>
-#include <queue>
+#include <cstdio>
 #include <utility>
+#include <vector>
 
 #pragma warning(push, 0)
 #include <FL/Fl.H>
@@ -14,6 +15,7 @@
 #include "utils.h"
 #include "themes.h"
 #include "image.h"
+#include "perf.h"
 #include "widgets.h"
 #include "modal-dialog.h"
 #include "option-dialogs.h"
@@ -21,6 +23,7 @@
 #include "metatileset.h"
 #include "preferences.h"
 #include "config.h"
+#include "mapped-file.h"
 #include "main-window.h"
 #include "image.h"
 #include "colors.h"
@@ -33,8 +36,18 @@
 #include "app-icon.xpm"
 #endif
 
+// A file rewritten by compacting the blockset
+struct Compacted_File {
+	std::string target;
+	std::vector<uint8_t> data, original;
+	bool existed;
+	Compacted_File(const std::string &t) : target(t), data(), original(), existed(false) {}
+};
+
 Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_Window(x, y, w, h, PROGRAM_NAME),
-	_directory(), _blk_file(), _metatileset(), _map(), _metatile_buttons(), _clipboard(0), _wx(x), _wy(y), _ww(w), _wh(h) {
+	_directory(), _blk_file(), _png_file("screenshot.png"), _metatileset(), _map(), _dependencies(), _usage_index(), _metatile_buttons(), _clipboard(0), _wx(x), _wy(y), _ww(w), _wh(h) {
+	Perf_Scope scope("Main_Window::Main_Window");
+
 	// Get global configs
 	Mode mode_config = (Mode)Preferences::get("mode", Mode::BLOCKS);
 	mode(mode_config);
@@ -46,6 +59,12 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	int show_events_config = Preferences::get("show", 1);
 	int event_cursor_config = Preferences::get("event", 0);
 	int show_priority_config = Preferences::get("priority", 1);
+	int show_collisions_config = Preferences::get("collisions", 0);
+	int connections_config = Preferences::get("connections", DEFAULT_CONNECTION_STRIP);
+	if (connections_config != 0 && connections_config != 1 && connections_config != 3 && connections_config != 6) {
+		connections_config = DEFAULT_CONNECTION_STRIP;
+	}
+	_connections.strip(connections_config);
 	Lighting lighting_config = (Lighting)Preferences::get("lighting", Lighting::DAY);
 
 	int monochrome_config = Preferences::get("monochrome", 0);
@@ -56,6 +75,10 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	int special_lighting_config = Preferences::get("special", 1);
 	int roof_colors_config = Preferences::get("roofs", 1);
 
+	Image::Encoder png_encoder_config = (Image::Encoder)Preferences::get("png", Image::Encoder::PNG_BALANCED);
+	Image::encoder(png_encoder_config);
+	_png_preference = png_encoder_config;
+
 	// Populate window
 
 	int wx = 0, wy = 0, ww = w, wh = h;
@@ -111,13 +134,13 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	wh -= _status_bar->h();
 	_metatile_count = new Status_Bar_Field(0, 0, text_width("Blocks: 999", 8), 21, "");
 	new Spacer(0, 0, 2, 21);
-	_map_dimensions = new Status_Bar_Field(0, 0, text_width("Map: 999 x 999", 8), 21, "");
+	_map_dimensions = new Status_Bar_Field(0, 0, text_width("Map: 99999 x 99999", 8), 21, "");
 	new Spacer(0, 0, 2, 21);
 	_hover_id = new Status_Bar_Field(0, 0, text_width("ID: $99", 8), 21, "");
 	new Spacer(0, 0, 2, 21);
-	_hover_xy = new Status_Bar_Field(0, 0, text_width("X/Y ($99, $99)", 8), 21, "");
+	_hover_xy = new Status_Bar_Field(0, 0, text_width("X/Y (99999, 99999)", 8), 21, "");
 	new Spacer(0, 0, 2, 21);
-	_hover_event = new Status_Bar_Field(0, 0, text_width("Event: X/Y ($999, $999)", 8), 21, "");
+	_hover_event = new Status_Bar_Field(0, 0, text_width("Object: X/Y (999999, 999999)", 8), 21, "");
 	_status_bar->end();
 	begin();
 
@@ -133,18 +156,15 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	// Map
 	_map_scroll = new Workspace(wx, wy, ww, wh);
 	_map_scroll->type(Fl_Scroll::BOTH);
+	_connection_preview = new Connection_Preview(wx, wy, 0, 0);
+	_connection_preview->connections(&_connections);
 	_map_group = new Fl_Group(wx, wy, 0, 0);
 	_map_group->end();
+	_map.change_callback((Map::Change_Callback)map_changed_cb, this);
 	begin();
 
 	// Dialogs
-	_new_dir_chooser = new Directory_Chooser(Fl_Native_File_Chooser::BROWSE_DIRECTORY);
-	_blk_open_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
-	_blk_save_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
-	_pal_load_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
-	_pal_save_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
-	_roof_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
-	_png_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
+	// (file choosers are created on first use; dialogs and windows build their widgets when first shown)
 	_error_dialog = new Modal_Dialog(this, "Error", Modal_Dialog::ERROR_ICON);
 	_warning_dialog = new Modal_Dialog(this, "Warning", Modal_Dialog::WARNING_ICON);
 	_success_dialog = new Modal_Dialog(this, "Success", Modal_Dialog::SUCCESS_ICON);
@@ -161,6 +181,8 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	_roof_window = new Roof_Window(48, 48);
 	_lighting_window = new Lighting_Window(48, 48);
 	_monochrome_lighting_window = new Monochrome_Lighting_Window(48, 48);
+	_world_window = new World_Window(48, 48, 640, 480);
+	_map_browser = new Map_Browser(600, 440);
 
 	// Drag-and-drop receiver
 	_dnd_receiver = new DnD_Receiver(0, 0, 0, 0);
@@ -168,11 +190,8 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	_dnd_receiver->user_data(this);
 
 	// TEMPORARY: hide not-yet-implemented features
-	_load_event_script_tb->hide();
-	_show_events_tb->hide();
 	_blocks_mode_tb->hide();
 	_events_mode_tb->hide();
-	_show_events_tb->hide();
 
 	// Configure window
 	size_range(384, 256);
@@ -210,9 +229,9 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 		OS_MENU_ITEM("Save &Blockset", 0, (Fl_Callback *)save_metatiles_cb, this, 0),
 		OS_MENU_ITEM("Save &Tileset", 0, (Fl_Callback *)save_tileset_cb, this, 0),
 		OS_MENU_ITEM("Save &Roof", 0, (Fl_Callback *)save_roof_cb, this, FL_MENU_DIVIDER),
-		OS_MENU_ITEM("Load &Event Script...", FL_COMMAND + 'a', (Fl_Callback *)load_event_script_cb, this, FL_MENU_INVISIBLE/*0*/),
+		OS_MENU_ITEM("Load &Event Script...", FL_COMMAND + 'a', (Fl_Callback *)load_event_script_cb, this, 0),
 		OS_MENU_ITEM("Save E&vent Script", 0, (Fl_Callback *)save_event_script_cb, this, FL_MENU_INVISIBLE/*0*/),
-		OS_MENU_ITEM("&Unload Event Script", FL_COMMAND + 'L', (Fl_Callback *)unload_event_script_cb, this, FL_MENU_INVISIBLE/*FL_MENU_DIVIDER*/),
+		OS_MENU_ITEM("&Unload Event Script", FL_COMMAND + 'A', (Fl_Callback *)unload_event_script_cb, this, FL_MENU_DIVIDER),
 		OS_MENU_ITEM("Load &Lighting...", FL_COMMAND + 'l', (Fl_Callback *)load_lighting_cb, this, 0),
 		OS_MENU_ITEM("Export Current Li&ghting...", 0, (Fl_Callback *)export_current_lighting_cb, this, FL_MENU_DIVIDER),
 		OS_MENU_ITEM("Load Roo&f Colors", 0, (Fl_Callback *)load_roof_colors_cb, this, FL_MENU_DIVIDER),
@@ -248,11 +267,23 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 		OS_MENU_ITEM("&Hexadecimal", FL_COMMAND + FL_SHIFT + '4', (Fl_Callback *)hex_cb, this,
 			FL_MENU_TOGGLE | (hex_config ? FL_MENU_VALUE : 0)),
 		OS_MENU_ITEM("Events &Over Blocks", FL_COMMAND + 'R', (Fl_Callback *)show_events_cb, this,
-			FL_MENU_INVISIBLE | FL_MENU_TOGGLE | (show_events_config ? FL_MENU_VALUE : 0)),
+			FL_MENU_TOGGLE | (show_events_config ? FL_MENU_VALUE : 0)),
 		OS_MENU_ITEM("&Event Cursor", FL_COMMAND + 'u', (Fl_Callback *)event_cursor_cb, this,
 			FL_MENU_TOGGLE | (event_cursor_config ? FL_MENU_VALUE : 0)),
 		OS_MENU_ITEM("Show &Priority", FL_COMMAND + 'P', (Fl_Callback *)show_priority_cb, this,
-			FL_MENU_TOGGLE | (show_priority_config ? FL_MENU_VALUE : 0) | FL_MENU_DIVIDER),
+			FL_MENU_TOGGLE | (show_priority_config ? FL_MENU_VALUE : 0)),
+		OS_MENU_ITEM("Show &Collisions", FL_COMMAND + 'C', (Fl_Callback *)show_collisions_cb, this,
+			FL_MENU_TOGGLE | (show_collisions_config ? FL_MENU_VALUE : 0) | FL_MENU_DIVIDER),
+		OS_MENU_ITEM("Co&nnections", 0, NULL, NULL, FL_SUBMENU),
+		OS_MENU_ITEM("&None", 0, (Fl_Callback *)no_connections_cb, this,
+			FL_MENU_RADIO | (connections_config == 0 ? FL_MENU_VALUE : 0)),
+		OS_MENU_ITEM("&1 Block", 0, (Fl_Callback *)small_connections_cb, this,
+			FL_MENU_RADIO | (connections_config == 1 ? FL_MENU_VALUE : 0)),
+		OS_MENU_ITEM("&3 Blocks", 0, (Fl_Callback *)medium_connections_cb, this,
+			FL_MENU_RADIO | (connections_config == 3 ? FL_MENU_VALUE : 0)),
+		OS_MENU_ITEM("&6 Blocks", 0, (Fl_Callback *)large_connections_cb, this,
+			FL_MENU_RADIO | (connections_config == 6 ? FL_MENU_VALUE : 0)),
+		{},
 		OS_MENU_ITEM("&Lighting", 0, NULL, NULL, FL_SUBMENU | FL_MENU_DIVIDER),
 		OS_MENU_ITEM("&Morn", 0, (Fl_Callback *)morn_lighting_cb, this,
 			FL_MENU_RADIO | (lighting_config == Lighting::MORN ? FL_MENU_VALUE : 0)),
@@ -265,7 +296,9 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 		OS_MENU_ITEM("&Custom", 0, (Fl_Callback *)custom_lighting_cb, this,
 			FL_MENU_RADIO | (lighting_config == Lighting::CUSTOM ? FL_MENU_VALUE : 0)),
 		{},
+		OS_MENU_ITEM("&World Map...", FL_COMMAND + 'm', (Fl_Callback *)world_map_cb, this, FL_MENU_DIVIDER),
 		OS_MENU_ITEM("Full &Screen", FL_F + 11, (Fl_Callback *)full_screen_cb, this, FL_MENU_TOGGLE),
+		OS_MENU_ITEM("Performance &HUD", 0, (Fl_Callback *)perf_hud_cb, this, FL_MENU_TOGGLE),
 		/*{},
 		OS_SUBMENU("&Mode"),*/
 		OS_MENU_ITEM("&Blocks", FL_COMMAND + '1', (Fl_Callback *)blocks_mode_cb, this,
@@ -275,9 +308,12 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 		{},
 		OS_SUBMENU("&Tools"),
 		OS_MENU_ITEM("Resize &Blockset...", FL_COMMAND + 'b', (Fl_Callback *)add_sub_cb, this, 0),
+		OS_MENU_ITEM("&Compact Blockset...", 0, (Fl_Callback *)compact_blockset_cb, this, 0),
+		OS_MENU_ITEM("Find Block &Usage...", FL_COMMAND + 'f', (Fl_Callback *)block_usage_cb, this, 0),
 		OS_MENU_ITEM("Resize &Map...", FL_COMMAND + 'e', (Fl_Callback *)resize_cb, this, FL_MENU_DIVIDER),
 		OS_MENU_ITEM("Chan&ge Tileset...", FL_COMMAND + 'h', (Fl_Callback *)change_tileset_cb, this, 0),
-		OS_MENU_ITEM("Edit &Tileset...", FL_COMMAND + 't', (Fl_Callback *)edit_tileset_cb, this, FL_MENU_DIVIDER),
+		OS_MENU_ITEM("Edit &Tileset...", FL_COMMAND + 't', (Fl_Callback *)edit_tileset_cb, this, 0),
+		OS_MENU_ITEM("Remove &Duplicate Tiles...", 0, (Fl_Callback *)remove_duplicate_tiles_cb, this, FL_MENU_DIVIDER),
 		OS_MENU_ITEM("C&hange Roof...", FL_COMMAND + 'H', (Fl_Callback *)change_roof_cb, this, 0),
 		OS_MENU_ITEM("Edit &Roof...", FL_COMMAND + 'r', (Fl_Callback *)edit_roof_cb, this, FL_MENU_DIVIDER),
 		OS_MENU_ITEM("Edit Current &Lighting...", FL_COMMAND + 'L', (Fl_Callback *)edit_current_lighting_cb, this, 0),
@@ -290,7 +326,15 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 		OS_MENU_ITEM("Auto-Load &Special Lighting", 0, (Fl_Callback *)auto_load_special_lighting_cb, this,
 			FL_MENU_TOGGLE | (special_lighting_config ? FL_MENU_VALUE : 0)),
 		OS_MENU_ITEM("Auto-Load &Roof Colors", 0, (Fl_Callback *)auto_load_roof_colors_cb, this,
-			FL_MENU_TOGGLE | (roof_colors_config ? FL_MENU_VALUE : 0)),
+			FL_MENU_TOGGLE | (roof_colors_config ? FL_MENU_VALUE : 0) | FL_MENU_DIVIDER),
+		OS_MENU_ITEM("&PNG Encoder", 0, NULL, NULL, FL_SUBMENU),
+		OS_MENU_ITEM("&Fast", 0, (Fl_Callback *)png_fast_cb, this,
+			FL_MENU_RADIO | (png_encoder_config == Image::Encoder::PNG_FAST ? FL_MENU_VALUE : 0)),
+		OS_MENU_ITEM("&Balanced", 0, (Fl_Callback *)png_balanced_cb, this,
+			FL_MENU_RADIO | (png_encoder_config == Image::Encoder::PNG_BALANCED ? FL_MENU_VALUE : 0)),
+		OS_MENU_ITEM("&Smallest", 0, (Fl_Callback *)png_smallest_cb, this,
+			FL_MENU_RADIO | (png_encoder_config == Image::Encoder::PNG_SMALLEST ? FL_MENU_VALUE : 0)),
+		{},
 		{},
 		OS_SUBMENU("&Help"),
 		OS_MENU_ITEM("&Help", FL_F + 1, (Fl_Callback *)help_cb, this, FL_MENU_DIVIDER),
@@ -314,7 +358,14 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	_show_events_mi = PM_FIND_MENU_ITEM_CB(show_events_cb);
 	_event_cursor_mi = PM_FIND_MENU_ITEM_CB(event_cursor_cb);
 	_show_priority_mi = PM_FIND_MENU_ITEM_CB(show_priority_cb);
+	_show_collisions_mi = PM_FIND_MENU_ITEM_CB(show_collisions_cb);
+	_no_connections_mi = PM_FIND_MENU_ITEM_CB(no_connections_cb);
+	_small_connections_mi = PM_FIND_MENU_ITEM_CB(small_connections_cb);
+	_medium_connections_mi = PM_FIND_MENU_ITEM_CB(medium_connections_cb);
+	_large_connections_mi = PM_FIND_MENU_ITEM_CB(large_connections_cb);
 	_full_screen_mi = PM_FIND_MENU_ITEM_CB(full_screen_cb);
+	_perf_hud_mi = PM_FIND_MENU_ITEM_CB(perf_hud_cb);
+	_world_map_mi = PM_FIND_MENU_ITEM_CB(world_map_cb);
 	_morn_mi = PM_FIND_MENU_ITEM_CB(morn_lighting_cb);
 	_day_mi = PM_FIND_MENU_ITEM_CB(day_lighting_cb);
 	_night_mi = PM_FIND_MENU_ITEM_CB(night_lighting_cb);
@@ -326,6 +377,9 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	_allow_256_tiles_mi = PM_FIND_MENU_ITEM_CB(allow_256_tiles_cb);
 	_special_lighting_mi = PM_FIND_MENU_ITEM_CB(auto_load_special_lighting_cb);
 	_roof_colors_mi = PM_FIND_MENU_ITEM_CB(auto_load_roof_colors_cb);
+	_png_fast_mi = PM_FIND_MENU_ITEM_CB(png_fast_cb);
+	_png_balanced_mi = PM_FIND_MENU_ITEM_CB(png_balanced_cb);
+	_png_smallest_mi = PM_FIND_MENU_ITEM_CB(png_smallest_cb);
 	// Conditional menu items
 	_load_event_script_mi = PM_FIND_MENU_ITEM_CB(load_event_script_cb);
 	_unload_event_script_mi = PM_FIND_MENU_ITEM_CB(unload_event_script_cb);
@@ -345,9 +399,12 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 	_paste_block_mi = PM_FIND_MENU_ITEM_CB(paste_metatile_cb);
 	_swap_block_mi = PM_FIND_MENU_ITEM_CB(swap_metatiles_cb);
 	_resize_blockset_mi = PM_FIND_MENU_ITEM_CB(add_sub_cb);
+	_compact_blockset_mi = PM_FIND_MENU_ITEM_CB(compact_blockset_cb);
+	_block_usage_mi = PM_FIND_MENU_ITEM_CB(block_usage_cb);
 	_resize_map_mi = PM_FIND_MENU_ITEM_CB(resize_cb);
 	_change_tileset_mi = PM_FIND_MENU_ITEM_CB(change_tileset_cb);
 	_edit_tileset_mi = PM_FIND_MENU_ITEM_CB(edit_tileset_cb);
+	_remove_duplicate_tiles_mi = PM_FIND_MENU_ITEM_CB(remove_duplicate_tiles_cb);
 	_change_roof_mi = PM_FIND_MENU_ITEM_CB(change_roof_cb);
 	_edit_roof_mi = PM_FIND_MENU_ITEM_CB(edit_roof_cb);
 	_edit_current_lighting_mi = PM_FIND_MENU_ITEM_CB(edit_current_lighting_cb);
@@ -495,29 +552,6 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 
 	// Configure dialogs
 
-	_new_dir_chooser->title("Choose Project Directory");
-
-	_blk_open_chooser->title("Open Map");
-	_blk_open_chooser->filter("BLK Files\t*.blk\n");
-
-	_blk_save_chooser->title("Save Map");
-	_blk_save_chooser->filter("BLK Files\t*.blk\n");
-	_blk_save_chooser->preset_file("NewMap.blk");
-
-	_pal_load_chooser->title("Open Lighting");
-	_pal_load_chooser->filter("PAL Files\t*.pal\n");
-
-	_pal_save_chooser->title("Save Lighting");
-	_pal_save_chooser->filter("PAL Files\t*.pal\n");
-	_pal_save_chooser->preset_file("lighting.pal");
-
-	_roof_chooser->title("Open Roof Tiles");
-	_roof_chooser->filter("PNG Files\t*.png\n2BPP Files\t*.2bpp\n");
-
-	_png_chooser->title("Print Screenshot");
-	_png_chooser->filter("PNG Files\t*.png\n");
-	_png_chooser->preset_file("screenshot.png");
-
 	_error_dialog->width_range(280, 700);
 	_warning_dialog->width_range(280, 700);
 	_success_dialog->width_range(280, 700);
@@ -543,17 +577,22 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Double_W
 }
 
 Main_Window::~Main_Window() {
+	Fl::remove_timeout((Fl_Timeout_Handler)refresh_status_cb, this);
+	Fl::remove_timeout((Fl_Timeout_Handler)refresh_perf_hud_cb, this);
 	delete _menu_bar; // includes menu items
 	delete _toolbar; // includes toolbar buttons
 	delete _sidebar; // includes metatiles
 	delete _status_bar; // includes status bar fields
 	delete _map_scroll; // includes map and blocks
 	delete _dnd_receiver;
+	delete _new_dir_chooser;
 	delete _blk_open_chooser;
 	delete _blk_save_chooser;
 	delete _pal_load_chooser;
 	delete _pal_save_chooser;
+	delete _roof_chooser;
 	delete _png_chooser;
+	delete _asm_chooser;
 	delete _error_dialog;
 	delete _warning_dialog;
 	delete _success_dialog;
@@ -570,6 +609,8 @@ Main_Window::~Main_Window() {
 	delete _roof_window;
 	delete _lighting_window;
 	delete _monochrome_lighting_window;
+	delete _world_window;
+	delete _map_browser;
 }
 
 void Main_Window::show() {
@@ -613,6 +654,7 @@ const char *Main_Window::modified_filename() {
 }
 
 int Main_Window::handle(int event) {
+	Perf_Scope scope("Main_Window::handle");
 	int key = 0;
 	switch (event) {
 	case FL_FOCUS:
@@ -673,10 +715,147 @@ int Main_Window::handle_hotkey(int key) {
 	return 0;
 }
 
+void Main_Window::draw(void) {
+	// A full redraw may follow any change to tiles, lighting, or the map
+	if (damage() & FL_DAMAGE_ALL) {
+		_framebuffer.invalidate();
+		_connections.invalidate();
+	}
+	if (_connections.size()) {
+		_connections.render(_map.width(), _map.height(), metatile_size());
+	}
+	if (show_collisions() && _has_collisions) {
+		_collision_overlay.update(_metatileset.collision_names());
+		_framebuffer.overlay(&_collision_overlay);
+	}
+	else {
+		_framebuffer.overlay(NULL);
+	}
+	Perf::begin_frame();
+	show_blocks();
+	Fl_Double_Window::draw();
+	if (show_events() && _event_script.loaded()) {
+		draw_events();
+	}
+	Perf::end_frame();
+	if (Perf::hud()) {
+		draw_perf_hud();
+	}
+}
+
+#define PERF_HUD_W 220
+#define PERF_HUD_H 88
+
+void Main_Window::draw_perf_hud() {
+	// Show the previous frame's statistics in the top-right corner of the map
+	int x = _map_scroll->x() + _map_scroll->w() - Fl::scrollbar_size() - PERF_HUD_W - 4, y = _map_scroll->y() + 4;
+	fl_color(FL_BLACK);
+	fl_rectf(x, y, PERF_HUD_W, PERF_HUD_H);
+	char buffer[256] = {};
+	sprintf(buffer, "Frame: %.2f ms\n"
+		"fl_draw_image: %u (%u px)\n"
+		"Blocks: %u  Tiles: %u\n"
+		"Framebuffer: %u hits, %u misses\n"
+		"Lighting: %u hits, %u misses",
+		Perf::last_frame_ms(), (uint32_t)Perf::last(Perf::DRAW_IMAGE_CALLS), (uint32_t)Perf::last(Perf::PIXELS_UPLOADED),
+		(uint32_t)Perf::last(Perf::BLOCKS_DRAWN), (uint32_t)Perf::last(Perf::TILES_DRAWN),
+		(uint32_t)Perf::last(Perf::FRAMEBUFFER_HITS), (uint32_t)Perf::last(Perf::FRAMEBUFFER_MISSES),
+		(uint32_t)Perf::last(Perf::LIGHTING_HITS), (uint32_t)Perf::last(Perf::LIGHTING_MISSES));
+	fl_font(FL_COURIER, 12);
+	fl_color(FL_GREEN);
+	fl_draw(buffer, x + 4, y + 4, PERF_HUD_W - 8, PERF_HUD_H - 8, FL_ALIGN_TOP_LEFT | FL_ALIGN_INSIDE);
+}
+
+void Main_Window::draw_events() {
+	// Only the events in the visible part of the map are looked up in the grid
+	static const uchar event_rgbs[NUM_EVENT_KINDS][3] = {
+		{0xF0, 0x58, 0xE8}, // warp
+		{0x48, 0xC8, 0xF8}, // coord
+		{0xF8, 0xB8, 0x30}, // bg
+		{0x58, 0xE0, 0x58}, // object
+	};
+	static const char *event_labels[NUM_EVENT_KINDS] = {"W", "C", "B", "O"};
+	int X = _map_scroll->x(), Y = _map_scroll->y();
+	int W = _map_scroll->w() - (_map_scroll->scrollbar.visible() ? _map_scroll->scrollbar.w() : 0);
+	int H = _map_scroll->h() - (_map_scroll->hscrollbar.visible() ? _map_scroll->hscrollbar.h() : 0);
+	int es = metatile_size() / 2, mx = _map_group->x(), my = _map_group->y();
+	int x0 = (X - mx) / es, y0 = (Y - my) / es;
+	int x1 = (X + W - mx + es - 1) / es, y1 = (Y + H - my + es - 1) / es;
+	_event_script.query(x0, y0, x1, y1, _visible_events);
+	if (_visible_events.empty()) { return; }
+	fl_push_clip(X, Y, W, H);
+	fl_font(FL_HELVETICA_BOLD, es / 2 + 2);
+	for (const Event *e : _visible_events) {
+		int x = mx + e->x * es, y = my + e->y * es;
+		const uchar *rgb = event_rgbs[e->kind];
+		Fl_Color c = fl_rgb_color(rgb[0], rgb[1], rgb[2]);
+		fl_color(c);
+		fl_rect(x, y, es, es);
+		fl_rect(x + 1, y + 1, es - 2, es - 2);
+		fl_color(FL_BLACK);
+		fl_draw(event_labels[e->kind], x + 1, y + 1, es, es, FL_ALIGN_CENTER);
+		fl_color(c);
+		fl_draw(event_labels[e->kind], x, y, es, es, FL_ALIGN_CENTER);
+	}
+	fl_pop_clip();
+}
+
 void Main_Window::draw_metatile(int x, int y, uint8_t id) const {
+	Perf_Scope scope("Main_Window::draw_metatile");
 	_metatileset.draw_metatile(x, y, id, zoom(), show_priority());
 }
 
+void Main_Window::draw_block(const Block *b) {
+	// Keep the visible blocks and a margin around them rendered
+	int ms = metatile_size();
+	int vx = MAX(_map_scroll->x() - _map_group->x(), 0), vy = MAX(_map_scroll->y() - _map_group->y(), 0);
+	int c0 = vx / ms, r0 = vy / ms;
+	int c1 = (vx + _map_scroll->w() + ms - 1) / ms, r1 = (vy + _map_scroll->h() + ms - 1) / ms;
+	_framebuffer.cover(_map, _metatileset, c0 - FRAMEBUFFER_MARGIN, r0 - FRAMEBUFFER_MARGIN,
+		c1 - c0 + 2 * FRAMEBUFFER_MARGIN, r1 - r0 + 2 * FRAMEBUFFER_MARGIN, ms);
+	const uchar *rgb = _framebuffer.pixels(_map, _metatileset, b->col(), b->row());
+	if (!rgb) {
+		draw_metatile(b->x(), b->y(), b->id());
+		return;
+	}
+	fl_draw_image(rgb, b->x(), b->y(), ms, ms, NUM_CHANNELS, _framebuffer.line_bytes());
+	Perf::count(Perf::BLOCKS_DRAWN);
+	Perf::count(Perf::DRAW_IMAGE_CALLS);
+	Perf::count(Perf::PIXELS_UPLOADED, ms * ms);
+	if (show_priority()) {
+		_metatileset.draw_metatile_priority(b->x(), b->y(), b->id(), zoom());
+	}
+}
+
+void Main_Window::show_blocks() {
+	// Block widgets are only created for the chunks of the map that get scrolled into view
+	if (!_map.size()) { return; }
+	Perf_Scope scope("Main_Window::show_blocks");
+	int ms = metatile_size();
+	int vx = MAX(_map_scroll->x() - _map_group->x(), 0), vy = MAX(_map_scroll->y() - _map_group->y(), 0);
+	int c0 = vx / ms / MAP_CHUNK_SIZE, r0 = vy / ms / MAP_CHUNK_SIZE;
+	int c1 = MIN((vx + _map_scroll->w()) / ms, (int)_map.width() - 1) / MAP_CHUNK_SIZE;
+	int r1 = MIN((vy + _map_scroll->h()) / ms, (int)_map.height() - 1) / MAP_CHUNK_SIZE;
+	int mx = _map_group->x(), my = _map_group->y();
+	for (int cy = r0; cy <= r1; cy++) {
+		for (int cx = c0; cx <= c1; cx++) {
+			int x0 = cx * MAP_CHUNK_SIZE, y0 = cy * MAP_CHUNK_SIZE;
+			if (_map.block((uint16_t)x0, (uint16_t)y0)) { continue; }
+			int x1 = MIN(x0 + MAP_CHUNK_SIZE, (int)_map.width()), y1 = MIN(y0 + MAP_CHUNK_SIZE, (int)_map.height());
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) {
+					uint16_t row = (uint16_t)y, col = (uint16_t)x;
+					Block *block = new Block(mx + x * ms, my + y * ms, ms, row, col, _map.id(col, row));
+					block->callback((Fl_Callback *)change_block_cb, this);
+					block->update_label();
+					_map_group->add(block);
+					_map.block(col, row, block);
+				}
+			}
+		}
+	}
+}
+
 void Main_Window::update_status(Block *b) {
 	if (!_map.size()) {
 		_metatile_count->label("");
@@ -703,7 +882,8 @@ void Main_Window::update_status(Block *b) {
 		_status_bar->redraw();
 		return;
 	}
-	uint8_t row = b->row(), col = b->col(), id = b->id();
+	uint16_t row = b->row(), col = b->col();
+	uint8_t id = b->id();
 	bool hex_ = hex();
 	sprintf(buffer, (hex_ ? "ID: $%02X" : "ID: %u"), id);
 	_hover_id->copy_label(buffer);
@@ -714,17 +894,46 @@ void Main_Window::update_status(Block *b) {
 
 void Main_Window::update_event_cursor(Block *b) {
 	if (!event_cursor() || !b) {
+		_event_x = _event_y = -1;
+	}
+	else {
+		_event_y = (int)b->row() * 2 + b->bottom_half();
+		_event_x = (int)b->col() * 2 + b->right_half();
+	}
+	// Refresh the status bar at most once per frame while the mouse moves
+	if (!_status_pending) {
+		_status_pending = true;
+		Fl::add_timeout(1.0 / 60.0, (Fl_Timeout_Handler)refresh_status_cb, this);
+	}
+}
+
+void Main_Window::refresh_status() {
+	_status_pending = false;
+	if (_event_x == -1) {
 		_hover_event->label("");
-		_status_bar->redraw();
-		return;
 	}
-	char buffer[64] = {};
-	int ey = (int)b->row() * 2 + b->bottom_half(), ex = (int)b->col() * 2 + b->right_half();
-	sprintf(buffer, (hex() ? "Event: X/Y ($%X, $%X)" : "Event: X/Y (%u, %u)"), ex, ey);
-	_hover_event->copy_label(buffer);
+	else {
+		// Only the events in the hovered cell of the grid are checked
+		const Event *e = _event_script.event_at(_event_x, _event_y);
+		const char *name = e ? Event_Script::kind_name(e->kind) : "Event";
+		char buffer[64] = {};
+		sprintf(buffer, (hex() ? "%s: X/Y ($%X, $%X)" : "%s: X/Y (%u, %u)"), name, _event_x, _event_y);
+		_hover_event->copy_label(buffer);
+	}
 	_status_bar->redraw();
 }
 
+void Main_Window::refresh_status_cb(Main_Window *mw) {
+	mw->refresh_status();
+}
+
+void Main_Window::refresh_perf_hud_cb(Main_Window *mw) {
+	if (!Perf::hud()) { return; }
+	int x = mw->_map_scroll->x() + mw->_map_scroll->w() - Fl::scrollbar_size() - PERF_HUD_W - 4;
+	mw->damage(FL_DAMAGE_USER1, x, mw->_map_scroll->y() + 4, PERF_HUD_W, PERF_HUD_H);
+	Fl::repeat_timeout(0.5, (Fl_Timeout_Handler)refresh_perf_hud_cb, mw);
+}
+
 void Main_Window::update_active_controls() {
 	if (_map.size()) {
 		_load_event_script_mi->activate();
@@ -737,8 +946,9 @@ void Main_Window::update_active_controls() {
 		_save_blockset_mi->activate();
 		_save_tileset_mi->activate();
 		_print_mi->activate();
+		_world_map_mi->activate();
 		_print_tb->activate();
-		if (false/* TODO: check for loaded event script */) {
+		if (_event_script.loaded()) {
 			_unload_event_script_mi->activate();
 			_save_event_script_mi->activate();
 		}
@@ -779,6 +989,8 @@ void Main_Window::update_active_controls() {
 			_swap_block_mi->deactivate();
 		}
 		_resize_blockset_mi->activate();
+		_compact_blockset_mi->activate();
+		_block_usage_mi->activate();
 		_add_sub_tb->activate();
 		_resize_map_mi->activate();
 		_resize_tb->activate();
@@ -786,6 +998,7 @@ void Main_Window::update_active_controls() {
 		_change_tileset_tb->activate();
 		_edit_tileset_mi->activate();
 		_edit_tileset_tb->activate();
+		_remove_duplicate_tiles_mi->activate();
 		if (_map_options_dialog->num_roofs() > 0) {
 			_change_roof_mi->activate();
 			_change_roof_tb->activate();
@@ -821,6 +1034,7 @@ void Main_Window::update_active_controls() {
 		_save_roof_mi->deactivate();
 		_save_event_script_mi->deactivate();
 		_print_mi->deactivate();
+		_world_map_mi->deactivate();
 		_print_tb->deactivate();
 		_undo_mi->deactivate();
 		_undo_tb->deactivate();
@@ -830,6 +1044,8 @@ void Main_Window::update_active_controls() {
 		_paste_block_mi->deactivate();
 		_swap_block_mi->deactivate();
 		_resize_blockset_mi->deactivate();
+		_compact_blockset_mi->deactivate();
+		_block_usage_mi->deactivate();
 		_add_sub_tb->deactivate();
 		_resize_map_mi->deactivate();
 		_resize_tb->deactivate();
@@ -837,6 +1053,7 @@ void Main_Window::update_active_controls() {
 		_edit_tileset_mi->deactivate();
 		_change_tileset_tb->deactivate();
 		_edit_tileset_tb->deactivate();
+		_remove_duplicate_tiles_mi->deactivate();
 		_change_roof_mi->deactivate();
 		_change_roof_tb->deactivate();
 		_edit_roof_mi->deactivate();
@@ -845,35 +1062,86 @@ void Main_Window::update_active_controls() {
 	}
 }
 
-void Main_Window::flood_fill(Block *b, uint8_t f, uint8_t t) {
+void Main_Window::substitute_block(uint8_t f, uint8_t t) {
 	if (f == t) { return; }
-	std::queue<size_t> queue;
-	uint8_t w = _map.width(), h = _map.height();
-	uint8_t row = b->row(), col = b->col();
-	size_t i = row * w + col;
-	queue.push(i);
-	while (!queue.empty()) {
-		size_t i = queue.front();
-		queue.pop();
-		Block *b = _map.block(i);
-		if (b->id() != f) { continue; }
-		b->id(t); // fill
-		uint8_t row = b->row(), col = b->col();
-		if (col > 0) { queue.push(i-1); } // left
-		if (col < w - 1) { queue.push(i+1); } // right
-		if (row > 0) { queue.push(i-w); } // up
-		if (row < h - 1) { queue.push(i+w); } // down
+	// copy the cells, since changing their IDs reindexes them
+	std::vector<size_t> cells = _dependencies.cells(f);
+	for (size_t i : cells) {
+		_map.cell_id(i, t);
 	}
 }
 
-void Main_Window::substitute_block(uint8_t f, uint8_t t) {
-	size_t n = _map.size();
-	for (size_t i = 0; i < n; i++) {
-		Block *b = _map.block(i);
-		if (b->id() == f) {
-			b->id(t);
-		}
+Directory_Chooser *Main_Window::new_dir_chooser() {
+	if (!_new_dir_chooser) {
+		_new_dir_chooser = new Directory_Chooser(Fl_Native_File_Chooser::BROWSE_DIRECTORY);
+		_new_dir_chooser->title("Choose Project Directory");
+	}
+	return _new_dir_chooser;
+}
+
+Fl_Native_File_Chooser *Main_Window::blk_open_chooser() {
+	if (!_blk_open_chooser) {
+		_blk_open_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
+		_blk_open_chooser->title("Open Map");
+		_blk_open_chooser->filter("BLK Files\t*.blk\n");
+	}
+	return _blk_open_chooser;
+}
+
+Fl_Native_File_Chooser *Main_Window::blk_save_chooser() {
+	if (!_blk_save_chooser) {
+		_blk_save_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
+		_blk_save_chooser->title("Save Map");
+		_blk_save_chooser->filter("BLK Files\t*.blk\n");
+		_blk_save_chooser->preset_file("NewMap.blk");
+	}
+	return _blk_save_chooser;
+}
+
+Fl_Native_File_Chooser *Main_Window::pal_load_chooser() {
+	if (!_pal_load_chooser) {
+		_pal_load_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
+		_pal_load_chooser->title("Open Lighting");
+		_pal_load_chooser->filter("PAL Files\t*.pal\n");
+	}
+	return _pal_load_chooser;
+}
+
+Fl_Native_File_Chooser *Main_Window::pal_save_chooser() {
+	if (!_pal_save_chooser) {
+		_pal_save_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
+		_pal_save_chooser->title("Save Lighting");
+		_pal_save_chooser->filter("PAL Files\t*.pal\n");
+		_pal_save_chooser->preset_file("lighting.pal");
+	}
+	return _pal_save_chooser;
+}
+
+Fl_Native_File_Chooser *Main_Window::roof_chooser() {
+	if (!_roof_chooser) {
+		_roof_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
+		_roof_chooser->title("Open Roof Tiles");
+		_roof_chooser->filter("PNG Files\t*.png\n2BPP Files\t*.2bpp\n");
+	}
+	return _roof_chooser;
+}
+
+Fl_Native_File_Chooser *Main_Window::png_chooser() {
+	if (!_png_chooser) {
+		_png_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
+		_png_chooser->title("Print Screenshot");
+		_png_chooser->filter("PNG Files\t*.png\n");
+	}
+	return _png_chooser;
+}
+
+Fl_Native_File_Chooser *Main_Window::asm_chooser() {
+	if (!_asm_chooser) {
+		_asm_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
+		_asm_chooser->title("Open Event Script");
+		_asm_chooser->filter("ASM Files\t*.asm\n");
 	}
+	return _asm_chooser;
 }
 
 void Main_Window::open_map(const char *filename) {
@@ -892,6 +1160,8 @@ void Main_Window::open_map(const char *filename) {
 }
 
 void Main_Window::open_map(const char *directory, const char *filename) {
+	// resolve the project's file layout again in case it changed on disk
+	Config::invalidate_paths();
 	// get map options
 	Map_Attributes attrs;
 	if (!_map_options_dialog->limit_blk_options(filename, directory, attrs)) {
@@ -912,6 +1182,12 @@ void Main_Window::open_map(const char *directory, const char *filename) {
 		_error_dialog->show(this);
 		return;
 	}
+	if ((size_t)_map_options_dialog->map_width() * _map_options_dialog->map_height() > MAX_MAP_AREA) {
+		std::string msg = Map::error_message(Map::Result::MAP_TOO_LARGE);
+		_error_dialog->message(msg);
+		_error_dialog->show(this);
+		return;
+	}
 
 	_map.modified(false);
 	_metatileset.modified(false);
@@ -923,7 +1199,7 @@ void Main_Window::open_map(const char *directory, const char *filename) {
 	}
 	else {
 		_blk_file = "";
-		_blk_save_chooser->directory(directory);
+		blk_save_chooser()->directory(directory);
 	}
 
 	// read data
@@ -931,7 +1207,7 @@ void Main_Window::open_map(const char *directory, const char *filename) {
 	const char *roof_name = _map_options_dialog->roof();
 	if (!read_metatile_data(tileset_name, roof_name)) { return; }
 
-	uint8_t w = _map_options_dialog->map_width(), h = _map_options_dialog->map_height();
+	uint16_t w = _map_options_dialog->map_width(), h = _map_options_dialog->map_height();
 	_map.size(w, h);
 	int ms = metatile_size();
 
@@ -958,33 +1234,13 @@ void Main_Window::open_map(const char *directory, const char *filename) {
 			return;
 		}
 
-		// map from file
-		_map_group->size(ms * (int)w, ms * (int)h);
-		for (uint8_t y = 0; y < h; y++) {
-			for (uint8_t x = 0; x < w; x++) {
-				Block *block = _map.block(x, y);
-				block->resize(_map_group->x() + x * ms, _map_group->y() + y * ms, ms, ms);
-				block->callback((Fl_Callback *)change_block_cb, this);
-				_map_group->add(block);
-			}
-		}
 	}
 	else {
 		basename = NEW_MAP_NAME;
 		_map.modified(true);
-
-		// new map
-		_map_group->size(ms * (int)w, ms * (int)h);
-		for (uint8_t row = 0; row < h; row++) {
-			for (uint8_t col = 0; col < w; col++) {
-				int x = col * ms, y = row * ms;
-				Block *block = new Block(_map_group->x() + x, _map_group->y() + y, ms, row, col, 0);
-				block->callback((Fl_Callback *)change_block_cb, this);
-				_map_group->add(block);
-				_map.block(col, row, block);
-			}
-		}
 	}
+	// blocks get their widgets from show_blocks once they are in view
+	_map_group->size(ms * (int)w, ms * (int)h);
 	_map_scroll->scroll_to(0, 0);
 	_map_scroll->init_sizes();
 	_map_scroll->contents(_map_group->w(), _map_group->h());
@@ -1002,7 +1258,7 @@ void Main_Window::open_map(const char *directory, const char *filename) {
 	else {
 		sprintf(buffer, "%s.png", basename);
 	}
-	_png_chooser->preset_file(buffer);
+	_png_file = buffer;
 
 	// populate sidebar with metatile buttons
 	_sidebar->scroll_to(0, 0);
@@ -1023,6 +1279,9 @@ void Main_Window::open_map(const char *directory, const char *filename) {
 	}
 	_copied = false;
 
+	_dependencies.index(_metatileset, _map);
+	_event_script.clear();
+
 	Tileset *tileset = _metatileset.tileset();
 	_block_window->tileset(tileset);
 	_tileset_window->tileset(tileset);
@@ -1055,6 +1314,8 @@ void Main_Window::open_map(const char *directory, const char *filename) {
 		}
 	}
 
+	load_connections();
+
 	// use lighting coresponding to palette
 	Lighting new_lighting = lighting();
 	if (new_lighting != Lighting::CUSTOM) {
@@ -1102,6 +1363,7 @@ void Main_Window::load_lighting(const char *filename) {
 	}
 
 	Lighting new_lighting = Color::read_lighting(filename, lighting());
+	_metatileset.tileset()->invalidate_lighting();
 	_edited_lighting = false;
 	if (new_lighting != lighting()) {
 		_lighting->value(new_lighting);
@@ -1139,6 +1401,7 @@ void Main_Window::load_roof_colors(bool quiet) {
 		}
 	}
 	else {
+		_metatileset.tileset()->invalidate_lighting();
 		update_lighting();
 		if (!quiet) {
 			std::string msg = "Loaded roof colors for map group ";
@@ -1209,6 +1472,7 @@ bool Main_Window::read_metatile_data(const char *tileset_name, const char *roof_
 	_metatileset.bin_collisions(bin_collisions);
 	rm = _metatileset.read_collisions(buffer);
 	_has_collisions = (rm == Metatileset::Result::META_OK);
+	_collision_overlay.clear();
 
 	if (tileset->has_roof()) {
 		Config::roof_path(buffer, directory, roof_name);
@@ -1285,6 +1549,8 @@ void Main_Window::force_add_sub_metatiles(size_t s, size_t n) {
 	_tileset_window->tileset(tileset);
 	_roof_window->tileset(tileset);
 
+	_dependencies.index(_metatileset, _map);
+
 	update_labels();
 	update_status(NULL);
 
@@ -1292,6 +1558,14 @@ void Main_Window::force_add_sub_metatiles(size_t s, size_t n) {
 }
 
 void Main_Window::resize_map(int w, int h) {
+	if ((size_t)w * h > MAX_MAP_AREA) {
+		std::string msg = "Could not resize the map!\n\n";
+		msg += Map::error_message(Map::Result::MAP_TOO_LARGE);
+		_error_dialog->message(msg);
+		_error_dialog->show(this);
+		return;
+	}
+
 	int dw = w - _map.width(), dh = h - _map.height();
 
 	int px, py;
@@ -1318,49 +1592,19 @@ void Main_Window::resize_map(int w, int h) {
 		py = dh / 2;
 	}
 
-	while (_map_group->children()) {
-		_map_group->remove(0);
-	}
-	int mx = MAX(px, 0), my = MAX(py, 0), mw = MIN(w, _map.width() + px), mh = MIN(h, _map.height() + py);
-	for (int y = 0; y < py; y++) {
-		for (int x = 0; x < w; x++) {
-			_map_group->add(new Block());
-		}
-	}
-	for (int y = my; y < mh; y++) {
-		for (int x = 0; x < px; x++) {
-			_map_group->add(new Block());
-		}
-		for (int x = mx; x < mw; x++) {
-			_map_group->add(_map.block((uint8_t)(x - px), (uint8_t)(y - py)));
-		}
-		for (int x = mw; x < w; x++) {
-			_map_group->add(new Block());
-		}
-	}
-	for (int y = mh; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			_map_group->add(new Block());
-		}
-	}
-
+	// the widgets are recreated by show_blocks at their new positions
+	_map_group->clear();
 	int ms = metatile_size();
 	_map_group->size(ms * (int)w, ms * (int)h);
-	_map.size((uint8_t)w, (uint8_t)h);
-	int i = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			Block *block = (Block *)_map_group->child(i++);
-			block->coords((uint8_t)y, (uint8_t)x);
-			block->resize(_map_group->x() + x * ms, _map_group->y() + y * ms, ms, ms);
-			block->callback((Fl_Callback *)change_block_cb, this);
-			_map.block((uint8_t)x, (uint8_t)y, block);
-		}
-	}
+	_map.resize((uint16_t)w, (uint16_t)h, px, py);
 
 	_map_scroll->scroll_to(0, 0);
 	_map_scroll->init_sizes();
 	_map_scroll->contents(_map_group->w(), _map_group->h());
+	update_connections();
+
+	_dependencies.index(_metatileset, _map);
+	_event_script.index(_map.width(), _map.height());
 
 	_map.modified(true);
 	redraw();
@@ -1371,22 +1615,13 @@ bool Main_Window::save_map(bool force) {
 	const char *basename = fl_filename_name(filename);
 
 	if (_map.modified() || force) {
-		FILE *file = fl_fopen(filename, "wb");
-		if (!file) {
+		if (!_map.write_blocks(filename)) {
 			std::string msg = "Could not write to ";
 			msg = msg + basename + "!";
 			_error_dialog->message(msg);
 			_error_dialog->show(this);
 			return false;
 		}
-
-		size_t n = _map.size();
-		for (size_t i = 0; i < n; i++) {
-			uint8_t id = _map.block(i)->id();
-			fputc(id, file);
-		}
-		fclose(file);
-
 		_map.modified(false);
 	}
 
@@ -1466,6 +1701,8 @@ bool Main_Window::save_tileset() {
 		_error_dialog->show(this);
 		return false;
 	}
+	// the .png may now take precedence over a .2bpp
+	Config::invalidate_paths();
 
 	std::string msg = "Saved ";
 	msg = msg + basename + "!";
@@ -1519,6 +1756,7 @@ bool Main_Window::save_roof() {
 		_error_dialog->show(this);
 		return false;
 	}
+	Config::invalidate_paths();
 
 	std::string msg = "Saved ";
 	msg = msg + basename + "!";
@@ -1550,21 +1788,39 @@ bool Main_Window::export_lighting(const char *filename, Lighting l) {
 }
 
 void Main_Window::edit_metatile(Metatile *mt) {
+	_dependencies.unindex_metatile(mt);
 	for (int y = 0; y < METATILE_SIZE; y++) {
 		for (int x = 0; x < METATILE_SIZE; x++) {
 			uint8_t id = _block_window->tile_id(x, y);
 			mt->tile_id(x, y, id);
-			for (int i = 0; i < NUM_QUADRANTS; i++) {
-				Quadrant q = (Quadrant)i;
-				const char *c = _block_window->collision(q);
-				mt->collision(q, c);
-				uint8_t b = _block_window->bin_collision(q);
-				mt->bin_collision(q, b);
-			}
 		}
 	}
+	for (int i = 0; i < NUM_QUADRANTS; i++) {
+		Quadrant q = (Quadrant)i;
+		uint16_t c = _metatileset.collision_id(_block_window->collision(q));
+		mt->collision(q, c);
+		uint8_t b = _block_window->bin_collision(q);
+		mt->bin_collision(q, b);
+	}
+	_dependencies.index_metatile(mt);
 	_metatileset.modified(true);
-	redraw();
+	redraw_metatile(mt->id());
+}
+
+void Main_Window::redraw_metatile(uint8_t id) {
+	_framebuffer.invalidate_metatile(id);
+	if (_connections.size()) {
+		_connections.invalidate();
+		_connection_preview->redraw();
+	}
+	if (id < _metatileset.size() && _metatile_buttons[id]) {
+		_metatile_buttons[id]->redraw();
+	}
+	const std::vector<size_t> &cells = _dependencies.cells(id);
+	for (size_t i : cells) {
+		Block *block = _map.block(i);
+		if (block) { block->redraw(); }
+	}
 }
 
 void Main_Window::update_zoom() {
@@ -1586,13 +1842,66 @@ void Main_Window::update_zoom() {
 		mt->resize(sx + dx, sy + dy, ms + 1, ms + 1);
 	}
 	int mx = _map_group->x(), my = _map_group->y();
-	for (uint8_t row = 0; row < _map.height(); row++) {
-		for (uint8_t col = 0; col < _map.width(); col++) {
-			Block *block = _map.block(col, row);
-			int dx = col * ms, dy = row * ms;
-			block->resize(mx + dx, my + dy, ms, ms);
-		}
+	for (int i = 0; i < _map_group->children(); i++) {
+		Block *block = (Block *)_map_group->child(i);
+		int dx = block->col() * ms, dy = block->row() * ms;
+		block->resize(mx + dx, my + dy, ms, ms);
 	}
+	update_connections();
+}
+
+void Main_Window::map_label(char *dest) const {
+	// The map's label is its filename without any extension or attributes
+	strcpy(dest, fl_filename_name(_blk_file.c_str()));
+	char *dot = strchr(dest, '.');
+	if (dot) { *dot = '\0'; }
+}
+
+void Main_Window::update_usage_index() {
+	// Only .blk files changed since the last query are read again
+	_usage_index.update(_directory.c_str());
+	if (_blk_file.empty()) { return; }
+	char current[FL_PATH_MAX] = {};
+	fl_filename_absolute(current, _blk_file.c_str());
+	_usage_index.recount(current, _map);
+}
+
+void Main_Window::load_connections() {
+	if (_blk_file.empty()) {
+		_connections.clear();
+		update_connections();
+		return;
+	}
+	char map_name[FL_PATH_MAX] = {};
+	map_label(map_name);
+	const char *directory = _directory.c_str();
+	size_t n = _connections.read_connections(directory, map_name);
+	Map_Attributes attrs;
+	for (size_t i = 0; i < n; i++) {
+		const char *blk_file = _connections.connection(i).blk_file.c_str();
+		std::string tileset_name = _map_options_dialog->guess_map_tileset(blk_file, directory, attrs);
+		_connections.tileset(i, tileset_name.c_str(), &_metatileset, lighting());
+	}
+	update_connections();
+}
+
+void Main_Window::update_connections() {
+	// Leave room around the map for the connected maps' strips
+	int ms = metatile_size();
+	int left = _connections.margin(WEST_CONNECTION) * ms, top = _connections.margin(NORTH_CONNECTION) * ms;
+	int right = _connections.margin(EAST_CONNECTION) * ms, bottom = _connections.margin(SOUTH_CONNECTION) * ms;
+	int ox = _map_scroll->x() - _map_scroll->xposition(), oy = _map_scroll->y() - _map_scroll->yposition();
+	_map_group->position(ox + left, oy + top);
+	int w = left + _map_group->w() + right, h = top + _map_group->h() + bottom;
+	if (left || top || right || bottom) {
+		_connection_preview->resize(ox, oy, w, h);
+	}
+	else {
+		_connection_preview->resize(ox, oy, 0, 0);
+	}
+	_map_scroll->init_sizes();
+	_map_scroll->contents(w, h);
+	_map_scroll->redraw();
 }
 
 void Main_Window::update_labels() {
@@ -1600,9 +1909,8 @@ void Main_Window::update_labels() {
 	for (size_t i = 0; i < n; i++) {
 		_metatile_buttons[i]->id(_metatile_buttons[i]->id());
 	}
-	n = _map.size();
-	for (size_t i = 0; i < n; i++) {
-		_map.block(i)->update_label();
+	for (int i = 0; i < _map_group->children(); i++) {
+		((Block *)_map_group->child(i))->update_label();
 	}
 	redraw();
 }
@@ -1610,6 +1918,8 @@ void Main_Window::update_labels() {
 void Main_Window::update_lighting() {
 	Tileset *tileset = _metatileset.tileset();
 	tileset->update_lighting(lighting());
+	_connections.update_lighting(lighting());
+	_world_window->lighting(lighting());
 	redraw();
 }
 
@@ -1648,7 +1958,7 @@ void Main_Window::new_cb(Fl_Widget *, Main_Window *mw) {
 	char directory[FL_PATH_MAX] = {};
 
 	if (!mw->_map.size()) {
-		int status = mw->_new_dir_chooser->show();
+		int status = mw->new_dir_chooser()->show();
 		if (status == 1) { return; }
 		if (status == -1) {
 			std::string msg = "Could not get project directory!";
@@ -1657,7 +1967,7 @@ void Main_Window::new_cb(Fl_Widget *, Main_Window *mw) {
 			return;
 		}
 
-		const char *project_dir = mw->_new_dir_chooser->filename();
+		const char *project_dir = mw->new_dir_chooser()->filename();
 		strcpy(directory, project_dir);
 		strcat(directory, DIR_SEP);
 	}
@@ -1678,14 +1988,27 @@ void Main_Window::open_cb(Fl_Widget *, Main_Window *mw) {
 		if (mw->_unsaved_dialog->canceled()) { return; }
 	}
 
-	int status = mw->_blk_open_chooser->show();
+	// Browse the current project's maps, unless there is none or another one is asked for
+	if (!mw->_directory.empty() &&
+		mw->_map_browser->show(mw, mw->_directory.c_str(), mw->lighting()) == World_Map::Result::WORLD_OK) {
+		if (mw->_map_browser->canceled()) { return; }
+		if (!mw->_map_browser->browse()) {
+			mw->open_map(mw->_map_browser->filename());
+			return;
+		}
+		char maps_directory[FL_PATH_MAX] = {};
+		sprintf(maps_directory, "%s%s", mw->_directory.c_str(), Config::maps_dir());
+		mw->blk_open_chooser()->directory(maps_directory);
+	}
+
+	int status = mw->blk_open_chooser()->show();
 	if (status == 1) { return; }
 
-	const char *filename = mw->_blk_open_chooser->filename();
+	const char *filename = mw->blk_open_chooser()->filename();
 	const char *basename = fl_filename_name(filename);
 	if (status == -1) {
 		std::string msg = "Could not open ";
-		msg = msg + basename + "!\n\n" + mw->_blk_open_chooser->errmsg();
+		msg = msg + basename + "!\n\n" + mw->blk_open_chooser()->errmsg();
 		mw->_error_dialog->message(msg);
 		mw->_error_dialog->show(mw);
 		return;
@@ -1718,11 +2041,17 @@ void Main_Window::close_cb(Fl_Widget *, Main_Window *mw) {
 	mw->_map_group->clear();
 	mw->_map_group->size(0, 0);
 	mw->_map.clear();
+	mw->_dependencies.clear();
+	mw->_framebuffer.clear();
+	mw->_event_script.clear();
+	mw->_connections.clear();
+	mw->_connection_preview->size(0, 0);
 	mw->_map_scroll->contents(0, 0);
 	mw->init_sizes();
 	mw->update_status(NULL);
 	mw->_directory.clear();
 	mw->_blk_file.clear();
+	Config::invalidate_paths();
 	mw->_metatileset.clear();
 	mw->_block_window->tileset(NULL);
 	mw->_tileset_window->tileset(NULL);
@@ -1751,15 +2080,15 @@ void Main_Window::save_cb(Fl_Widget *w, Main_Window *mw) {
 void Main_Window::save_as_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_map.size()) { return; }
 
-	int status = mw->_blk_save_chooser->show();
+	int status = mw->blk_save_chooser()->show();
 	if (status == 1) { return; }
 
-	const char *filename = mw->_blk_save_chooser->filename();
+	const char *filename = mw->blk_save_chooser()->filename();
 	const char *basename = fl_filename_name(filename);
 
 	if (status == -1) {
 		std::string msg = "Could not open ";
-		msg = msg + basename + "!\n\n" + mw->_blk_save_chooser->errmsg();
+		msg = msg + basename + "!\n\n" + mw->blk_save_chooser()->errmsg();
 		mw->_error_dialog->message(msg);
 		mw->_error_dialog->show(mw);
 		return;
@@ -1776,6 +2105,7 @@ void Main_Window::save_as_cb(Fl_Widget *, Main_Window *mw) {
 
 	mw->_directory = directory;
 	mw->_blk_file = filename ? filename : "";
+	Config::invalidate_paths();
 
 	char buffer[FL_PATH_MAX] = {};
 	sprintf(buffer, PROGRAM_NAME " - %s", basename);
@@ -1789,7 +2119,7 @@ void Main_Window::save_as_cb(Fl_Widget *, Main_Window *mw) {
 	else {
 		sprintf(buffer, "%s.png", basename);
 	}
-	mw->_png_chooser->preset_file(buffer);
+	mw->_png_file = buffer;
 
 	mw->save_map(true);
 }
@@ -1818,16 +2148,53 @@ void Main_Window::save_roof_cb(Fl_Widget *, Main_Window *mw) {
 	mw->save_roof();
 }
 
-void Main_Window::load_event_script_cb(Fl_Widget *, Main_Window *) {
-	// TODO: load_event_script_cb
+void Main_Window::load_event_script_cb(Fl_Widget *, Main_Window *mw) {
+	if (!mw->_map.size()) { return; }
+
+	Fl_Native_File_Chooser *chooser = mw->asm_chooser();
+	char directory[FL_PATH_MAX] = {};
+	sprintf(directory, "%s%s", mw->_directory.c_str(), Config::maps_dir());
+	chooser->directory(directory);
+	int status = chooser->show();
+	if (status == 1) { return; }
+
+	const char *filename = chooser->filename();
+	const char *basename = fl_filename_name(filename);
+	if (status == -1) {
+		std::string msg = "Could not open ";
+		msg = msg + basename + "!\n\n" + chooser->errmsg();
+		mw->_error_dialog->message(msg);
+		mw->_error_dialog->show(mw);
+		return;
+	}
+
+	Event_Script::Result r = mw->_event_script.read_events(filename);
+	if (r) {
+		mw->_event_script.clear();
+		mw->update_active_controls();
+		mw->redraw();
+		std::string msg = "Error reading ";
+		msg = msg + basename + "!\n\n" + Event_Script::error_message(r);
+		mw->_error_dialog->message(msg);
+		mw->_error_dialog->show(mw);
+		return;
+	}
+	mw->_event_script.index(mw->_map.width(), mw->_map.height());
+
+	mw->update_active_controls();
+	mw->redraw();
 }
 
 void Main_Window::save_event_script_cb(Fl_Widget *, Main_Window *) {
 	// TODO: save_event_script_cb
 }
 
-void Main_Window::unload_event_script_cb(Fl_Widget *, Main_Window *) {
-	// TODO: unload_event_script_cb
+void Main_Window::unload_event_script_cb(Fl_Widget *, Main_Window *mw) {
+	if (!mw->_event_script.loaded()) { return; }
+	mw->_event_script.clear();
+	mw->update_active_controls();
+	mw->update_status(NULL);
+	mw->redraw();
 }
 
 void Main_Window::load_roof_colors_cb(Fl_Widget *, Main_Window *mw) {
@@ -1844,14 +2211,14 @@ void Main_Window::load_roof_colors_cb(Fl_Widget *, Main_Window *mw) {
 }
 
 void Main_Window::load_lighting_cb(Fl_Widget *, Main_Window *mw) {
-	int status = mw->_pal_load_chooser->show();
+	int status = mw->pal_load_chooser()->show();
 	if (status == 1) { return; }
 
-	const char *filename = mw->_pal_load_chooser->filename();
+	const char *filename = mw->pal_load_chooser()->filename();
 	const char *basename = fl_filename_name(filename);
 	if (status == -1) {
 		std::string msg = "Could not open ";
-		msg = msg + basename + "!\n\n" + mw->_pal_load_chooser->errmsg();
+		msg = msg + basename + "!\n\n" + mw->pal_load_chooser()->errmsg();
 		mw->_error_dialog->message(msg);
 		mw->_error_dialog->show(mw);
 		return;
@@ -1864,15 +2231,15 @@ void Main_Window::load_lighting_cb(Fl_Widget *, Main_Window *mw) {
 }
 
 void Main_Window::export_current_lighting_cb(Fl_Widget *, Main_Window *mw) {
-	int status = mw->_pal_save_chooser->show();
+	int status = mw->pal_save_chooser()->show();
 	if (status == 1) { return; }
 
-	const char *filename = mw->_pal_save_chooser->filename();
+	const char *filename = mw->pal_save_chooser()->filename();
 	const char *basename = fl_filename_name(filename);
 
 	if (status == -1) {
 		std::string msg = "Could not open ";
-		msg = msg + basename + "!\n\n" + mw->_pal_save_chooser->errmsg();
+		msg = msg + basename + "!\n\n" + mw->pal_save_chooser()->errmsg();
 		mw->_error_dialog->message(msg);
 		mw->_error_dialog->show(mw);
 		return;
@@ -1884,15 +2251,17 @@ void Main_Window::export_current_lighting_cb(Fl_Widget *, Main_Window *mw) {
 void Main_Window::print_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_map.size()) { return; }
 
-	int status = mw->_png_chooser->show();
+	Fl_Native_File_Chooser *chooser = mw->png_chooser();
+	chooser->preset_file(mw->_png_file.c_str());
+	int status = chooser->show();
 	if (status == 1) { return; }
 
-	const char *filename = mw->_png_chooser->filename();
+	const char *filename = chooser->filename();
 	const char *basename = fl_filename_name(filename);
 
 	if (status == -1) {
 		std::string msg = "Could not print to ";
-		msg = msg + basename + "!\n\n" + mw->_png_chooser->errmsg();
+		msg = msg + basename + "!\n\n" + chooser->errmsg();
 		mw->_error_dialog->message(msg);
 		mw->_error_dialog->show(mw);
 		return;
@@ -1906,8 +2275,11 @@ void Main_Window::print_cb(Fl_Widget *, Main_Window *mw) {
 		mw->_error_dialog->show(mw);
 	}
 	else {
+		char stats[FL_PATH_MAX] = {};
+		sprintf(stats, "%s encoder: %.1f KB in %.2f s", Image::encoder_name(Image::encoder()),
+			Image::encoded_size() / 1024.0, Image::encode_time());
 		std::string msg = "Printed ";
-		msg = msg + basename + "!";
+		msg = msg + basename + "!\n\n" + stats;
 		mw->_success_dialog->message(msg);
 		mw->_success_dialog->show(mw);
 	}
@@ -1948,15 +2320,20 @@ void Main_Window::exit_cb(Fl_Widget *, Main_Window *mw) {
 	Preferences::set("show", mw->show_events());
 	Preferences::set("event", mw->event_cursor());
 	Preferences::set("priority", mw->show_priority());
+	Preferences::set("collisions", mw->show_collisions());
+	Preferences::set("connections", mw->connection_strip());
 	Preferences::set("lighting", mw->lighting());
 	Preferences::set("monochrome", mw->monochrome());
 	Preferences::set("all256", mw->allow_256_tiles());
 	Preferences::set("special", mw->auto_load_special_lighting());
 	Preferences::set("roofs", mw->auto_load_roof_colors());
+	Preferences::set("png", mw->_png_preference);
 	if (mw->_resize_dialog->initialized()) {
 		Preferences::set("resize-anchor", mw->_resize_dialog->anchor());
 	}
 
+	Perf::write_trace();
+
 	exit(EXIT_SUCCESS);
 }
 
@@ -1988,18 +2365,25 @@ void Main_Window::paste_metatile_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_copied || !mw->_selected) { return; }
 	uint8_t id = mw->_selected->id();
 	Metatile *dest = mw->_metatileset.metatile(id);
+	mw->_dependencies.unindex_metatile(dest);
 	dest->copy(&mw->_clipboard);
+	mw->_dependencies.index_metatile(dest);
 	mw->_metatileset.modified(true);
-	mw->redraw();
+	mw->redraw_metatile(id);
 }
 
 void Main_Window::swap_metatiles_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_copied || !mw->_selected) { return; }
 	uint8_t id1 = mw->_clipboard.id(), id2 = mw->_selected->id();
 	Metatile *mt1 = mw->_metatileset.metatile(id1), *mt2 = mw->_metatileset.metatile(id2);
+	mw->_dependencies.unindex_metatile(mt1);
+	mw->_dependencies.unindex_metatile(mt2);
 	mt1->swap(mt2);
+	mw->_dependencies.index_metatile(mt1);
+	mw->_dependencies.index_metatile(mt2);
 	mw->_metatileset.modified(true);
-	mw->redraw();
+	mw->redraw_metatile(id1);
+	mw->redraw_metatile(id2);
 }
 
 void Main_Window::aero_theme_cb(Fl_Menu_ *, Main_Window *mw) {
@@ -2043,6 +2427,15 @@ void Main_Window::full_screen_cb(Fl_Menu_ *m, Main_Window *mw) {
 	}
 }
 
+void Main_Window::perf_hud_cb(Fl_Menu_ *m, Main_Window *mw) {
+	Perf::hud(!!m->mvalue()->value());
+	Fl::remove_timeout((Fl_Timeout_Handler)refresh_perf_hud_cb, mw);
+	if (Perf::hud()) {
+		Fl::add_timeout(0.5, (Fl_Timeout_Handler)refresh_perf_hud_cb, mw);
+	}
+	mw->redraw();
+}
+
 #define SYNC_TB_WITH_M(tb, m) tb->value(m->mvalue()->value())
 
 void Main_Window::grid_cb(Fl_Menu_ *m, Main_Window *mw) {
@@ -2085,6 +2478,10 @@ void Main_Window::show_priority_cb(Fl_Menu_ *m, Main_Window *mw) {
 	mw->redraw();
 }
 
+void Main_Window::show_collisions_cb(Fl_Menu_ *, Main_Window *mw) {
+	mw->redraw();
+}
+
 #undef SYNC_TB_WITH_M
 
 #define SYNC_MI_WITH_TB(tb, mi) if (tb->value()) mi->set(); else mi->clear()
@@ -2131,6 +2528,30 @@ void Main_Window::show_priority_tb_cb(Toolbar_Toggle_Button *, Main_Window *mw)
 
 #undef SYNC_MI_WITH_TB
 
+void Main_Window::no_connections_cb(Fl_Menu_ *, Main_Window *mw) {
+	mw->_connections.strip(0);
+	mw->update_connections();
+	mw->redraw();
+}
+
+void Main_Window::small_connections_cb(Fl_Menu_ *, Main_Window *mw) {
+	mw->_connections.strip(1);
+	mw->update_connections();
+	mw->redraw();
+}
+
+void Main_Window::medium_connections_cb(Fl_Menu_ *, Main_Window *mw) {
+	mw->_connections.strip(3);
+	mw->update_connections();
+	mw->redraw();
+}
+
+void Main_Window::large_connections_cb(Fl_Menu_ *, Main_Window *mw) {
+	mw->_connections.strip(6);
+	mw->update_connections();
+	mw->redraw();
+}
+
 void Main_Window::morn_lighting_cb(Fl_Menu_ *, Main_Window *mw) {
 	mw->_lighting->value(Lighting::MORN);
 	mw->update_lighting();
@@ -2161,6 +2582,19 @@ void Main_Window::custom_lighting_cb(Fl_Menu_ *, Main_Window *mw) {
 	mw->redraw();
 }
 
+void Main_Window::world_map_cb(Fl_Menu_ *, Main_Window *mw) {
+	if (!mw->_map.size()) { return; }
+	char map_name[FL_PATH_MAX] = {};
+	mw->map_label(map_name);
+	World_Map::Result r = mw->_world_window->show(mw, mw->_directory.c_str(), map_name, mw->lighting());
+	if (r != World_Map::Result::WORLD_OK) {
+		std::string msg = "Could not show the world map!\n\n";
+		msg = msg + World_Map::error_message(r);
+		mw->_error_dialog->message(msg);
+		mw->_error_dialog->show(mw);
+	}
+}
+
 void Main_Window::lighting_cb(Dropdown *, Main_Window *mw) {
 	Lighting lighting = (Lighting)mw->_lighting->value();
 	switch (lighting) {
@@ -2208,6 +2642,227 @@ void Main_Window::add_sub_cb(Fl_Widget *, Main_Window *mw) {
 	}
 }
 
+void Main_Window::block_usage_cb(Fl_Widget *, Main_Window *mw) {
+	if (!mw->_map.size() || !mw->_selected) { return; }
+
+	mw->update_usage_index();
+	const char *tileset_name = mw->_metatileset.tileset()->name();
+	std::vector<uint8_t> ids(1, mw->_selected->id());
+	std::vector<Map_Usage> uses;
+	size_t total = mw->_usage_index.usage(tileset_name, ids, uses);
+
+	char buffer[32] = {};
+	sprintf(buffer, (mw->hex() ? "Block $%02X" : "Block %u"), ids[0]);
+	std::string msg(buffer);
+	if (uses.empty()) {
+		msg = msg + " is not used by any map with the " + tileset_name + " tileset.";
+	}
+	else {
+		size_t n = mw->_usage_index.maps_using(tileset_name).size();
+		msg = msg + " is used " + std::to_string(total) + (total == 1 ? " time in " : " times in ") +
+			std::to_string(uses.size()) + " of the " + std::to_string(n) + (n == 1 ? " map" : " maps") + " with the " +
+			tileset_name + " tileset:\n";
+		// Long lists are cut short to fit the dialog
+		size_t shown = uses.size() > BLOCK_USAGE_LINES ? BLOCK_USAGE_LINES - 1 : uses.size();
+		for (size_t i = 0; i < shown; i++) {
+			const Indexed_Map &m = mw->_usage_index.map(uses[i].map);
+			msg = msg + "\n" + m.label + ": " + std::to_string(uses[i].count);
+		}
+		if (shown < uses.size()) {
+			msg = msg + "\n(and " + std::to_string(uses.size() - shown) + " more)";
+		}
+	}
+	mw->_success_dialog->message(msg);
+	mw->_success_dialog->show(mw);
+}
+
+void Main_Window::compact_blockset_cb(Fl_Widget *, Main_Window *mw) {
+	if (!mw->_map.size()) { return; }
+
+	if (mw->unsaved()) {
+		std::string msg = mw->modified_filename();
+		msg = msg + " has unsaved changes!\n\n"
+			"Save before compacting the blockset.";
+		mw->_error_dialog->message(msg);
+		mw->_error_dialog->show(mw);
+		return;
+	}
+
+	const char *directory = mw->_directory.c_str();
+	const char *tileset_name = mw->_metatileset.tileset()->name();
+
+	// Scan this map and every other .blk that uses the same tileset
+	bool used[MAX_NUM_METATILES] = {};
+	size_t n = mw->_map.size();
+	std::vector<uint8_t> map_ids(n);
+	mw->_map.copy_ids(map_ids.data());
+	for (uint8_t id : map_ids) {
+		used[id] = true;
+	}
+
+	char current[FL_PATH_MAX] = {};
+	fl_filename_absolute(current, mw->_blk_file.c_str());
+	char maps_directory[FL_PATH_MAX] = {};
+	strcpy(maps_directory, directory);
+	strcat(maps_directory, Config::maps_dir());
+
+	std::vector<std::string> blk_files;
+	std::vector<std::vector<uint8_t>> blk_data;
+	dirent **list;
+	int m = fl_filename_list(maps_directory, &list);
+	for (int i = 0; i < m; i++) {
+		const char *name = list[i]->d_name;
+		if (!fl_filename_match(name, "*.[Bb][Ll][Kk]")) { continue; }
+		std::string filename(maps_directory);
+		filename += name;
+		char absolute[FL_PATH_MAX] = {};
+		fl_filename_absolute(absolute, filename.c_str());
+		if (!strcmp(absolute, current)) { continue; }
+		Map_Attributes attrs;
+		if (mw->_map_options_dialog->guess_map_tileset(filename.c_str(), directory, attrs) != tileset_name) { continue; }
+		std::vector<uint8_t> ids(file_size(filename.c_str()));
+		FILE *file = fl_fopen(filename.c_str(), "rb");
+		if (!file || fread(ids.data(), 1, ids.size(), file) != ids.size()) {
+			if (file) { fclose(file); }
+			fl_filename_free_list(&list, m);
+			std::string msg = "Could not read ";
+			msg = msg + name + "!";
+			mw->_error_dialog->message(msg);
+			mw->_error_dialog->show(mw);
+			return;
+		}
+		fclose(file);
+		for (uint8_t id : ids) {
+			used[id] = true;
+		}
+		blk_files.push_back(filename);
+		blk_data.push_back(ids);
+	}
+	if (m >= 0) { fl_filename_free_list(&list, m); }
+
+	uint8_t remap[MAX_NUM_METATILES] = {};
+	size_t s = mw->_metatileset.size();
+	size_t k = mw->_metatileset.compaction(used, remap);
+	if (k == s) {
+		std::string msg = "The blockset is already compact!";
+		mw->_success_dialog->message(msg);
+		mw->_success_dialog->show(mw);
+		return;
+	}
+
+	size_t unused = 0;
+	for (size_t i = 0; i < s; i++) {
+		if (!used[i]) { unused++; }
+	}
+	std::string msg = "Compacting will merge " + std::to_string(s - k - unused) + " duplicate and remove " +
+		std::to_string(unused) + " unused blocks,\nleaving " + std::to_string(k) + " of " + std::to_string(s) + ".\n\n" +
+		"This rewrites the blockset" + (mw->_has_collisions ? ", its collisions," : "") + " and " +
+		std::to_string(blk_files.size() + 1) + " .blk files. Blocks used only\nby scripts will be lost, and the map's undo history is cleared.\n\n"
+		"Compact the blockset anyway?";
+	mw->_unsaved_dialog->message(msg);
+	mw->_unsaved_dialog->show(mw);
+	if (mw->_unsaved_dialog->canceled()) { return; }
+
+	// Keep a copy of the blocks in case any file cannot be written
+	std::vector<Metatile> backup;
+	backup.reserve(s);
+	for (size_t i = 0; i < s; i++) {
+		backup.emplace_back((uint8_t)i);
+		backup.back().copy(mw->_metatileset.metatile((uint8_t)i));
+	}
+	mw->_metatileset.compact(used, remap);
+
+	// Build every file's new contents, keeping the old ones to undo a partial write
+	std::vector<Compacted_File> files;
+	char filename[FL_PATH_MAX] = {};
+	Config::metatileset_path(filename, directory, tileset_name);
+	files.emplace_back(filename);
+	mw->_metatileset.print_metatiles(files.back().data);
+	if (mw->_has_collisions) {
+		Config::collisions_path(filename, directory, tileset_name);
+		files.emplace_back(filename);
+		mw->_metatileset.print_collisions(files.back().data);
+	}
+	files.emplace_back(mw->_blk_file);
+	files.back().data.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		files.back().data[i] = remap[map_ids[i]];
+	}
+	for (Compacted_File &cf : files) {
+		Mapped_File file(cf.target.c_str());
+		cf.existed = file.is_open();
+		cf.original.assign(file.data(), file.data() + file.size());
+	}
+	for (size_t i = 0; i < blk_files.size(); i++) {
+		files.emplace_back(blk_files[i]);
+		Compacted_File &cf = files.back();
+		cf.existed = true;
+		cf.original.swap(blk_data[i]);
+		cf.data.resize(cf.original.size());
+		for (size_t j = 0; j < cf.data.size(); j++) {
+			cf.data[j] = remap[cf.original[j]];
+		}
+	}
+
+	// Each file is replaced atomically; on the first failure, the ones
+	// already written get their old contents back
+	size_t written = 0;
+	for (; written < files.size(); written++) {
+		const Compacted_File &cf = files[written];
+		if (!write_file_atomic(cf.target.c_str(), cf.data.data(), cf.data.size())) { break; }
+	}
+	if (written < files.size()) {
+		std::string unrestored;
+		for (size_t i = 0; i < written; i++) {
+			const Compacted_File &cf = files[i];
+			bool restored = cf.existed ? write_file_atomic(cf.target.c_str(), cf.original.data(), cf.original.size()) :
+				!fl_unlink(cf.target.c_str());
+			if (!restored) {
+				unrestored = unrestored + "\n" + fl_filename_name(cf.target.c_str());
+			}
+		}
+		mw->_metatileset.size(s);
+		for (size_t i = 0; i < s; i++) {
+			mw->_metatileset.metatile((uint8_t)i)->copy(&backup[i]);
+		}
+		mw->_metatileset.modified(false);
+		std::string msg = "Could not write to ";
+		msg = msg + fl_filename_name(files[written].target.c_str()) + "!\n\n";
+		if (unrestored.empty()) {
+			msg += "No files were changed.";
+		}
+		else {
+			msg = msg + "These files are compacted and could not be restored:\n" + unrestored;
+		}
+		mw->_error_dialog->message(msg);
+		mw->_error_dialog->show(mw);
+		return;
+	}
+
+	// Apply the new block IDs to the open map and hotkeys
+	mw->_map.remap_blocks(remap);
+	std::unordered_map<int, uint8_t> hotkeys;
+	hotkeys.swap(mw->_hotkey_metatiles);
+	mw->_metatile_hotkeys.clear();
+	for (const auto &hk : hotkeys) {
+		uint8_t id = hk.second;
+		if (id < s && !used[id]) { continue; }
+		id = remap[id];
+		if (mw->_metatile_hotkeys.count(id)) { continue; }
+		mw->_hotkey_metatiles[hk.first] = id;
+		mw->_metatile_hotkeys[id] = hk.first;
+	}
+	mw->_copied = false;
+	mw->force_add_sub_metatiles(s, k);
+	mw->_metatileset.modified(false);
+	mw->_map.modified(false);
+	mw->update_active_controls();
+
+	msg = "Compacted the blockset to " + std::to_string(k) + (k == 1 ? " block!" : " blocks!");
+	mw->_success_dialog->message(msg);
+	mw->_success_dialog->show(mw);
+}
+
 void Main_Window::resize_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_map.size()) { return; }
 	mw->_resize_dialog->map_size(mw->_map.width(), mw->_map.height());
@@ -2268,12 +2923,49 @@ void Main_Window::change_tileset_cb(Fl_Widget *, Main_Window *mw) {
 void Main_Window::edit_tileset_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_map.size()) { return; }
 
+	mw->update_usage_index();
 	mw->_tileset_window->tileset(mw->_metatileset.tileset());
+	mw->_tileset_window->usage(&mw->_usage_index, &mw->_dependencies);
 	mw->_tileset_window->show(mw, mw->show_priority());
 	bool canceled = mw->_tileset_window->canceled();
 	if (canceled) { return; }
 
-	mw->_tileset_window->apply_modifications();
+	std::vector<uint8_t> changed;
+	mw->_tileset_window->apply_modifications(changed);
+	std::vector<uint8_t> mids = mw->_dependencies.metatiles_using(changed);
+	for (uint8_t id : mids) {
+		mw->redraw_metatile(id);
+	}
+}
+
+void Main_Window::remove_duplicate_tiles_cb(Fl_Widget *, Main_Window *mw) {
+	if (!mw->_map.size()) { return; }
+
+	Tile_Index index;
+	index.add_tileset(*mw->_metatileset.const_tileset());
+	size_t n = index.num_exact(), f = index.num_flipped();
+	if (!n) {
+		std::string msg = "No duplicate tiles found!";
+		if (f) {
+			msg = msg + "\n\n" + std::to_string(f) + (f == 1 ? " tile is a flipped copy" : " tiles are flipped copies") +
+				" of another,\nbut blocks cannot flip tiles.";
+		}
+		mw->_success_dialog->message(msg);
+		mw->_success_dialog->show(mw);
+		return;
+	}
+
+	std::string msg = "Found " + std::to_string(n) + (n == 1 ? " duplicate tile" : " duplicate tiles");
+	if (f) {
+		msg = msg + " and\n" + std::to_string(f) + (f == 1 ? " flipped copy" : " flipped copies") + " (which blocks cannot use)";
+	}
+	msg = msg + ".\n\nChange all blocks to use the original tiles?";
+	mw->_unsaved_dialog->message(msg);
+	mw->_unsaved_dialog->show(mw);
+	if (mw->_unsaved_dialog->canceled()) { return; }
+
+	index.remap(mw->_metatileset);
+	mw->_dependencies.index(mw->_metatileset, mw->_map);
 	mw->redraw();
 }
 
@@ -2353,6 +3045,7 @@ void Main_Window::edit_current_lighting_cb(Fl_Widget *, Main_Window *mw) {
 
 	mw->_edited_lighting = true;
 	alw->apply_modifications();
+	mw->_metatileset.tileset()->invalidate_lighting();
 	mw->update_lighting();
 	mw->redraw();
 }
@@ -2373,6 +3066,30 @@ void Main_Window::auto_load_special_lighting_cb(Fl_Menu_ *m, Main_Window *mw) {
 	}
 }
 
+void Main_Window::png_encoder(Image::Encoder e) {
+	Image::encoder(e);
+	switch (e) {
+	case Image::Encoder::PNG_FAST:     _png_fast_mi->setonly(); break;
+	case Image::Encoder::PNG_BALANCED: _png_balanced_mi->setonly(); break;
+	case Image::Encoder::PNG_SMALLEST: _png_smallest_mi->setonly(); break;
+	}
+}
+
+void Main_Window::png_fast_cb(Fl_Menu_ *, Main_Window *mw) {
+	Image::encoder(Image::Encoder::PNG_FAST);
+	mw->_png_preference = Image::Encoder::PNG_FAST;
+}
+
+void Main_Window::png_balanced_cb(Fl_Menu_ *, Main_Window *mw) {
+	Image::encoder(Image::Encoder::PNG_BALANCED);
+	mw->_png_preference = Image::Encoder::PNG_BALANCED;
+}
+
+void Main_Window::png_smallest_cb(Fl_Menu_ *, Main_Window *mw) {
+	Image::encoder(Image::Encoder::PNG_SMALLEST);
+	mw->_png_preference = Image::Encoder::PNG_SMALLEST;
+}
+
 void Main_Window::auto_load_roof_colors_cb(Fl_Menu_ *m, Main_Window *mw) {
 	if (mw->auto_load_roof_colors() == !m->mvalue()->value()) {
 		mw->redraw();
@@ -2393,7 +3110,8 @@ void Main_Window::select_metatile_cb(Metatile_Button *mb, Main_Window *mw) {
 	if (Fl::event_button() == FL_RIGHT_MOUSE) {
 		// Right-click to edit
 		Metatile *mt = mw->_metatileset.metatile(mb->id());
-		mw->_block_window->metatile(mt, mw->_has_collisions, mw->_metatileset.bin_collisions());
+		mw->_block_window->metatile(mt, mw->_metatileset.collision_names(), mw->_has_collisions,
+			mw->_metatileset.bin_collisions());
 		mw->_block_window->show(mw, mw->show_priority());
 		if (!mw->_block_window->canceled()) {
 			mw->edit_metatile(mt);
@@ -2411,7 +3129,7 @@ void Main_Window::change_block_cb(Block *b, Main_Window *mw) {
 		}
 		if (Fl::event_shift()) {
 			// Shift+left-click to flood fill
-			mw->flood_fill(b, b->id(), mw->_selected->id());
+			mw->_map.flood_fill(b->col(), b->row(), mw->_selected->id());
 			mw->_map_group->redraw();
 			mw->_map.modified(true);
 			mw->update_status(b);
@@ -2426,7 +3144,7 @@ void Main_Window::change_block_cb(Block *b, Main_Window *mw) {
 		else {
 			// Left-click/drag to edit
 			uint8_t id = mw->_selected->id();
-			b->id(id);
+			mw->_map.id(b->col(), b->row(), id);
 			b->damage(1);
 			mw->_map.modified(true);
 			mw->update_status(b);
@@ -2439,3 +3157,8 @@ void Main_Window::change_block_cb(Block *b, Main_Window *mw) {
 		mw->select_metatile(mw->_metatile_buttons[id]);
 	}
 }
+
+void Main_Window::map_changed_cb(uint16_t x, uint16_t y, uint8_t from, uint8_t to, Main_Window *mw) {
+	size_t i = (size_t)y * mw->_map.width() + (size_t)x;
+	mw->_dependencies.move_cell(i, from, to);
+}
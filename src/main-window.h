@@ -17,11 +17,20 @@
 #include "option-dialogs.h"
 #include "metatileset.h"
 #include "map.h"
+#include "image.h"
+#include "dependency-index.h"
+#include "usage-index.h"
+#include "map-framebuffer.h"
+#include "collision-overlay.h"
+#include "event-script.h"
+#include "map-connections.h"
 #include "help-window.h"
 #include "block-window.h"
 #include "tileset-window.h"
 #include "roof-window.h"
 #include "lighting-window.h"
+#include "world-window.h"
+#include "map-browser.h"
 #include "directory-chooser.h"
 
 #define METATILES_PER_ROW 4
@@ -39,15 +48,20 @@ private:
 	Workspace *_sidebar, *_map_scroll;
 	Toolbar *_status_bar;
 	Fl_Group *_map_group;
+	Connection_Preview *_connection_preview;
 	// GUI inputs
 	DnD_Receiver *_dnd_receiver;
 	Fl_Menu_Item *_aero_theme_mi = NULL, *_metro_theme_mi = NULL, *_greybird_theme_mi = NULL, *_blue_theme_mi = NULL,
 		*_dark_theme_mi = NULL;
 	Fl_Menu_Item *_grid_mi = NULL, *_zoom_mi = NULL, *_ids_mi = NULL, *_hex_mi = NULL, *_show_events_mi = NULL,
-		*_event_cursor_mi = NULL, *_show_priority_mi, *_full_screen_mi = NULL;
+		*_event_cursor_mi = NULL, *_show_priority_mi, *_show_collisions_mi = NULL, *_full_screen_mi = NULL,
+		*_perf_hud_mi = NULL, *_world_map_mi = NULL;
+	Fl_Menu_Item *_no_connections_mi = NULL, *_small_connections_mi = NULL, *_medium_connections_mi = NULL,
+		*_large_connections_mi = NULL;
 	Fl_Menu_Item *_morn_mi = NULL, *_day_mi = NULL, *_night_mi = NULL, *_indoor_mi = NULL, *_custom_mi = NULL;
 	Fl_Menu_Item *_blocks_mode_mi = NULL, *_events_mode_mi = NULL;
 	Fl_Menu_Item *_monochrome_mi = NULL, *_allow_256_tiles_mi = NULL, *_special_lighting_mi = NULL, *_roof_colors_mi = NULL;
+	Fl_Menu_Item *_png_fast_mi = NULL, *_png_balanced_mi = NULL, *_png_smallest_mi = NULL;
 	Toolbar_Button *_new_tb, *_open_tb, *_load_event_script_tb, *_save_tb, *_print_tb, *_undo_tb, *_redo_tb,
 		*_add_sub_tb, *_resize_tb, *_change_tileset_tb, *_change_roof_tb, *_edit_tileset_tb, *_edit_roof_tb,
 		*_load_lighting_tb, *_edit_current_lighting_tb;
@@ -61,12 +75,12 @@ private:
 		*_close_mi = NULL, *_save_mi = NULL, *_save_as_mi = NULL, *_save_map_mi, *_save_blockset_mi = NULL,
 		*_save_tileset_mi = NULL, *_save_roof_mi = NULL, *_save_event_script_mi = NULL, *_print_mi = NULL;
 	Fl_Menu_Item *_undo_mi = NULL, *_redo_mi = NULL, *_copy_block_mi = NULL, *_paste_block_mi = NULL, *_swap_block_mi = NULL;
-	Fl_Menu_Item *_resize_blockset_mi = NULL, *_resize_map_mi = NULL, *_change_tileset_mi = NULL, *_change_roof_mi = NULL,
-		*_edit_tileset_mi = NULL, *_edit_roof_mi = NULL, *_edit_current_lighting_mi = NULL;
+	Fl_Menu_Item *_resize_blockset_mi = NULL, *_compact_blockset_mi = NULL, *_resize_map_mi = NULL, *_change_tileset_mi = NULL, *_change_roof_mi = NULL,
+		*_block_usage_mi = NULL, *_edit_tileset_mi = NULL, *_remove_duplicate_tiles_mi = NULL, *_edit_roof_mi = NULL, *_edit_current_lighting_mi = NULL;
 	// Dialogs
-	Directory_Chooser *_new_dir_chooser;
-	Fl_Native_File_Chooser *_blk_open_chooser, *_blk_save_chooser, *_pal_load_chooser, *_pal_save_chooser, *_roof_chooser,
-		*_png_chooser;
+	Directory_Chooser *_new_dir_chooser = NULL;
+	Fl_Native_File_Chooser *_blk_open_chooser = NULL, *_blk_save_chooser = NULL, *_pal_load_chooser = NULL,
+		*_pal_save_chooser = NULL, *_roof_chooser = NULL, *_png_chooser = NULL, *_asm_chooser = NULL;
 	Modal_Dialog *_error_dialog, *_warning_dialog, *_success_dialog, *_unsaved_dialog, *_about_dialog;
 	Map_Options_Dialog *_map_options_dialog;
 	Tileset_Options_Dialog *_tileset_options_dialog;
@@ -79,17 +93,31 @@ private:
 	Roof_Window *_roof_window;
 	Lighting_Window *_lighting_window;
 	Monochrome_Lighting_Window *_monochrome_lighting_window;
+	World_Window *_world_window;
+	Map_Browser *_map_browser;
 	// Data
-	std::string _directory, _blk_file;
+	std::string _directory, _blk_file, _png_file;
 	Metatileset _metatileset;
 	Map _map;
+	Dependency_Index _dependencies;
+	Usage_Index _usage_index;
+	Map_Framebuffer _framebuffer;
+	Collision_Overlay _collision_overlay;
+	Event_Script _event_script;
+	std::vector<const Event *> _visible_events;
+	Map_Connections _connections;
 	// Metatile button properties
 	Metatile_Button *_metatile_buttons[MAX_NUM_METATILES];
 	Metatile_Button *_selected = NULL;
 	// Work properties
 	Mode _mode = Mode::BLOCKS;
 	bool _unsaved = false, _has_collisions = false, _edited_lighting = false, _copied = false, _map_editable = false;
+	// Event cursor coordinates waiting to be shown, or -1
+	int _event_x = -1, _event_y = -1;
+	bool _status_pending = false;
 	Metatile _clipboard;
+	// The PNG encoder chosen in the menu; a command-line override is not saved
+	Image::Encoder _png_preference = Image::Encoder::PNG_BALANCED;
 	std::unordered_map<int, uint8_t> _hotkey_metatiles;
 	std::unordered_map<uint8_t, int> _metatile_hotkeys;
 	// Window size cache
@@ -102,6 +130,7 @@ public:
 	Main_Window(int x, int y, int w, int h, const char *l = NULL);
 	~Main_Window();
 	void show(void);
+	void draw(void);
 	inline bool grid(void) const { return _grid_mi && !!_grid_mi->value(); }
 	inline bool zoom(void) const { return _zoom_mi && !!_zoom_mi->value(); }
 	inline bool ids(void) const { return _ids_mi && !!_ids_mi->value(); }
@@ -109,12 +138,20 @@ public:
 	inline bool show_events(void) const { return _show_events_mi && !!_show_events_mi->value(); }
 	inline bool event_cursor(void) const { return _event_cursor_mi && !!_event_cursor_mi->value(); }
 	inline bool show_priority(void) const { return _show_priority_mi && !!_show_priority_mi->value(); }
+	inline bool show_collisions(void) const { return _show_collisions_mi && !!_show_collisions_mi->value(); }
+	inline int connection_strip(void) const {
+		return _small_connections_mi && _small_connections_mi->value() ? 1 :
+			_medium_connections_mi && _medium_connections_mi->value() ? 3 :
+			_large_connections_mi && _large_connections_mi->value() ? 6 : 0;
+	}
 	inline Lighting lighting(void) const { return (Lighting)_lighting->value(); }
 	inline Mode mode(void) const { return _mode; }
 	inline bool monochrome(void) const { return _monochrome_mi && !!_monochrome_mi->value(); }
 	inline bool allow_256_tiles(void) const { return _allow_256_tiles_mi && !!_allow_256_tiles_mi->value(); }
 	inline bool auto_load_special_lighting(void) const { return _special_lighting_mi && !!_special_lighting_mi->value(); }
 	inline bool auto_load_roof_colors(void) const { return _roof_colors_mi && !!_roof_colors_mi->value(); }
+	inline Image::Encoder png_encoder(void) const { return Image::encoder(); }
+	void png_encoder(Image::Encoder e);
 	inline int metatile_size(void) const { return METATILE_PX_SIZE * (zoom() ? ZOOM_FACTOR : 1); }
 	inline bool unsaved(void) const {
 		return _map.modified() || _metatileset.modified() || _metatileset.const_tileset()->modified() || _metatileset.const_tileset()->modified_roof();
@@ -127,9 +164,13 @@ public:
 	const char *modified_filename(void);
 	int handle(int event);
 	void draw_metatile(int x, int y, uint8_t id) const;
+	void draw_block(const Block *b);
+	void show_blocks(void);
+	void draw_perf_hud(void);
+	void draw_events(void);
 	void update_status(Block *b);
 	void update_event_cursor(Block *b);
-	void flood_fill(Block *b, uint8_t f, uint8_t t);
+	void refresh_status(void);
 	void substitute_block(uint8_t f, uint8_t t);
 	void open_map(const char *filename);
 private:
@@ -149,10 +190,24 @@ private:
 	bool save_roof(void);
 	bool export_lighting(const char *filename, Lighting l);
 	void edit_metatile(Metatile *mt);
+	void redraw_metatile(uint8_t id);
 	void update_zoom(void);
+	void map_label(char *dest) const;
+	void load_connections(void);
+	void update_usage_index(void);
+	void update_connections(void);
 	void update_labels(void);
 	void update_lighting(void);
 	void select_metatile(Metatile_Button *mb);
+	// File choosers are created on first use
+	Directory_Chooser *new_dir_chooser(void);
+	Fl_Native_File_Chooser *blk_open_chooser(void);
+	Fl_Native_File_Chooser *blk_save_chooser(void);
+	Fl_Native_File_Chooser *pal_load_chooser(void);
+	Fl_Native_File_Chooser *pal_save_chooser(void);
+	Fl_Native_File_Chooser *roof_chooser(void);
+	Fl_Native_File_Chooser *png_chooser(void);
+	Fl_Native_File_Chooser *asm_chooser(void);
 	// Drag-and-drop
 	static void drag_and_drop_cb(DnD_Receiver *dndr, Main_Window *mw);
 	// File menu
@@ -192,28 +247,44 @@ private:
 	static void show_events_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void event_cursor_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void show_priority_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void show_collisions_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void no_connections_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void small_connections_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void medium_connections_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void large_connections_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void morn_lighting_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void day_lighting_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void night_lighting_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void indoor_lighting_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void custom_lighting_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void world_map_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void full_screen_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void perf_hud_cb(Fl_Menu_ *m, Main_Window *mw);
 	// Mode menu
 	static void blocks_mode_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void events_mode_cb(Fl_Menu_ *m, Main_Window *mw);
 	// Tools menu
 	static void add_sub_cb(Fl_Widget *w, Main_Window *mw);
+	static void compact_blockset_cb(Fl_Widget *w, Main_Window *mw);
+	static void block_usage_cb(Fl_Widget *w, Main_Window *mw);
 	static void resize_cb(Fl_Widget *w, Main_Window *mw);
 	static void change_tileset_cb(Fl_Widget *w, Main_Window *mw);
 	static void change_roof_cb(Fl_Widget *w, Main_Window *mw);
 	static void edit_tileset_cb(Fl_Widget *w, Main_Window *mw);
+	static void remove_duplicate_tiles_cb(Fl_Widget *w, Main_Window *mw);
 	static void edit_roof_cb(Fl_Widget *w, Main_Window *mw);
 	static void edit_current_lighting_cb(Fl_Widget *w, Main_Window *mw);
+	// Status bar
+	static void refresh_status_cb(Main_Window *mw);
+	static void refresh_perf_hud_cb(Main_Window *mw);
 	// Options menu
 	static void monochrome_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void allow_256_tiles_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void auto_load_special_lighting_cb(Fl_Menu_ *m, Main_Window *mw);
 	static void auto_load_roof_colors_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void png_fast_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void png_balanced_cb(Fl_Menu_ *m, Main_Window *mw);
+	static void png_smallest_cb(Fl_Menu_ *m, Main_Window *mw);
 	// Toolbar buttons
 	static void grid_tb_cb(Toolbar_Toggle_Button *tb, Main_Window *mw);
 	static void zoom_tb_cb(Toolbar_Toggle_Button *tb, Main_Window *mw);
@@ -232,6 +303,7 @@ private:
 	static void select_metatile_cb(Metatile_Button *mb, Main_Window *mw);
 	// Map
 	static void change_block_cb(Block *b, Main_Window *mw);
+	static void map_changed_cb(uint16_t x, uint16_t y, uint8_t from, uint8_t to, Main_Window *mw);
 };
 
 #endif
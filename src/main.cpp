@@ -1,4 +1,6 @@
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 #pragma warning(push, 0)
 #include <FL/Fl.H>
@@ -9,6 +11,7 @@
 #include "version.h"
 #include "preferences.h"
 #include "themes.h"
+#include "perf.h"
 #include "main-window.h"
 
 #ifdef _WIN32
@@ -48,6 +51,26 @@ int main(int argc, char **argv) {
 #endif
 	Fl::visual(FL_DOUBLE | FL_RGB);
 
+	// polished-map [--png=fast|balanced|smallest] [--perf-log] [--trace=trace.json] [map.blk]
+	// (parsed before creating the window so startup can be profiled)
+	static const char *usage = "Usage: " PROGRAM_EXE " [--png=fast|balanced|smallest] [--perf-log] [--trace=trace.json] [map.blk]";
+	int encoder = -1;
+	const char *filename = NULL;
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--png=fast") { encoder = Image::Encoder::PNG_FAST; }
+		else if (arg == "--png=balanced") { encoder = Image::Encoder::PNG_BALANCED; }
+		else if (arg == "--png=smallest") { encoder = Image::Encoder::PNG_SMALLEST; }
+		else if (arg == "--perf-log") { Perf::log(true); }
+		else if (arg.compare(0, 8, "--trace=") == 0) { Perf::trace_file(argv[i] + 8); }
+		else if (arg[0] == '-') {
+			// A mistyped option should not be opened as a map
+			std::cerr << "Unknown option: " << arg << "\n" << usage << std::endl;
+			return EXIT_FAILURE;
+		}
+		else { filename = argv[i]; }
+	}
+
 #ifdef _WIN32
 	OS::Theme theme = (OS::Theme)Preferences::get("theme", (int)OS::Theme::BLUE);
 #else
@@ -64,8 +87,11 @@ int main(int argc, char **argv) {
 	Main_Window window(x, y, w, h);
 	window.show();
 
-	if (argc > 1) {
-		window.open_map(argv[1]);
+	if (encoder != -1) {
+		window.png_encoder((Image::Encoder)encoder);
+	}
+	if (filename) {
+		window.open_map(filename);
 	}
 
 	return Fl::run();
@@ -0,0 +1,417 @@
+#include <cctype>
+#include <cstring>
+
+#pragma warning(push, 0)
+#include <FL/Fl.H>
+#include <FL/fl_draw.H>
+#include <FL/fl_utf8.h>
+#pragma warning(pop)
+
+#include "themes.h"
+#include "config.h"
+#include "preferences.h"
+#include "world-window.h"
+#include "map-browser.h"
+
+static std::string lowercase(const char *s) {
+	std::string l(s);
+	for (char &c : l) {
+		c = (char)tolower((unsigned char)c);
+	}
+	return l;
+}
+
+Thumbnail_Grid::Thumbnail_Grid(int x, int y, int w, int h) : Fl_Group(x, y, w, h), _catalog(NULL), _renderer(NULL),
+	_items(), _selected(0), _top(0), _opened(false), _polling(false), _scrollbar(NULL), _scratch() {
+	int sw = Fl::scrollbar_size();
+	_scrollbar = new Fl_Scrollbar(x + w - sw, y, sw, h);
+	end();
+	labeltype(FL_NO_LABEL);
+	box(FL_NO_BOX);
+	color(FL_BACKGROUND2_COLOR);
+	_scrollbar->slider(OS_BUTTON_UP_BOX);
+	_scrollbar->linesize(THUMBNAIL_CELL_H / 2);
+	_scrollbar->callback((Fl_Callback *)scrollbar_cb, this);
+}
+
+Thumbnail_Grid::~Thumbnail_Grid() {
+	Fl::remove_timeout((Fl_Timeout_Handler)poll_cb, this);
+}
+
+void Thumbnail_Grid::catalog(const World_Map *c, World_Renderer *r) {
+	Fl::remove_timeout((Fl_Timeout_Handler)poll_cb, this);
+	_polling = false;
+	_catalog = c;
+	_renderer = r;
+	_items.clear();
+	for (size_t i = 0; c && i < c->size(); i++) {
+		_items.push_back(i);
+	}
+	_selected = 0;
+	_top = 0;
+	_scratch.clear();
+	_scratch.shrink_to_fit();
+	update_scrollbar();
+	redraw();
+}
+
+void Thumbnail_Grid::filter(const char *text) {
+	// Keep the selected map selected if it still passes
+	size_t previous = selected();
+	std::string needle = lowercase(text);
+	_items.clear();
+	for (size_t i = 0; _catalog && i < _catalog->size(); i++) {
+		if (lowercase(_catalog->map(i).label.c_str()).find(needle) != std::string::npos) {
+			_items.push_back(i);
+		}
+	}
+	_selected = 0;
+	for (size_t item = 0; item < _items.size(); item++) {
+		if (_items[item] == previous) { _selected = item; }
+	}
+	_top = 0;
+	scroll_to_selected();
+	redraw();
+	_opened = false;
+	do_callback();
+}
+
+size_t Thumbnail_Grid::selected() const {
+	if (_selected < _items.size()) { return _items[_selected]; }
+	return _catalog ? _catalog->size() : 0;
+}
+
+int Thumbnail_Grid::columns() const {
+	return MAX((w() - _scrollbar->w()) / THUMBNAIL_CELL_W, 1);
+}
+
+int Thumbnail_Grid::left() const {
+	// Center the columns in the space left of the scrollbar
+	return x() + MAX(w() - _scrollbar->w() - columns() * THUMBNAIL_CELL_W, 0) / 2;
+}
+
+size_t Thumbnail_Grid::item_at(int ex, int ey) const {
+	int dx = ex - left(), dy = ey - y() + _top;
+	if (dx < 0 || dy < 0) { return _items.size(); }
+	int col = dx / THUMBNAIL_CELL_W, row = dy / THUMBNAIL_CELL_H, cols = columns();
+	if (col >= cols) { return _items.size(); }
+	size_t item = (size_t)row * cols + col;
+	return MIN(item, _items.size());
+}
+
+void Thumbnail_Grid::resize(int x, int y, int w, int h) {
+	// The grid reflows its cells instead of scaling them like a group would
+	Fl_Widget::resize(x, y, w, h);
+	int sw = Fl::scrollbar_size();
+	_scrollbar->resize(x + w - sw, y, sw, h);
+	scroll_to_selected();
+}
+
+void Thumbnail_Grid::update_scrollbar() {
+	int cols = columns();
+	int rows = (int)((_items.size() + cols - 1) / cols);
+	int total = rows * THUMBNAIL_CELL_H;
+	_top = MAX(0, MIN(_top, total - h()));
+	_scrollbar->value(_top, h(), 0, MAX(total, h()));
+}
+
+void Thumbnail_Grid::select(size_t item, bool open) {
+	if (item >= _items.size()) { return; }
+	bool changed = item != _selected;
+	_selected = item;
+	scroll_to_selected();
+	redraw();
+	if (changed || open) {
+		_opened = open;
+		do_callback();
+	}
+}
+
+void Thumbnail_Grid::scroll_to_selected() {
+	int row_y = (int)(_selected / columns()) * THUMBNAIL_CELL_H;
+	if (row_y < _top) {
+		_top = row_y;
+	}
+	else if (row_y + THUMBNAIL_CELL_H > _top + h()) {
+		_top = row_y + THUMBNAIL_CELL_H - h();
+	}
+	update_scrollbar();
+}
+
+bool Thumbnail_Grid::move_selection(int key) {
+	if (_items.empty()) { return false; }
+	long long n = (long long)_items.size(), s = _selected < _items.size() ? (long long)_selected : 0;
+	int cols = columns(), rows = MAX(h() / THUMBNAIL_CELL_H, 1);
+	switch (key) {
+	case FL_Left: s--; break;
+	case FL_Right: s++; break;
+	case FL_Up: s -= cols; break;
+	case FL_Down: s += cols; break;
+	case FL_Page_Up: s -= cols * rows; break;
+	case FL_Page_Down: s += cols * rows; break;
+	case FL_Home: s = 0; break;
+	case FL_End: s = n - 1; break;
+	default: return false;
+	}
+	select((size_t)MAX(0, MIN(s, n - 1)), false);
+	return true;
+}
+
+int Thumbnail_Grid::thumbnail_ppb(const World_Map_Entry &m) {
+	// The largest power of two that fits the map in the thumbnail box, or
+	// 1 for maps too large for that, which are scaled down to fit when drawn
+	if (!m.width || !m.height || m.tileset == NO_WORLD_TILESET) { return 0; }
+	int fit = THUMBNAIL_SIZE / MAX(m.width, m.height), ppb = 1;
+	while (ppb * 2 <= fit && ppb * 2 <= MAX_THUMBNAIL_PPB) {
+		ppb *= 2;
+	}
+	return ppb;
+}
+
+void Thumbnail_Grid::draw() {
+	int gw = w() - _scrollbar->w(), gh = h();
+	fl_push_clip(x(), y(), gw, gh);
+	fl_rectf(x(), y(), gw, gh, color());
+	if (_catalog && _renderer && _renderer->running()) {
+		// Only the visible cells request thumbnails
+		_renderer->begin_frame();
+		int cols = columns(), lx = left();
+		for (size_t item = (size_t)(_top / THUMBNAIL_CELL_H) * cols; item < _items.size(); item++) {
+			int cx = lx + (int)(item % cols) * THUMBNAIL_CELL_W, cy = y() + (int)(item / cols) * THUMBNAIL_CELL_H - _top;
+			if (cy >= y() + gh) { break; }
+			draw_cell(item, cx, cy, gw, gh);
+		}
+	}
+	fl_pop_clip();
+	draw_child(*_scrollbar);
+	if (_renderer && _renderer->busy() && !_polling) {
+		_polling = true;
+		Fl::add_timeout(1.0 / 30.0, (Fl_Timeout_Handler)poll_cb, this);
+	}
+}
+
+void Thumbnail_Grid::draw_cell(size_t item, int cx, int cy, int gw, int gh) {
+	size_t i = _items[item];
+	const World_Map_Entry &m = _catalog->map(i);
+	bool selected = item == _selected;
+	if (selected) {
+		fl_rectf(cx + 2, cy + 2, THUMBNAIL_CELL_W - 4, THUMBNAIL_CELL_H - 4, FL_SELECTION_COLOR);
+	}
+	int tx = cx + (THUMBNAIL_CELL_W - THUMBNAIL_SIZE) / 2, ty = cy + 8;
+	int ppb = thumbnail_ppb(m);
+	const World_Image *image = ppb ? _renderer->image(i, ppb) : NULL;
+	if (image && image->w) {
+		int iw = image->w, ih = image->h, s = MAX(iw, ih);
+		if (s > THUMBNAIL_SIZE) {
+			iw = MAX(iw * THUMBNAIL_SIZE / s, 1);
+			ih = MAX(ih * THUMBNAIL_SIZE / s, 1);
+		}
+		int ix = tx + (THUMBNAIL_SIZE - iw) / 2, iy = ty + (THUMBNAIL_SIZE - ih) / 2;
+		int cx0 = MAX(ix, x()), cy0 = MAX(iy, y());
+		int cx1 = MIN(ix + iw, x() + gw), cy1 = MIN(iy + ih, y() + gh);
+		if (cx0 < cx1 && cy0 < cy1) {
+			draw_world_image(image, ix, iy, iw, ih, cx0, cy0, cx1 - cx0, cy1 - cy0, _scratch);
+		}
+	}
+	else {
+		// Still rendering, or the map's size, tileset, or blocks are unknown
+		int q = THUMBNAIL_SIZE / 4;
+		fl_rectf(tx + q, ty + q, THUMBNAIL_SIZE - q * 2, THUMBNAIL_SIZE - q * 2, ppb && !image ? FL_DARK2 : FL_DARK3);
+	}
+	fl_font(OS_FONT, OS_FONT_SIZE);
+	fl_color(selected ? fl_contrast(FL_FOREGROUND_COLOR, FL_SELECTION_COLOR) : FL_FOREGROUND_COLOR);
+	fl_draw(m.label.c_str(), cx + 4, ty + THUMBNAIL_SIZE + 2, THUMBNAIL_CELL_W - 8, THUMBNAIL_CELL_H - THUMBNAIL_SIZE - 12,
+		FL_ALIGN_TOP | FL_ALIGN_INSIDE | FL_ALIGN_CLIP);
+}
+
+int Thumbnail_Grid::handle(int event) {
+	int key = Fl::event_key();
+	switch (event) {
+	case FL_PUSH:
+		if (Fl::event_inside(_scrollbar)) { break; }
+		take_focus();
+		select(item_at(Fl::event_x(), Fl::event_y()), Fl::event_clicks() > 0);
+		return 1;
+	case FL_FOCUS:
+	case FL_UNFOCUS:
+		return 1;
+	case FL_MOUSEWHEEL:
+		_top += Fl::event_dy() * THUMBNAIL_CELL_H / 2;
+		update_scrollbar();
+		redraw();
+		return 1;
+	case FL_KEYBOARD:
+		if (move_selection(key)) { return 1; }
+		if (key == FL_Enter || key == FL_KP_Enter) {
+			select(_selected, true);
+			return 1;
+		}
+		break;
+	case FL_SHORTCUT:
+		// Let the arrow keys move the selection while typing a filter
+		if (key == FL_Up || key == FL_Down || key == FL_Page_Up || key == FL_Page_Down) {
+			return move_selection(key) ? 1 : 0;
+		}
+		break;
+	}
+	return Fl_Group::handle(event);
+}
+
+void Thumbnail_Grid::scrollbar_cb(Fl_Scrollbar *sb, Thumbnail_Grid *tg) {
+	tg->_top = sb->value();
+	tg->redraw();
+}
+
+void Thumbnail_Grid::poll_cb(Thumbnail_Grid *tg) {
+	if (!tg->_renderer) {
+		tg->_polling = false;
+		return;
+	}
+	if (tg->_renderer->collect()) {
+		tg->redraw();
+	}
+	if (tg->_renderer->busy()) {
+		Fl::repeat_timeout(1.0 / 30.0, (Fl_Timeout_Handler)poll_cb, tg);
+	}
+	else {
+		tg->_polling = false;
+	}
+}
+
+Map_Browser::Map_Browser(int w, int h) : _width(w), _height(h), _canceled(false), _browse(false), _dialog(NULL),
+	_heading(NULL), _filter(NULL), _grid(NULL), _buttons(NULL), _spacer(NULL), _browse_button(NULL), _cancel_button(NULL),
+	_open_button(NULL), _catalog(), _renderer(), _filename() {}
+
+Map_Browser::~Map_Browser() {
+	close();
+	delete _dialog;
+	delete _heading;
+	delete _filter;
+	delete _grid;
+	delete _buttons;
+	delete _spacer;
+	delete _browse_button;
+	delete _cancel_button;
+	delete _open_button;
+}
+
+void Map_Browser::initialize() {
+	if (_dialog) { return; }
+	Fl_Group *prev_current = Fl_Group::current();
+	Fl_Group::current(NULL);
+	// Populate dialog
+	int ww = _width, wh = _height;
+	_dialog = new Fl_Double_Window(0, 0, ww, wh, "Open Map");
+	_heading = new Label(10, 10, ww - 20, 22);
+	_filter = new OS_Input(52, 36, ww - 62, 22, "Filter:");
+	_grid = new Thumbnail_Grid(10, 66, ww - 20, wh - 108);
+	_buttons = new Fl_Group(0, wh - 42, ww, 42);
+	_browse_button = new OS_Button(10, wh - 32, 80, 22, "Browse...");
+	_spacer = new Spacer(100, wh - 32, ww - 294, 22);
+#ifdef _WIN32
+	_open_button = new Default_Button(ww - 184, wh - 32, 80, 22, "Open");
+	_cancel_button = new OS_Button(ww - 90, wh - 32, 80, 22, "Cancel");
+#else
+	_cancel_button = new OS_Button(ww - 184, wh - 32, 80, 22, "Cancel");
+	_open_button = new Default_Button(ww - 90, wh - 32, 80, 22, "Open");
+#endif
+	_buttons->end();
+	_dialog->end();
+	// Initialize dialog
+	_dialog->resizable(_grid);
+	_dialog->size_range(400, 300);
+	_dialog->callback((Fl_Callback *)cancel_cb, this);
+	_dialog->set_modal();
+	// Initialize dialog's children
+	_heading->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE | FL_ALIGN_CLIP);
+	_filter->when(FL_WHEN_CHANGED);
+	_filter->callback((Fl_Callback *)filter_cb, this);
+	_grid->callback((Fl_Callback *)grid_cb, this);
+	_buttons->resizable(_spacer);
+	_browse_button->tooltip("Choose a map from anywhere");
+	_browse_button->callback((Fl_Callback *)browse_cb, this);
+	_open_button->tooltip("Open (Enter)");
+	_open_button->callback((Fl_Callback *)open_cb, this);
+	_cancel_button->shortcut(FL_Escape);
+	_cancel_button->tooltip("Cancel (Esc)");
+	_cancel_button->callback((Fl_Callback *)cancel_cb, this);
+	Fl_Group::current(prev_current);
+}
+
+void Map_Browser::update_open_button() {
+	if (_grid->selected() < _catalog.size()) {
+		_open_button->activate();
+	}
+	else {
+		_open_button->deactivate();
+	}
+}
+
+void Map_Browser::close() {
+	// Stop rendering and free the thumbnails, which are saved on disk
+	if (_grid) { _grid->catalog(NULL, NULL); }
+	_renderer.stop();
+	_catalog.clear();
+}
+
+World_Map::Result Map_Browser::show(const Fl_Widget *p, const char *directory, Lighting l) {
+	initialize();
+	_canceled = true;
+	_browse = false;
+	_filename.clear();
+	World_Map::Result r = _catalog.read_catalog(directory);
+	if (r != World_Map::Result::WORLD_OK) {
+		_catalog.clear();
+		return r;
+	}
+	// Thumbnails are read from the cache when it has them, so the
+	// renderer only reads tilesets for new or changed maps
+	char cache[FL_PATH_MAX] = {};
+	if (Preferences::userdata_path(cache, FL_PATH_MAX - 16)) {
+		strcat(cache, "thumbnails" DIR_SEP);
+		_renderer.disk_cache(fl_make_path(cache) ? cache : NULL);
+	}
+	_renderer.start(&_catalog, l);
+	std::string heading = "Maps in ";
+	heading = heading + directory + Config::maps_dir();
+	_heading->copy_label(heading.c_str());
+	_filter->value("");
+	_grid->catalog(&_catalog, &_renderer);
+	update_open_button();
+	int x = p->x() + (p->w() - _dialog->w()) / 2;
+	int y = p->y() + (p->h() - _dialog->h()) / 2;
+	_dialog->position(x, y);
+	_filter->take_focus();
+	_dialog->show();
+	while (_dialog->shown()) { Fl::wait(); }
+	close();
+	return r;
+}
+
+void Map_Browser::filter_cb(OS_Input *i, Map_Browser *mb) {
+	mb->_grid->filter(i->value());
+}
+
+void Map_Browser::grid_cb(Thumbnail_Grid *tg, Map_Browser *mb) {
+	mb->update_open_button();
+	if (tg->opened()) { open_cb(tg, mb); }
+}
+
+void Map_Browser::open_cb(Fl_Widget *, Map_Browser *mb) {
+	size_t i = mb->_grid->selected();
+	if (i >= mb->_catalog.size()) { return; }
+	mb->_filename = mb->_catalog.map(i).blk_file;
+	mb->_canceled = false;
+	mb->_dialog->hide();
+}
+
+void Map_Browser::browse_cb(Fl_Widget *, Map_Browser *mb) {
+	mb->_browse = true;
+	mb->_canceled = false;
+	mb->_dialog->hide();
+}
+
+void Map_Browser::cancel_cb(Fl_Widget *, Map_Browser *mb) {
+	mb->_canceled = true;
+	mb->_dialog->hide();
+}
@@ -0,0 +1,102 @@
+#ifndef MAP_BROWSER_H
+#define MAP_BROWSER_H
+
+#include <string>
+#include <vector>
+
+#pragma warning(push, 0)
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Scrollbar.H>
+#pragma warning(pop)
+
+#include "colors.h"
+#include "widgets.h"
+#include "world-map.h"
+#include "world-renderer.h"
+
+// Thumbnails fit in a square this many pixels wide, with their map's name below
+#define THUMBNAIL_SIZE 96
+#define THUMBNAIL_CELL_W (THUMBNAIL_SIZE + 16)
+#define THUMBNAIL_CELL_H (THUMBNAIL_SIZE + 28)
+// Thumbnails are never rendered with more pixels per block than this
+#define MAX_THUMBNAIL_PPB 8
+
+// Draws a scrolling grid of every catalog entry that passes the filter,
+// requesting thumbnails only for the visible ones
+class Thumbnail_Grid : public Fl_Group {
+private:
+	const World_Map *_catalog;
+	World_Renderer *_renderer;
+	// Catalog indexes of the entries that pass the filter
+	std::vector<size_t> _items;
+	size_t _selected;
+	int _top;
+	bool _opened, _polling;
+	Fl_Scrollbar *_scrollbar;
+	std::vector<uchar> _scratch;
+public:
+	Thumbnail_Grid(int x, int y, int w, int h);
+	~Thumbnail_Grid();
+	void catalog(const World_Map *c, World_Renderer *r);
+	void filter(const char *text);
+	// The selected catalog index, or the catalog's size for none
+	size_t selected(void) const;
+	// Whether the last callback was for a double-click or Enter
+	inline bool opened(void) const { return _opened; }
+	int columns(void) const;
+	void resize(int x, int y, int w, int h);
+	void draw(void);
+	int handle(int event);
+	static int thumbnail_ppb(const World_Map_Entry &m);
+private:
+	int left(void) const;
+	size_t item_at(int ex, int ey) const;
+	void update_scrollbar(void);
+	void select(size_t item, bool open);
+	void scroll_to_selected(void);
+	bool move_selection(int key);
+	void draw_cell(size_t item, int cx, int cy, int gw, int gh);
+	static void scrollbar_cb(Fl_Scrollbar *sb, Thumbnail_Grid *tg);
+	static void poll_cb(Thumbnail_Grid *tg);
+};
+
+// Shows every map in a project's maps directory as a thumbnail, rendered in
+// the background and saved to disk so the next time they appear right away
+class Map_Browser {
+private:
+	int _width, _height;
+	bool _canceled, _browse;
+	Fl_Double_Window *_dialog;
+	Label *_heading;
+	OS_Input *_filter;
+	Thumbnail_Grid *_grid;
+	Fl_Group *_buttons;
+	Spacer *_spacer;
+	OS_Button *_browse_button, *_cancel_button;
+	Default_Button *_open_button;
+	World_Map _catalog;
+	World_Renderer _renderer;
+	std::string _filename;
+public:
+	Map_Browser(int w, int h);
+	~Map_Browser();
+	inline bool canceled(void) const { return _canceled; }
+	// Whether another map was asked for with the file chooser instead
+	inline bool browse(void) const { return _browse; }
+	inline const char *filename(void) const { return _filename.c_str(); }
+private:
+	void initialize(void);
+	void update_open_button(void);
+	void close(void);
+public:
+	World_Map::Result show(const Fl_Widget *p, const char *directory, Lighting l);
+private:
+	static void filter_cb(OS_Input *i, Map_Browser *mb);
+	static void grid_cb(Thumbnail_Grid *tg, Map_Browser *mb);
+	static void open_cb(Fl_Widget *w, Map_Browser *mb);
+	static void browse_cb(Fl_Widget *w, Map_Browser *mb);
+	static void cancel_cb(Fl_Widget *w, Map_Browser *mb);
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include "main-window.h"
 #include "block-window.h"
 #include "map-buttons.h"
+#include "perf.h"
 
 // 32x32 translucent red highlight for the event quadrant of a block
 static uchar event_cursor_png_buffer[96] = {
@@ -42,11 +43,10 @@ static void draw_selection_border(int x, int y, int rs, bool zoom) {
 	}
 }
 
-static void draw_map_button(Fl_Widget *wgt, uint8_t id, bool border) {
+static void draw_map_button_overlay(Fl_Widget *wgt, bool border) {
 	Main_Window *mw = (Main_Window *)wgt->user_data();
 	int x = wgt->x(), y = wgt->y();
 	int ms = mw->metatile_size();
-	mw->draw_metatile(x, y, id);
 	if (mw->grid()) {
 		fl_color(FL_INACTIVE_COLOR);
 		fl_xyline(x, y+ms-1, x+ms-1, y);
@@ -90,7 +90,8 @@ void Metatile_Button::id(uint8_t id) {
 
 void Metatile_Button::draw() {
 	Main_Window *mw = (Main_Window *)user_data();
-	draw_map_button(this, _id, !!value());
+	mw->draw_metatile(x(), y(), _id);
+	draw_map_button_overlay(this, !!value());
 	auto s = mw->metatile_hotkey(_id);
 	if (s == mw->no_hotkey()) { return; }
 	int key = s->second;
@@ -119,14 +120,20 @@ int Metatile_Button::handle(int event) {
 	}
 }
 
-Block::Block(int x, int y, int s, uint8_t row, uint8_t col, uint8_t id) : Fl_Box(x, y, s, s),
-	_row(row), _col(col), _id(id) {
+Block::Block(int x, int y, int s, uint16_t row, uint16_t col, uint8_t id) : Fl_Box(x, y, s, s),
+	_row(row), _col(col), _id(id), _quadrant(-1) {
 	user_data(NULL);
 	box(FL_NO_BOX);
 	labeltype(FL_NO_LABEL);
 	labelcolor(FL_YELLOW);
 }
 
+void Block::id(uint8_t id) {
+	// The map owns block IDs and calls this to keep the widget in sync
+	_id = id;
+	update_label();
+}
+
 void Block::update_label() {
 	Main_Window *mw = (Main_Window *)user_data();
 	char buffer[16];
@@ -137,14 +144,22 @@ void Block::update_label() {
 void Block::draw() {
 	Main_Window *mw = (Main_Window *)user_data();
 	bool below_mouse = Fl::belowmouse() == this, event_cursor = mw->event_cursor();
-	draw_map_button(this, _id, below_mouse && !event_cursor);
+	mw->draw_block(this);
+	draw_map_button_overlay(this, below_mouse && !event_cursor);
 	if (!below_mouse || !event_cursor) { return; }
+	int q = _quadrant == -1 ? quadrant() : _quadrant;
 	int hw = w() / 2, hh = h() / 2;
-	int hx = x() + right_half() * hw, hy = y() + bottom_half() * hh;
+	int hx = x() + (q & 1) * hw, hy = y() + (q >> 1) * hh;
 	event_cursor_png.draw(hx, hy, hw, hh);
 }
 
+void Block::damage_quadrant(int q) {
+	int hw = w() / 2, hh = h() / 2;
+	damage(FL_DAMAGE_USER1, x() + (q & 1) * hw, y() + (q >> 1) * hh, hw, hh);
+}
+
 int Block::handle(int event) {
+	Perf_Scope scope("Block::handle");
 	Main_Window *mw = (Main_Window *)user_data();
 	switch (event) {
 	case FL_ENTER:
@@ -152,16 +167,26 @@ int Block::handle(int event) {
 			Fl::pushed(this);
 			do_callback();
 		}
+		_quadrant = quadrant();
 		mw->update_status(this);
 		redraw();
 		return 1;
 	case FL_LEAVE:
+		_quadrant = -1;
 		mw->update_status(NULL);
 		redraw();
 		return 1;
 	case FL_MOVE:
-		mw->update_event_cursor(this);
-		redraw();
+		if (mw->event_cursor()) {
+			int q = quadrant();
+			if (q != _quadrant) {
+				// only the quadrants losing and gaining the cursor change
+				if (_quadrant != -1) { damage_quadrant(_quadrant); }
+				damage_quadrant(q);
+				_quadrant = q;
+				mw->update_event_cursor(this);
+			}
+		}
 		return 1;
 	case FL_PUSH:
 		mw->map_editable(true);
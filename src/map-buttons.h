@@ -24,20 +24,25 @@ public:
 
 class Block : public Fl_Box {
 private:
-	uint8_t _row, _col;
+	uint16_t _row, _col;
 	uint8_t _id;
+	// quadrant highlighted by the event cursor, or -1
+	int _quadrant;
 public:
-	Block(int x = 0, int y = 0, int s = 0, uint8_t row = 0, uint8_t col = 0, uint8_t id = 0);
-	inline uint8_t row(void) const { return _row; }
-	inline uint8_t col(void) const { return _col; }
-	inline void coords(uint8_t row, uint8_t col) { _row = row; _col = col; }
+	Block(int x = 0, int y = 0, int s = 0, uint16_t row = 0, uint16_t col = 0, uint8_t id = 0);
+	inline uint16_t row(void) const { return _row; }
+	inline uint16_t col(void) const { return _col; }
+	inline void coords(uint16_t row, uint16_t col) { _row = row; _col = col; }
 	inline uint8_t id(void) const { return _id; }
-	inline void id(uint8_t id) { _id = id; update_label(); }
+	void id(uint8_t id);
 	inline bool right_half(void) const { return Fl::event_x() >= x() + w() / 2; }
 	inline bool bottom_half(void) const { return Fl::event_y() >= y() + h() / 2; }
+	inline int quadrant(void) const { return (bottom_half() ? 2 : 0) + (right_half() ? 1 : 0); }
 	void update_label(void);
 	void draw(void);
 	int handle(int event);
+private:
+	void damage_quadrant(int q);
 };
 
 class Tile_Button : public Fl_Radio_Button {
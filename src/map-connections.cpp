@@ -0,0 +1,302 @@
+#include <cstring>
+
+#pragma warning(push, 0)
+#include <FL/fl_draw.H>
+#include <FL/filename.H>
+#pragma warning(pop)
+
+#include "config.h"
+#include "perf.h"
+#include "mapped-file.h"
+#include "tokenizer.h"
+#include "map-framebuffer.h"
+#include "map-connections.h"
+
+static bool parse_direction(const Token &t, Connection_Direction &d) {
+	if (t == "north") { d = NORTH_CONNECTION; }
+	else if (t == "south") { d = SOUTH_CONNECTION; }
+	else if (t == "west") { d = WEST_CONNECTION; }
+	else if (t == "east") { d = EAST_CONNECTION; }
+	else { return false; }
+	return true;
+}
+
+static bool parse_int(const Token &t, int &v) {
+	Token digits(t);
+	bool negative = !digits.empty() && digits[0] == '-';
+	if (negative) { digits.skip(1); }
+	unsigned int n;
+	if (!digits.to_uint(n)) { return false; }
+	v = negative ? -(int)n : (int)n;
+	return true;
+}
+
+static bool has_lowercase(const std::string &s) {
+	for (char c : s) {
+		if (c >= 'a' && c <= 'z') { return true; }
+	}
+	return false;
+}
+
+static bool read_metatileset(Metatileset &mt, const char *directory, const char *name, Lighting l) {
+	// The same files as Main_Window::read_metatile_data, without collisions or roofs
+	char buffer[FL_PATH_MAX] = {};
+	Tileset *tileset = mt.tileset();
+	tileset->name(name);
+	Config::palette_map_path(buffer, directory, name);
+	Palette_Map::Result rp = tileset->read_palette_map(buffer);
+	if (rp && rp != Palette_Map::Result::PALETTE_TOO_LONG) { return false; }
+	Config::tileset_path(buffer, directory, name);
+	if (tileset->read_graphics(buffer, l)) { return false; }
+	Config::metatileset_path(buffer, directory, name);
+	Metatileset::Result rm = mt.read_metatiles(buffer);
+	return rm == Metatileset::Result::META_OK || rm == Metatileset::Result::META_TOO_SHORT ||
+		rm == Metatileset::Result::META_TOO_LONG;
+}
+
+Map_Connections::Map_Connections() : _connections(), _tilesets(), _directory(), _strip(DEFAULT_CONNECTION_STRIP),
+	_ms(0), _map_width(0), _map_height(0) {}
+
+Map_Connections::~Map_Connections() {
+	clear_tilesets();
+}
+
+void Map_Connections::strip(int s) {
+	if (s != _strip) {
+		_strip = s;
+		invalidate();
+	}
+}
+
+int Map_Connections::margin(Connection_Direction d) const {
+	for (const Map_Connection &c : _connections) {
+		if (c.direction == d && c.metatileset) { return _strip; }
+	}
+	return 0;
+}
+
+void Map_Connections::clear() {
+	_connections.clear();
+	clear_tilesets();
+	_directory.clear();
+	_ms = 0;
+	_map_width = _map_height = 0;
+}
+
+void Map_Connections::clear_tilesets() {
+	for (auto &it : _tilesets) {
+		delete it.second;
+	}
+	_tilesets.clear();
+}
+
+size_t Map_Connections::read_connections(const char *directory, const char *map_name) {
+	_connections.clear();
+	if (_directory != directory) {
+		clear_tilesets();
+		_directory = directory;
+	}
+
+	char buffer[FL_PATH_MAX] = {};
+	if (!Config::map_attributes_path(buffer, directory, map_name)) { return 0; }
+	Mapped_File file(buffer);
+	if (!file.is_open()) { return 0; }
+	// The connections follow the map's map_attributes (pokecrystal) or map_header (pokered)
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, macro, field;
+	bool found = false;
+	while (tokenizer.next_line(line)) {
+		line.remove_comment();
+		if (!line.split_word(macro)) { continue; }
+		if (macro == "map_attributes" || macro == "map_header") {
+			if (found) { break; }
+			line.split(',', field);
+			field.trim();
+			found = field == map_name;
+			continue;
+		}
+		if (!found) { continue; }
+		if (macro == "end_map_header") { break; }
+		Map_Connection c = {};
+		if (macro == "connection" && parse_connection(line, c)) {
+			_connections.push_back(c);
+		}
+	}
+
+	read_dimensions();
+	size_t n = 0;
+	for (Map_Connection &c : _connections) {
+		if (c.width && c.height && read_blocks(c)) { _connections[n++] = c; }
+	}
+	_connections.resize(n);
+	return n;
+}
+
+bool Map_Connections::parse_connection(Token &line, Map_Connection &c) {
+	// connection direction, MapName, MAP_CONSTANT, offset
+	Token field;
+	if (!line.split(',', field)) { return false; }
+	field.trim();
+	if (!parse_direction(field, c.direction)) { return false; }
+	if (!line.split(',', field)) { return false; }
+	field.trim();
+	c.label = field.str();
+	if (!line.split(',', field)) { return false; }
+	field.trim();
+	c.constant = field.str();
+	if (!line.split(',', field)) { return false; }
+	field.trim();
+	if (!parse_int(field, c.offset)) { return false; }
+	// older versions put the constant first
+	if (!has_lowercase(c.label)) { c.label.swap(c.constant); }
+	return true;
+}
+
+bool Map_Connections::parse_map_constant(const Token &macro, Token &line, Token &constant, uint16_t &w, uint16_t &h) {
+	// "map_const": pokecrystal; "mapgroup": pokecrystal pre-2018; "mapconst": pokered
+	bool w_x_h = macro == "map_const";
+	if (!w_x_h && macro != "mapgroup" && macro != "mapconst") { return false; }
+	if (!line.split(',', constant)) { return false; }
+	constant.trim();
+	Token a, b;
+	unsigned int m, n;
+	if (!line.split(',', a) || !line.split(',', b)) { return false; }
+	a.trim();
+	b.trim();
+	if (!a.to_uint(m) || !b.to_uint(n) || !m || !n || m > MAX_MAP_SIZE || n > MAX_MAP_SIZE) { return false; }
+	w = (uint16_t)(w_x_h ? m : n);
+	h = (uint16_t)(w_x_h ? n : m);
+	return true;
+}
+
+void Map_Connections::read_dimensions() {
+	// Like Map_Options_Dialog::guess_map_size, but for every connection in one pass
+	char buffer[FL_PATH_MAX] = {};
+	Config::map_constants_path(buffer, _directory.c_str());
+	Mapped_File file(buffer);
+	if (!file.is_open()) { return; }
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, macro, constant;
+	uint16_t w, h;
+	while (tokenizer.next_line(line)) {
+		line.remove_comment();
+		if (!line.split_word(macro) || !parse_map_constant(macro, line, constant, w, h)) { continue; }
+		for (Map_Connection &c : _connections) {
+			if (constant == c.constant.c_str()) {
+				c.width = w;
+				c.height = h;
+			}
+		}
+	}
+}
+
+bool Map_Connections::read_blocks(Map_Connection &c) {
+	char buffer[FL_PATH_MAX] = {};
+	sprintf(buffer, "%s%s%s.blk", _directory.c_str(), Config::maps_dir(), c.label.c_str());
+	Mapped_File file(buffer);
+	size_t n = (size_t)c.width * c.height;
+	if (!file.is_open() || file.size() < n) { return false; }
+	c.ids.assign(file.data(), file.data() + n);
+	c.blk_file = buffer;
+	return true;
+}
+
+void Map_Connections::tileset(size_t i, const char *name, const Metatileset *current, Lighting l) {
+	// Neighbours that share the current map's tileset draw with it, so they
+	// cost no extra decoding and show its unsaved edits
+	Map_Connection &c = _connections[i];
+	c.rendered = false;
+	if (!*name || !strcmp(name, current->const_tileset()->name())) {
+		c.metatileset = current;
+		return;
+	}
+	auto it = _tilesets.find(name);
+	if (it == _tilesets.end()) {
+		Metatileset *mt = new Metatileset();
+		if (!read_metatileset(*mt, _directory.c_str(), name, l)) {
+			delete mt;
+			mt = NULL;
+		}
+		it = _tilesets.emplace(name, mt).first;
+	}
+	c.metatileset = it->second;
+}
+
+void Map_Connections::update_lighting(Lighting l) {
+	// The lighting's colors may have been edited or loaded, not just switched
+	for (auto &it : _tilesets) {
+		if (!it.second) { continue; }
+		Tileset *tileset = it.second->tileset();
+		tileset->invalidate_lighting();
+		tileset->update_lighting(l);
+	}
+	invalidate();
+}
+
+void Map_Connections::invalidate() {
+	for (Map_Connection &c : _connections) {
+		c.rendered = false;
+	}
+}
+
+void Map_Connections::render(uint16_t map_w, uint16_t map_h, int ms) {
+	if (ms != _ms || map_w != _map_width || map_h != _map_height) {
+		_ms = ms;
+		_map_width = map_w;
+		_map_height = map_h;
+		invalidate();
+	}
+	int w = map_w, h = map_h;
+	int left = margin(WEST_CONNECTION), top = margin(NORTH_CONNECTION);
+	int right = margin(EAST_CONNECTION), bottom = margin(SOUTH_CONNECTION);
+	for (Map_Connection &c : _connections) {
+		if (c.rendered || !c.metatileset) { continue; }
+		c.rendered = true;
+		// Place the connected map and keep the part of it inside the margin on its side
+		int nx = c.offset, ny = c.offset;
+		int bx0 = -left, by0 = -top, bx1 = w + right, by1 = h + bottom;
+		switch (c.direction) {
+		case NORTH_CONNECTION: ny = -(int)c.height; by1 = 0; break;
+		case SOUTH_CONNECTION: ny = h; by0 = h; break;
+		case WEST_CONNECTION: nx = -(int)c.width; bx1 = 0; break;
+		case EAST_CONNECTION: nx = w; bx0 = w; break;
+		}
+		c.x0 = MAX(nx, bx0);
+		c.y0 = MAX(ny, by0);
+		c.x1 = MIN(nx + (int)c.width, bx1);
+		c.y1 = MIN(ny + (int)c.height, by1);
+		if (c.x0 >= c.x1 || c.y0 >= c.y1) {
+			c.rgb.clear();
+			continue;
+		}
+		size_t lb = (size_t)(c.x1 - c.x0) * ms * NUM_CHANNELS;
+		c.rgb.resize(lb * (size_t)(c.y1 - c.y0) * ms);
+		for (int y = c.y0; y < c.y1; y++) {
+			for (int x = c.x0; x < c.x1; x++) {
+				uint8_t id = c.ids[(size_t)(y - ny) * c.width + (size_t)(x - nx)];
+				uchar *dst = c.rgb.data() + (size_t)(y - c.y0) * ms * lb + (size_t)(x - c.x0) * ms * NUM_CHANNELS;
+				Map_Framebuffer::render_block(dst, lb, ms, *c.metatileset, id);
+			}
+		}
+		// Dim the strip so it is not mistaken for part of the map
+		for (uchar &p : c.rgb) {
+			p = (uchar)(p - p / 4);
+		}
+	}
+}
+
+Connection_Preview::Connection_Preview(int x, int y, int w, int h) : Fl_Widget(x, y, w, h), _connections(NULL) {}
+
+void Connection_Preview::draw() {
+	if (!_connections || !_connections->ms()) { return; }
+	int ms = _connections->ms();
+	int ox = x() + _connections->margin(WEST_CONNECTION) * ms, oy = y() + _connections->margin(NORTH_CONNECTION) * ms;
+	for (size_t i = 0; i < _connections->size(); i++) {
+		const Map_Connection &c = _connections->connection(i);
+		if (c.rgb.empty()) { continue; }
+		int w = (c.x1 - c.x0) * ms, h = (c.y1 - c.y0) * ms;
+		fl_draw_image(c.rgb.data(), ox + c.x0 * ms, oy + c.y0 * ms, w, h, NUM_CHANNELS, w * NUM_CHANNELS);
+		Perf::count(Perf::DRAW_IMAGE_CALLS);
+		Perf::count(Perf::PIXELS_UPLOADED, w * h);
+	}
+}
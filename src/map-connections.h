@@ -0,0 +1,77 @@
+#ifndef MAP_CONNECTIONS_H
+#define MAP_CONNECTIONS_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#pragma warning(push, 0)
+#include <FL/Fl_Widget.H>
+#pragma warning(pop)
+
+#include "utils.h"
+#include "colors.h"
+#include "tokenizer.h"
+#include "metatileset.h"
+
+#define DEFAULT_CONNECTION_STRIP 3
+
+enum Connection_Direction { NORTH_CONNECTION, SOUTH_CONNECTION, WEST_CONNECTION, EAST_CONNECTION };
+
+struct Map_Connection {
+	Connection_Direction direction;
+	std::string label, constant, blk_file;
+	int offset;
+	uint16_t width, height;
+	std::vector<uint8_t> ids;
+	const Metatileset *metatileset;
+	// The visible strip, in blocks from the current map's top-left corner
+	int x0, y0, x1, y1;
+	std::vector<uchar> rgb;
+	bool rendered;
+};
+
+// The maps connected to the current one, rendered straight from their block
+// IDs as strips around its edges
+class Map_Connections {
+private:
+	std::vector<Map_Connection> _connections;
+	// Tilesets other than the current map's, each read once per project
+	std::unordered_map<std::string, Metatileset *> _tilesets;
+	std::string _directory;
+	int _strip, _ms;
+	uint16_t _map_width, _map_height;
+public:
+	Map_Connections(void);
+	~Map_Connections();
+	inline size_t size(void) const { return _connections.size(); }
+	inline const Map_Connection &connection(size_t i) const { return _connections[i]; }
+	inline int strip(void) const { return _strip; }
+	void strip(int s);
+	inline int ms(void) const { return _ms; }
+	int margin(Connection_Direction d) const;
+	void clear(void);
+	size_t read_connections(const char *directory, const char *map_name);
+	void tileset(size_t i, const char *name, const Metatileset *current, Lighting l);
+	void update_lighting(Lighting l);
+	void invalidate(void);
+	void render(uint16_t map_w, uint16_t map_h, int ms);
+	static bool parse_connection(Token &line, Map_Connection &c);
+	static bool parse_map_constant(const Token &macro, Token &line, Token &constant, uint16_t &w, uint16_t &h);
+private:
+	void clear_tilesets(void);
+	void read_dimensions(void);
+	bool read_blocks(Map_Connection &c);
+};
+
+// Draws the connected maps' strips behind the map, without any widgets for their blocks
+class Connection_Preview : public Fl_Widget {
+private:
+	const Map_Connections *_connections;
+public:
+	Connection_Preview(int x, int y, int w, int h);
+	inline void connections(const Map_Connections *c) { _connections = c; }
+	void draw(void);
+};
+
+#endif
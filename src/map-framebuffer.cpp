@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cstring>
+
+#include "tile.h"
+#include "perf.h"
+#include "map-framebuffer.h"
+
+static const uchar empty_rgb[NUM_CHANNELS] = {EMPTY_RGB};
+
+Map_Framebuffer::Map_Framebuffer() : _rgb(), _ids(), _col(0), _row(0), _cols(0), _rows(0), _ms(0), _dirty(false),
+	_overlay(NULL) {}
+
+void Map_Framebuffer::clear() {
+	_rgb.clear();
+	_rgb.shrink_to_fit();
+	_ids.clear();
+	_col = _row = _cols = _rows = _ms = 0;
+	_dirty = false;
+}
+
+void Map_Framebuffer::invalidate() {
+	std::fill(_ids.begin(), _ids.end(), -1);
+	_dirty = true;
+}
+
+void Map_Framebuffer::invalidate_metatile(uint8_t id) {
+	for (int &i : _ids) {
+		if (i == id) {
+			i = -1;
+			_dirty = true;
+		}
+	}
+}
+
+void Map_Framebuffer::overlay(const Collision_Overlay *o) {
+	if (o != _overlay) {
+		_overlay = o;
+		invalidate();
+	}
+}
+
+void Map_Framebuffer::cover(const Map &map, const Metatileset &mt, int col, int row, int cols, int rows, int ms) {
+	if (cols != _cols || rows != _rows || ms != _ms) {
+		_cols = cols;
+		_rows = rows;
+		_ms = ms;
+		_col = col;
+		_row = row;
+		_rgb.resize((size_t)rows * ms * line_bytes());
+		_ids.assign((size_t)cols * rows, -1);
+		_dirty = true;
+	}
+	else if (col != _col || row != _row) {
+		shift(col, row);
+	}
+	if (!_dirty) { return; }
+	// Render every block in the window that is not already rendered
+	int w = map.width(), h = map.height();
+	for (int r = MAX(_row, 0); r < MIN(_row + _rows, h); r++) {
+		for (int c = MAX(_col, 0); c < MIN(_col + _cols, w); c++) {
+			int &i = _ids[(r - _row) * _cols + (c - _col)];
+			if (i == -1) {
+				i = map.id((uint16_t)c, (uint16_t)r);
+				render(mt, c, r, (uint8_t)i);
+			}
+		}
+	}
+	_dirty = false;
+}
+
+const uchar *Map_Framebuffer::pixels(const Map &map, const Metatileset &mt, uint16_t col, uint16_t row) {
+	if (!inside(col, row)) { return NULL; }
+	int &i = _ids[(row - _row) * _cols + (col - _col)];
+	uint8_t id = map.id(col, row);
+	if (i != id) {
+		i = id;
+		render(mt, col, row, id);
+	}
+	else {
+		Perf::count(Perf::FRAMEBUFFER_HITS);
+	}
+	return cell(col, row);
+}
+
+void Map_Framebuffer::shift(int col, int row) {
+	int dc = col - _col, dr = row - _row;
+	if (abs(dc) >= _cols || abs(dr) >= _rows) {
+		_col = col;
+		_row = row;
+		invalidate();
+		return;
+	}
+	// Move the pixels of the blocks that stay in the window
+	size_t lb = (size_t)line_bytes(), cb = (size_t)_ms * NUM_CHANNELS;
+	size_t n = (size_t)(_cols - abs(dc)) * cb;
+	size_t src_x = (size_t)MAX(dc, 0) * cb, dst_x = (size_t)MAX(-dc, 0) * cb;
+	int lines = (_rows - abs(dr)) * _ms;
+	for (int k = 0; k < lines; k++) {
+		// copy in the direction that never overwrites unread lines
+		int y = dr >= 0 ? k : lines - 1 - k;
+		int src_y = y + MAX(dr, 0) * _ms, dst_y = y + MAX(-dr, 0) * _ms;
+		memmove(_rgb.data() + dst_y * lb + dst_x, _rgb.data() + src_y * lb + src_x, n);
+	}
+	std::vector<int> ids((size_t)_cols * _rows, -1);
+	for (int r = 0; r < _rows; r++) {
+		int old_r = r + dr;
+		if (old_r < 0 || old_r >= _rows) { continue; }
+		for (int c = 0; c < _cols; c++) {
+			int old_c = c + dc;
+			if (old_c < 0 || old_c >= _cols) { continue; }
+			ids[r * _cols + c] = _ids[old_r * _cols + old_c];
+		}
+	}
+	_ids.swap(ids);
+	_col = col;
+	_row = row;
+	_dirty = true;
+}
+
+void Map_Framebuffer::render(const Metatileset &mt, int col, int row, uint8_t id) {
+	Perf::count(Perf::FRAMEBUFFER_MISSES);
+	render_block(cell(col, row), (size_t)line_bytes(), _ms, mt, id, _overlay);
+}
+
+void Map_Framebuffer::render_block(uchar *dst, size_t lb, int ms, const Metatileset &mt, uint8_t id,
+	const Collision_Overlay *overlay) {
+	if (id >= mt.size()) {
+		for (int y = 0; y < ms; y++) {
+			uchar *line = dst + y * lb;
+			for (int x = 0; x < ms; x++) {
+				memcpy(line + x * NUM_CHANNELS, empty_rgb, NUM_CHANNELS);
+			}
+		}
+		return;
+	}
+	const Metatile *m = mt.const_metatile(id);
+	const Tileset *ts = mt.const_tileset();
+	// Tiles are cached at ZOOM_FACTOR, so unzoomed blocks take every other pixel
+	int s = ms / METATILE_SIZE, step = TILE_PX_SIZE / s;
+	for (int ty = 0; ty < METATILE_SIZE; ty++) {
+		for (int tx = 0; tx < METATILE_SIZE; tx++) {
+			const uchar *rgb = ts->const_tile_or_roof(m->tile_id(tx, ty))->rgb();
+			uchar *tile = dst + (size_t)ty * s * lb + (size_t)tx * s * NUM_CHANNELS;
+			for (int py = 0; py < s; py++) {
+				const uchar *src = rgb + py * step * LINE_BYTES;
+				uchar *line = tile + py * lb;
+				if (step == 1) {
+					memcpy(line, src, LINE_BYTES);
+					continue;
+				}
+				for (int px = 0; px < s; px++) {
+					memcpy(line + px * NUM_CHANNELS, src + px * step * NUM_CHANNELS, NUM_CHANNELS);
+				}
+			}
+		}
+	}
+	// Collisions are blended in here, so drawing them costs nothing per frame
+	if (overlay) {
+		overlay->composite(dst, lb, ms, m, mt.bin_collisions());
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef MAP_FRAMEBUFFER_H
+#define MAP_FRAMEBUFFER_H
+
+#include <vector>
+
+#pragma warning(push, 0)
+#include <FL/fl_types.h>
+#pragma warning(pop)
+
+#include "utils.h"
+#include "map.h"
+#include "metatileset.h"
+#include "collision-overlay.h"
+
+#define FRAMEBUFFER_MARGIN 2
+
+// RGB rendering of the visible part of the map plus a margin of blocks,
+// kept between redraws so scrolling only renders newly exposed blocks
+class Map_Framebuffer {
+private:
+	std::vector<uchar> _rgb;
+	// ID of the block rendered in each cell, or -1 if it needs rendering
+	std::vector<int> _ids;
+	int _col, _row, _cols, _rows, _ms;
+	bool _dirty;
+	const Collision_Overlay *_overlay;
+public:
+	Map_Framebuffer();
+	void clear(void);
+	void invalidate(void);
+	void invalidate_metatile(uint8_t id);
+	void overlay(const Collision_Overlay *o);
+	void cover(const Map &map, const Metatileset &mt, int col, int row, int cols, int rows, int ms);
+	const uchar *pixels(const Map &map, const Metatileset &mt, uint16_t col, uint16_t row);
+	inline int line_bytes(void) const { return _cols * _ms * NUM_CHANNELS; }
+	static void render_block(uchar *dst, size_t lb, int ms, const Metatileset &mt, uint8_t id,
+		const Collision_Overlay *overlay = NULL);
+private:
+	inline bool inside(int col, int row) const {
+		return col >= _col && col < _col + _cols && row >= _row && row < _row + _rows;
+	}
+	inline uchar *cell(int col, int row) {
+		return _rgb.data() + (size_t)(row - _row) * _ms * line_bytes() + (size_t)(col - _col) * _ms * NUM_CHANNELS;
+	}
+	void shift(int col, int row);
+	void render(const Metatileset &mt, int col, int row, uint8_t id);
+};
+
+#endif
@@ -1,5 +1,8 @@
 #include <cstdio>
+#include <cstring>
+#include <queue>
 
+#include "mapped-file.h"
 #include "map.h"
 
 void Map_Attributes::clear() {
@@ -9,27 +12,108 @@ void Map_Attributes::clear() {
 	palette.clear();
 }
 
-Map::Map() : _width(0), _height(0), _blocks(NULL), _result(MAP_NULL), _modified(false),
+Map::Map() : _width(0), _height(0), _chunk_cols(0), _chunks(), _change_cb(NULL), _change_data(NULL),
+	_result(MAP_NULL), _modified(false),
 	_history(MAX_HISTORY_SIZE), _future(MAX_HISTORY_SIZE) {}
 
 Map::~Map() {
 	clear();
 }
 
-void Map::size(uint8_t w, uint8_t h) {
+void Map::size(uint16_t w, uint16_t h) {
 	clear();
 	_width = w;
 	_height = h;
-	_blocks = new Block *[size()]();
+	_chunk_cols = ((size_t)w + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+	size_t chunk_rows = ((size_t)h + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+	_chunks.assign(_chunk_cols * chunk_rows, NULL);
 }
 
-void Map::block(uint8_t x, uint8_t y, Block *b) {
-	_blocks[(size_t)y * _width + (size_t)x] = b;
+void Map::resize(uint16_t w, uint16_t h, int px, int py) {
+	// Keep the IDs of the blocks that are still inside the map, offset by (px, py)
+	std::vector<uint8_t> data(size());
+	copy_ids(data.data());
+	int ow = _width, oh = _height;
+	Map_Attributes attributes = _attributes;
+	size(w, h);
+	_attributes = attributes;
+	int x0 = MAX(px, 0), y0 = MAX(py, 0), x1 = MIN((int)w, ow + px), y1 = MIN((int)h, oh + py);
+	for (int y = y0; y < y1; y++) {
+		for (int x = x0; x < x1; x++) {
+			uint8_t id = data[(size_t)(y - py) * ow + (size_t)(x - px)];
+			if (!id) { continue; }
+			Block_Chunk *c = chunk((uint16_t)x, (uint16_t)y);
+			if (!c) { c = new_chunk((uint16_t)x, (uint16_t)y); }
+			c->ids[chunk_index((uint16_t)x, (uint16_t)y)] = id;
+		}
+	}
+}
+
+Map::Block_Chunk *Map::new_chunk(uint16_t x, uint16_t y) {
+	Block_Chunk *&c = _chunks[(size_t)(y / MAP_CHUNK_SIZE) * _chunk_cols + (size_t)(x / MAP_CHUNK_SIZE)];
+	if (!c) { c = new Block_Chunk(); }
+	return c;
+}
+
+void Map::chunk_bounds(size_t k, size_t &x0, size_t &y0, size_t &cw, size_t &ch) const {
+	x0 = k % _chunk_cols * MAP_CHUNK_SIZE;
+	y0 = k / _chunk_cols * MAP_CHUNK_SIZE;
+	cw = MIN((size_t)MAP_CHUNK_SIZE, _width - x0);
+	ch = MIN((size_t)MAP_CHUNK_SIZE, _height - y0);
+}
+
+void Map::id(uint16_t x, uint16_t y, uint8_t id) {
+	Block_Chunk *c = chunk(x, y);
+	if (!c) {
+		if (!id) { return; } // still the default ID
+		c = new_chunk(x, y);
+	}
+	size_t j = chunk_index(x, y);
+	uint8_t from = c->ids[j];
+	if (from == id) { return; }
+	c->ids[j] = id;
+	if (c->blocks[j]) { c->blocks[j]->id(id); }
+	if (_change_cb) { _change_cb(x, y, from, id, _change_data); }
+}
+
+void Map::copy_ids(uint8_t *data) const {
+	for (size_t k = 0; k < _chunks.size(); k++) {
+		size_t x0, y0, cw, ch;
+		chunk_bounds(k, x0, y0, cw, ch);
+		const Block_Chunk *c = _chunks[k];
+		for (size_t dy = 0; dy < ch; dy++) {
+			uint8_t *row = data + (y0 + dy) * _width + x0;
+			if (c) { memcpy(row, c->ids + dy * MAP_CHUNK_SIZE, cw); }
+			else { memset(row, 0, cw); }
+		}
+	}
+}
+
+void Map::chunk_ids(size_t k, const uint8_t *ids) {
+	// Changes go through id() so that widgets and the change callback see them
+	size_t x0, y0, cw, ch;
+	chunk_bounds(k, x0, y0, cw, ch);
+	for (size_t dy = 0; dy < ch; dy++) {
+		for (size_t dx = 0; dx < cw; dx++) {
+			size_t j = dy * MAP_CHUNK_SIZE + dx;
+			const Block_Chunk *c = _chunks[k];
+			if ((c ? c->ids[j] : 0) != ids[j]) {
+				id((uint16_t)(x0 + dx), (uint16_t)(y0 + dy), ids[j]);
+			}
+		}
+	}
+}
+
+void Map::block(uint16_t x, uint16_t y, Block *b) {
+	new_chunk(x, y)->blocks[chunk_index(x, y)] = b;
 }
 
 void Map::clear() {
-	delete [] _blocks;
-	_blocks = NULL;
+	for (Block_Chunk *c : _chunks) {
+		delete c;
+	}
+	_chunks.clear();
+	_chunk_cols = 0;
 	_attributes.clear();
 	_width = _height = 0;
 	_result = MAP_NULL;
@@ -38,75 +122,129 @@ void Map::clear() {
 	_future.clear();
 }
 
+Map::Map_State Map::snapshot(const Map_State *prev) const {
+	Map_State ms;
+	ms.chunks.resize(_chunks.size());
+	bool share = prev && prev->chunks.size() == _chunks.size();
+	Id_Chunk ic;
+	for (size_t k = 0; k < _chunks.size(); k++) {
+		const Block_Chunk *c = _chunks[k];
+		if (!c) { continue; }
+		// reuse the previous state's copy of any chunk that has not changed
+		const std::shared_ptr<const Id_Chunk> *pc = share ? &prev->chunks[k] : NULL;
+		if (pc && *pc && !memcmp((*pc)->ids, c->ids, MAP_CHUNK_AREA)) {
+			ms.chunks[k] = *pc;
+		}
+		else {
+			memcpy(ic.ids, c->ids, MAP_CHUNK_AREA);
+			ms.chunks[k] = std::make_shared<const Id_Chunk>(ic);
+		}
+	}
+	return ms;
+}
+
+void Map::restore(const Map_State &ms) {
+	static const Id_Chunk default_chunk = {};
+	for (size_t k = 0; k < _chunks.size() && k < ms.chunks.size(); k++) {
+		const Id_Chunk *ic = ms.chunks[k].get();
+		if (!_chunks[k] && !ic) { continue; }
+		chunk_ids(k, ic ? ic->ids : default_chunk.ids);
+	}
+}
+
 void Map::remember() {
 	_future.clear();
 	while (_history.size() >= MAX_HISTORY_SIZE) { _history.pop_front(); }
-
-	Map_State ms(size());
-	for (size_t i = 0; i < size(); i++) {
-		ms.ids[i] = block(i)->id();
-	}
-	_history.push_back(ms);
+	_history.push_back(snapshot(_history.empty() ? NULL : &_history.back()));
 }
 
 void Map::undo() {
 	if (_history.empty()) { return; }
 	while (_future.size() >= MAX_HISTORY_SIZE) { _future.pop_front(); }
-
-	Map_State ms(size());
-	for (size_t i = 0; i < size(); i++) {
-		ms.ids[i] = block(i)->id();
-	}
-	_future.push_back(ms);
-
-	const Map_State &prev = _history.back();
-	for (size_t i = 0; i < size(); i++) {
-		block(i)->id(prev.ids[i]);
-	}
+	_future.push_back(snapshot(&_history.back()));
+	restore(_history.back());
 	_history.pop_back();
 }
 
 void Map::redo() {
 	if (_future.empty()) { return; }
 	while (_history.size() >= MAX_HISTORY_SIZE) { _history.pop_front(); }
+	_history.push_back(snapshot(&_future.back()));
+	restore(_future.back());
+	_future.pop_back();
+}
 
-	Map_State ms(size());
-	for (size_t i = 0; i < size(); i++) {
-		ms.ids[i] = block(i)->id();
+void Map::remap_blocks(const uint8_t *remap) {
+	uint8_t ids[MAP_CHUNK_AREA];
+	for (size_t k = 0; k < _chunks.size(); k++) {
+		const Block_Chunk *c = _chunks[k];
+		if (!c && !remap[0]) { continue; } // still the default ID
+		for (size_t j = 0; j < MAP_CHUNK_AREA; j++) {
+			ids[j] = remap[c ? c->ids[j] : 0];
+		}
+		chunk_ids(k, ids);
 	}
-	_history.push_back(ms);
+	// Past states may use blocks that were merged or removed, which have no new ID
+	_history.clear();
+	_future.clear();
+}
 
-	const Map_State &next = _future.back();
-	for (size_t i = 0; i < size(); i++) {
-		block(i)->id(next.ids[i]);
+bool Map::write_blocks(const char *f) const {
+	std::vector<uint8_t> data(size());
+	copy_ids(data.data());
+	return write_file_atomic(f, data.data(), data.size());
+}
+
+void Map::flood_fill(uint16_t x, uint16_t y, uint8_t t) {
+	uint8_t f = id(x, y);
+	if (f == t) { return; }
+	std::queue<std::pair<uint16_t, uint16_t>> queue;
+	queue.push(std::make_pair(x, y));
+	while (!queue.empty()) {
+		uint16_t col = queue.front().first, row = queue.front().second;
+		queue.pop();
+		if (id(col, row) != f) { continue; }
+		id(col, row, t); // fill
+		if (col > 0) { queue.push(std::make_pair((uint16_t)(col - 1), row)); } // left
+		if (col < _width - 1) { queue.push(std::make_pair((uint16_t)(col + 1), row)); } // right
+		if (row > 0) { queue.push(std::make_pair(col, (uint16_t)(row - 1))); } // up
+		if (row < _height - 1) { queue.push(std::make_pair(col, (uint16_t)(row + 1))); } // down
 	}
-	_future.pop_back();
 }
 
 Map::Result Map::read_blocks(const char *f) {
-	bool too_long = false;
-
-	FILE *file = fl_fopen(f, "rb");
-	if (file == NULL) { return (_result = MAP_BAD_FILE); } // cannot load file
-
-	uint8_t *data = new uint8_t[size() + 1];
-	size_t c = fread(data, 1, size() + 1, file);
-	fclose(file);
-	if (c < size()) { delete [] data; return (_result = MAP_TOO_SHORT); } // too-short blk
-	if (c == size() + 1) { too_long = true; }
-
-	for (uint8_t y = 0; y < (size_t)_height; y++) {
-		for (uint8_t x = 0; x < (size_t)_width; x++) {
-			size_t i = (size_t)y * _width + (size_t)x;
-			uint8_t id = data[i];
-			_blocks[i] = new Block(0, 0, 0, y, x, id);
+	Mapped_File file(f);
+	if (!file.is_open()) { return (_result = MAP_BAD_FILE); } // cannot load file
+	if (file.size() < size()) { return (_result = MAP_TOO_SHORT); } // too-short blk
+	bool too_long = file.size() > size();
+
+	// Only chunks with a non-default ID are allocated
+	const uint8_t *data = file.data();
+	for (size_t k = 0; k < _chunks.size(); k++) {
+		size_t x0, y0, cw, ch;
+		chunk_bounds(k, x0, y0, cw, ch);
+		Block_Chunk *c = _chunks[k];
+		for (size_t dy = 0; dy < ch; dy++) {
+			const uint8_t *row = data + (y0 + dy) * _width + x0;
+			if (!c) {
+				size_t dx = 0;
+				while (dx < cw && !row[dx]) { dx++; }
+				if (dx == cw) { continue; }
+				c = new_chunk((uint16_t)x0, (uint16_t)y0);
+			}
+			memcpy(c->ids + dy * MAP_CHUNK_SIZE, row, cw);
 		}
 	}
 
-	delete [] data;
 	return (_result = too_long ? MAP_TOO_LONG : MAP_OK);
 }
 
+static const char *too_large_message() {
+	static char buffer[64] = {};
+	sprintf(buffer, "Maps can have at most %u blocks.", (uint32_t)MAX_MAP_AREA);
+	return buffer;
+}
+
 const char *Map::error_message(Result result) {
 	switch (result) {
 	case MAP_OK:
@@ -117,6 +255,8 @@ const char *Map::error_message(Result result) {
 		return "File ends too early.";
 	case MAP_TOO_LONG:
 		return "The .blk file is larger than the specified size.";
+	case MAP_TOO_LARGE:
+		return too_large_message();
 	case MAP_NULL:
 		return "No *.blk file chosen.";
 	default:
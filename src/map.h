@@ -2,6 +2,7 @@
 #define MAP_H
 
 #include <deque>
+#include <memory>
 #include <vector>
 
 #include "utils.h"
@@ -9,6 +10,16 @@
 
 #define MAX_HISTORY_SIZE 100
 
+#define MAX_MAP_SIZE 0xFFFF
+// The dependency index still tracks every cell, so the total area is
+// limited well below MAX_MAP_SIZE * MAX_MAP_SIZE
+#define MAX_MAP_AREA (1024 * 1024)
+
+// Block IDs are stored in square chunks, so large maps need no single huge
+// allocation and undo states can share the chunks an edit did not touch
+#define MAP_CHUNK_SIZE 32
+#define MAP_CHUNK_AREA (MAP_CHUNK_SIZE * MAP_CHUNK_SIZE)
+
 struct Map_Attributes {
 public:
 	uint8_t group;
@@ -21,25 +32,38 @@ public:
 
 class Map {
 protected:
+	struct Id_Chunk {
+		uint8_t ids[MAP_CHUNK_AREA];
+	};
 	struct Map_State {
-		std::vector<uint8_t> ids;
-		Map_State() : ids() {}
-		Map_State(size_t n) : ids(n) {}
+		// NULL for chunks without any blocks
+		std::vector<std::shared_ptr<const Id_Chunk>> chunks;
+	};
+	struct Block_Chunk {
+		uint8_t ids[MAP_CHUNK_AREA];
+		// NULL for blocks without a widget yet
+		Block *blocks[MAP_CHUNK_AREA];
 	};
 public:
-	enum Result { MAP_OK, MAP_BAD_FILE, MAP_TOO_SHORT, MAP_TOO_LONG, MAP_NULL };
+	enum Result { MAP_OK, MAP_BAD_FILE, MAP_TOO_SHORT, MAP_TOO_LONG, MAP_TOO_LARGE, MAP_NULL };
+	typedef void (*Change_Callback)(uint16_t x, uint16_t y, uint8_t from, uint8_t to, void *data);
 private:
 	Map_Attributes _attributes;
-	uint8_t _width, _height;
-	Block **_blocks;
+	uint16_t _width, _height;
+	size_t _chunk_cols;
+	// Chunks are allocated when a block first gets a non-default ID or a widget;
+	// blocks in NULL chunks have the default ID
+	std::vector<Block_Chunk *> _chunks;
+	Change_Callback _change_cb;
+	void *_change_data;
 	Result _result;
 	bool _modified;
 	std::deque<Map_State> _history, _future;
 public:
 	Map();
 	~Map();
-	inline uint8_t width(void) const { return _width; }
-	inline uint8_t height(void) const { return _height; }
+	inline uint16_t width(void) const { return _width; }
+	inline uint16_t height(void) const { return _height; }
 	inline Map_Attributes attributes(void) const { return _attributes; }
 	void attributes(Map_Attributes a) { _attributes = a; }
 	inline uint8_t group(void) const { return _attributes.group; }
@@ -54,11 +78,25 @@ public:
 		return _attributes.environment == "TOWN" || _attributes.environment == "ROUTE" ||
 			_attributes.environment == "1" || _attributes.environment == "2"; // TPP:AC uses numbers
 	}
-	void size(uint8_t w, uint8_t h);
+	void size(uint16_t w, uint16_t h);
 	inline size_t size(void) const { return (size_t)_width * (size_t)_height; }
-	inline Block *block(uint8_t x, uint8_t y) const { return _blocks[(size_t)y * _width + (size_t)x]; }
-	inline Block *block(size_t i) const { return _blocks[i]; }
-	void block(uint8_t x, uint8_t y, Block *b);
+	void resize(uint16_t w, uint16_t h, int px, int py);
+	inline uint8_t id(uint16_t x, uint16_t y) const {
+		const Block_Chunk *c = chunk(x, y);
+		return c ? c->ids[chunk_index(x, y)] : 0;
+	}
+	void id(uint16_t x, uint16_t y, uint8_t id);
+	// cells are indexed by y * width + x, as in the dependency index
+	inline uint8_t cell_id(size_t i) const { return id((uint16_t)(i % _width), (uint16_t)(i / _width)); }
+	inline void cell_id(size_t i, uint8_t v) { id((uint16_t)(i % _width), (uint16_t)(i / _width), v); }
+	void copy_ids(uint8_t *data) const;
+	inline Block *block(uint16_t x, uint16_t y) const {
+		const Block_Chunk *c = chunk(x, y);
+		return c ? c->blocks[chunk_index(x, y)] : NULL;
+	}
+	inline Block *block(size_t i) const { return block((uint16_t)(i % _width), (uint16_t)(i / _width)); }
+	void block(uint16_t x, uint16_t y, Block *b);
+	inline void change_callback(Change_Callback cb, void *data) { _change_cb = cb; _change_data = data; }
 	inline Result result(void) const { return _result; }
 	inline bool modified(void) const { return _modified; }
 	inline void modified(bool m) { _modified = m; }
@@ -68,7 +106,22 @@ public:
 	void remember(void);
 	void undo(void);
 	void redo(void);
+	void remap_blocks(const uint8_t *remap);
+	void flood_fill(uint16_t x, uint16_t y, uint8_t t);
 	Result read_blocks(const char *f);
+	bool write_blocks(const char *f) const;
+private:
+	inline Block_Chunk *chunk(uint16_t x, uint16_t y) const {
+		return _chunks[(size_t)(y / MAP_CHUNK_SIZE) * _chunk_cols + (size_t)(x / MAP_CHUNK_SIZE)];
+	}
+	inline static size_t chunk_index(uint16_t x, uint16_t y) {
+		return (size_t)(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + (size_t)(x % MAP_CHUNK_SIZE);
+	}
+	Block_Chunk *new_chunk(uint16_t x, uint16_t y);
+	void chunk_bounds(size_t k, size_t &x0, size_t &y0, size_t &cw, size_t &ch) const;
+	void chunk_ids(size_t k, const uint8_t *ids);
+	Map_State snapshot(const Map_State *prev) const;
+	void restore(const Map_State &ms);
 public:
 	static const char *error_message(Result result);
 };
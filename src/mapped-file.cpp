@@ -0,0 +1,66 @@
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#pragma warning(push, 0)
+#include <FL/filename.H>
+#include <FL/fl_utf8.h>
+#pragma warning(pop)
+
+#include "mapped-file.h"
+
+#ifdef _WIN32
+
+Mapped_File::Mapped_File(const char *f) : _data(NULL), _size(0), _open(false) {
+	wchar_t wf[FL_PATH_MAX] = {};
+	fl_utf8towc(f, (unsigned int)strlen(f), wf, FL_PATH_MAX);
+	HANDLE file = CreateFileW(wf, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return; }
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) { CloseHandle(file); return; }
+	_size = (size_t)size.QuadPart;
+	_open = true;
+	if (!_size) { CloseHandle(file); return; } // empty files cannot be mapped
+	// The view keeps the file mapped after both handles are closed
+	HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping) {
+		_data = (const uchar *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	if (!_data) { _size = 0; _open = false; }
+}
+
+Mapped_File::~Mapped_File() {
+	if (_data) { UnmapViewOfFile(_data); }
+}
+
+#else
+
+Mapped_File::Mapped_File(const char *f) : _data(NULL), _size(0), _open(false) {
+	int fd = fl_open(f, O_RDONLY);
+	if (fd == -1) { return; }
+	struct stat s;
+	if (fstat(fd, &s)) { close(fd); return; }
+	_size = (size_t)s.st_size;
+	_open = true;
+	if (!_size) { close(fd); return; } // empty files cannot be mapped
+	// The mapping stays valid after the descriptor is closed
+	void *p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) { _size = 0; _open = false; return; }
+	_data = (const uchar *)p;
+}
+
+Mapped_File::~Mapped_File() {
+	if (_data) { munmap(const_cast<uchar *>(_data), _size); }
+}
+
+#endif
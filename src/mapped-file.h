@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#pragma warning(push, 0)
+#include <FL/fl_types.h>
+#pragma warning(pop)
+
+#include "utils.h"
+
+// Read-only view of a whole file, mapped into memory so it can be decoded
+// without first copying it into a buffer
+class Mapped_File {
+private:
+	const uchar *_data;
+	size_t _size;
+	bool _open;
+public:
+	Mapped_File(const char *f);
+	~Mapped_File();
+	inline bool is_open(void) const { return _open; }
+	inline const uchar *data(void) const { return _data; }
+	inline size_t size(void) const { return _size; }
+};
+
+#endif
@@ -10,7 +10,7 @@ void Metatile::clear() {
 		}
 	}
 	for (int i = 0; i < NUM_QUADRANTS; i++) {
-		_collisions[i].clear();
+		_collisions[i] = 0;
 		_bin_collisions[i] = 0;
 	}
 }
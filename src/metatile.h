@@ -1,7 +1,7 @@
 #ifndef METATILE_H
 #define METATILE_H
 
-#include <string>
+#include <cstring>
 
 #pragma warning(push, 0)
 #include <FL/fl_types.h>
@@ -19,7 +19,7 @@ class Metatile {
 private:
 	uint8_t _id;
 	uint8_t _tile_ids[METATILE_SIZE][METATILE_SIZE];
-	std::string _collisions[NUM_QUADRANTS];
+	uint16_t _collisions[NUM_QUADRANTS];
 	uint8_t _bin_collisions[NUM_QUADRANTS];
 public:
 	Metatile(uint8_t id);
@@ -27,11 +27,14 @@ public:
 	inline void id(uint8_t id) { _id = id; }
 	inline uint8_t tile_id(int x, int y) const { return _tile_ids[y][x]; }
 	inline void tile_id(int x, int y, uint8_t id) { _tile_ids[y][x] = id; }
-	std::string collision(Quadrant q) const { return _collisions[q]; }
-	void collision(Quadrant q, std::string c) { _collisions[q] = c; }
+	inline const uint8_t *tile_ids(void) const { return &_tile_ids[0][0]; }
+	inline void tile_ids(const uint8_t *ids) { memcpy(_tile_ids, ids, sizeof(_tile_ids)); }
+	uint16_t collision(Quadrant q) const { return _collisions[q]; }
+	void collision(Quadrant q, uint16_t c) { _collisions[q] = c; }
 	uint8_t bin_collision(Quadrant q) const { return _bin_collisions[q]; }
 	const uint8_t *bin_collisions(void) const { return _bin_collisions; }
 	void bin_collision(Quadrant q, uint8_t c) { _bin_collisions[q] = c; }
+	void bin_collisions(const uint8_t *c) { memcpy(_bin_collisions, c, sizeof(_bin_collisions)); }
 	void clear(void);
 	void copy(const Metatile *src);
 	void swap(Metatile *mt);
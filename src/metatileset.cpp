@@ -1,14 +1,16 @@
 #include <cstdio>
-#include <fstream>
-#include <sstream>
+#include <unordered_map>
 
 #pragma warning(push, 0)
 #include <FL/fl_draw.H>
 #pragma warning(pop)
 
+#include "parallel.h"
+#include "mapped-file.h"
+#include "tokenizer.h"
 #include "metatileset.h"
 
-Metatileset::Metatileset() : _tileset(), _metatiles(), _num_metatiles(0), _result(META_NULL), _modified(false),
+Metatileset::Metatileset() : _tileset(), _metatiles(), _collision_names(), _num_metatiles(0), _result(META_NULL), _modified(false),
 	_bin_collisions(false) {
 	for (size_t i = 0; i < MAX_NUM_METATILES; i++) {
 		_metatiles[i] = new Metatile((uint8_t)i);
@@ -27,6 +29,7 @@ void Metatileset::clear() {
 	for (size_t i = 0; i < MAX_NUM_METATILES; i++) {
 		_metatiles[i]->clear();
 	}
+	_collision_names.clear();
 	_num_metatiles = 0;
 	_result = META_NULL;
 	_modified = false;
@@ -63,98 +66,153 @@ void Metatileset::draw_metatile(int x, int y, uint8_t id, bool zoom, bool show_p
 	}
 }
 
-uchar *Metatileset::print_rgb(const Map &map) const {
-	int w = map.width(), h = map.height();
-	int bw = w * METATILE_SIZE * TILE_SIZE, bh = h * METATILE_SIZE * TILE_SIZE;
-	uchar *buffer = new uchar[bw * bh * NUM_CHANNELS]();
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			Block *b = map.block((uint8_t)x, (uint8_t)y);
-			const Metatile *m = _metatiles[b->id()];
-			for (int ty = 0; ty < METATILE_SIZE; ty++) {
-				for (int tx = 0; tx < METATILE_SIZE; tx++) {
-					uint8_t tid = m->tile_id(tx, ty);
-					const Tile *t = _tileset.const_tile_or_roof(tid);
-					size_t o = ((y * METATILE_SIZE + ty) * bw + x * METATILE_SIZE + tx) * TILE_SIZE * NUM_CHANNELS;
-					for (int py = 0; py < TILE_SIZE; py++) {
-						for (int px = 0; px < TILE_SIZE; px++) {
-							const uchar *rgb = t->const_pixel(px, py);
-							size_t j = o + (py * bw + px) * NUM_CHANNELS;
-							buffer[j++] = rgb[0];
-							buffer[j++] = rgb[1];
-							buffer[j] = rgb[2];
-						}
+void Metatileset::draw_metatile_priority(int x, int y, uint8_t id, bool zoom) const {
+	if (id >= size()) { return; }
+	Metatile *mt = _metatiles[id];
+	int s = TILE_SIZE * (zoom ? ZOOM_FACTOR : 1);
+	for (int ty = 0; ty < METATILE_SIZE; ty++) {
+		for (int tx = 0; tx < METATILE_SIZE; tx++) {
+			const Tile *t = _tileset.const_tile_or_roof(mt->tile_id(tx, ty));
+			t->draw_priority(x + tx * s, y + ty * s, s);
+		}
+	}
+}
+
+struct Print_Job {
+	const Metatileset *metatileset;
+	const Map *map;
+	uchar *buffer;
+};
+
+void Metatileset::print_row(size_t y, void *data) {
+	// each job writes only the pixels of its own row of blocks
+	Print_Job *job = (Print_Job *)data;
+	const Metatileset *ms = job->metatileset;
+	size_t w = job->map->width();
+	size_t bw = w * METATILE_SIZE * TILE_SIZE;
+	for (size_t x = 0; x < w; x++) {
+		const Metatile *m = ms->_metatiles[job->map->id((uint16_t)x, (uint16_t)y)];
+		for (int ty = 0; ty < METATILE_SIZE; ty++) {
+			for (int tx = 0; tx < METATILE_SIZE; tx++) {
+				uint8_t tid = m->tile_id(tx, ty);
+				const Tile *t = ms->_tileset.const_tile_or_roof(tid);
+				uchar slot = (uchar)(((int)t->palette() & 0xf) * NUM_HUES);
+				size_t o = ((y * METATILE_SIZE + ty) * bw + x * METATILE_SIZE + tx) * TILE_SIZE;
+				for (int py = 0; py < TILE_SIZE; py++) {
+					for (int px = 0; px < TILE_SIZE; px++) {
+						job->buffer[o + py * bw + px] = slot + (uchar)t->hue(px, py);
 					}
 				}
 			}
 		}
 	}
-	return buffer;
 }
 
-Metatileset::Result Metatileset::read_metatiles(const char *f) {
-	if (!_tileset.num_tiles()) { return (_result = META_NO_GFX); } // no graphics
-
-	FILE *file = fl_fopen(f, "rb");
-	if (file == NULL) { return (_result = META_BAD_FILE); } // cannot load file
+uchar *Metatileset::print_indexed(const Map &map) const {
+	// one (palette, hue) slot per byte; see Image::write_map_image
+	size_t w = map.width(), h = map.height();
+	size_t bw = w * METATILE_SIZE * TILE_SIZE, bh = h * METATILE_SIZE * TILE_SIZE;
+	uchar *buffer = new uchar[bw * bh]();
+	Print_Job job = {this, &map, buffer};
+	parallel_for(h, print_row, &job);
+	return buffer;
+}
 
-	uchar data[METATILE_SIZE * METATILE_SIZE] = {};
-	while (!feof(file)) {
-		size_t c = fread(data, 1, METATILE_SIZE * METATILE_SIZE, file);
-		if (!c) { break; } // end of file
-		if (c < METATILE_SIZE * METATILE_SIZE) { fclose(file); return (_result = META_TOO_SHORT); }
-		if (_num_metatiles == MAX_NUM_METATILES) { fclose(file); return (_result = META_TOO_LONG); }
-		Metatile *mt = _metatiles[_num_metatiles++];
+size_t Metatileset::compaction(const bool *used, uint8_t *remap) const {
+	// remap used blocks to new IDs, merging identical ones; return the new size
+	std::unordered_map<std::string, uint8_t> unique;
+	size_t n = 0;
+	for (size_t i = 0; i < MAX_NUM_METATILES; i++) {
+		remap[i] = (uint8_t)i;
+		if (i >= _num_metatiles || !used[i]) { continue; }
+		const Metatile *mt = _metatiles[i];
+		std::string key;
 		for (int y = 0; y < METATILE_SIZE; y++) {
 			for (int x = 0; x < METATILE_SIZE; x++) {
-				mt->tile_id(x, y, data[y * METATILE_SIZE + x]);
+				key += (char)mt->tile_id(x, y);
 			}
 		}
+		for (int q = 0; q < NUM_QUADRANTS; q++) {
+			uint16_t c = mt->collision((Quadrant)q);
+			key += (char)mt->bin_collision((Quadrant)q);
+			key += (char)(c >> 8);
+			key += (char)c;
+		}
+		auto it = unique.find(key);
+		if (it != unique.end()) {
+			remap[i] = it->second;
+			continue;
+		}
+		unique[key] = (uint8_t)n;
+		remap[i] = (uint8_t)n++;
 	}
+	return n;
+}
 
-	fclose(file);
+void Metatileset::compact(const bool *used, const uint8_t *remap) {
+	// first occurrences get consecutive new IDs, so they can be moved down in place
+	size_t n = 0;
+	for (size_t i = 0; i < _num_metatiles; i++) {
+		if (!used[i] || remap[i] != n) { continue; }
+		if (i != n) { _metatiles[n]->copy(_metatiles[i]); }
+		n++;
+	}
+	size(n);
+}
+
+Metatileset::Result Metatileset::read_metatiles(const char *f) {
+	if (!_tileset.num_tiles()) { return (_result = META_NO_GFX); } // no graphics
+
+	Mapped_File file(f);
+	if (!file.is_open()) { return (_result = META_BAD_FILE); } // cannot load file
+
+	const size_t mt_size = METATILE_SIZE * METATILE_SIZE;
+	size_t n = file.size() / mt_size;
+	for (size_t i = 0; i < n && _num_metatiles < MAX_NUM_METATILES; i++) {
+		_metatiles[_num_metatiles++]->tile_ids(file.data() + i * mt_size);
+	}
+	if (n > MAX_NUM_METATILES) { return (_result = META_TOO_LONG); }
+	if (file.size() % mt_size) { return (_result = META_TOO_SHORT); }
 	return (_result = META_OK);
 }
 
-bool Metatileset::write_metatiles(const char *f) {
-	FILE *file = fl_fopen(f, "wb");
-	if (!file) { return false; }
+void Metatileset::print_metatiles(std::vector<uint8_t> &data) const {
+	const size_t mt_size = METATILE_SIZE * METATILE_SIZE;
+	data.resize(_num_metatiles * mt_size);
 	for (size_t i = 0; i < _num_metatiles; i++) {
-		Metatile *mt = _metatiles[i];
-		for (int y = 0; y < METATILE_SIZE; y++) {
-			for (int x = 0; x < METATILE_SIZE; x++) {
-				uint8_t id = mt->tile_id(x, y);
-				fputc(id, file);
-			}
-		}
+		memcpy(data.data() + i * mt_size, _metatiles[i]->tile_ids(), mt_size);
 	}
-	fclose(file);
-	return true;
+}
+
+bool Metatileset::write_metatiles(const char *f) const {
+	std::vector<uint8_t> data;
+	print_metatiles(data);
+	return write_file_atomic(f, data.data(), data.size());
 }
 
 Metatileset::Result Metatileset::read_asm_collisions(const char *f) {
 	if (!_tileset.num_tiles()) { return (_result = META_NO_GFX); } // no graphics
 
-	std::ifstream ifs(f);
-	if (!ifs.is_open()) { return (_result = META_BAD_FILE); } // cannot load file
+	Mapped_File file(f);
+	if (!file.is_open()) { return (_result = META_BAD_FILE); } // cannot load file
 
 	size_t i = 0;
-	while (ifs.good()) {
-		std::string line;
-		std::getline(ifs, line);
-		trim(line);
-		if (!starts_with(line, "tilecoll")) { continue; }
-		line.erase(0, strlen("tilecoll") + 1); // include next whitespace character
-		std::istringstream lss(line);
-		std::string c1, c2, c3, c4;
-		std::getline(lss, c1, ','); trim(c1);
-		std::getline(lss, c2, ','); trim(c2);
-		std::getline(lss, c3, ','); trim(c3);
-		std::getline(lss, c4, ';'); trim(c4);
-		_metatiles[i]->collision(Quadrant::TOP_LEFT, c1);
-		_metatiles[i]->collision(Quadrant::TOP_RIGHT, c2);
-		_metatiles[i]->collision(Quadrant::BOTTOM_LEFT, c3);
-		_metatiles[i]->collision(Quadrant::BOTTOM_RIGHT, c4);
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, c1, c2, c3, c4;
+	while (tokenizer.next_line(line)) {
+		line.trim();
+		if (!line.starts_with("tilecoll")) { continue; }
+		line.skip(strlen("tilecoll") + 1); // include next whitespace character
+		line.remove_comment();
+		c1 = c2 = c3 = Token();
+		line.split(',', c1); c1.trim();
+		line.split(',', c2); c2.trim();
+		line.split(',', c3); c3.trim();
+		c4 = line; c4.trim();
+		_metatiles[i]->collision(Quadrant::TOP_LEFT, _collision_names.intern(c1.data(), c1.size()));
+		_metatiles[i]->collision(Quadrant::TOP_RIGHT, _collision_names.intern(c2.data(), c2.size()));
+		_metatiles[i]->collision(Quadrant::BOTTOM_LEFT, _collision_names.intern(c3.data(), c3.size()));
+		_metatiles[i]->collision(Quadrant::BOTTOM_RIGHT, _collision_names.intern(c4.data(), c4.size()));
 		if (++i == _num_metatiles) { break; }
 	}
 
@@ -165,48 +223,49 @@ Metatileset::Result Metatileset::read_asm_collisions(const char *f) {
 Metatileset::Result Metatileset::read_bin_collisions(const char *f) {
 	if (!_tileset.num_tiles()) { return (_result = META_NO_GFX); } // no graphics
 
-	FILE *file = fl_fopen(f, "rb");
-	if (file == NULL) { return (_result = META_BAD_FILE); } // cannot load file
+	Mapped_File file(f);
+	if (!file.is_open()) { return (_result = META_BAD_FILE); } // cannot load file
 
-	size_t i = 0;
-	uchar data[NUM_QUADRANTS] = {};
-	while (!feof(file)) {
-		size_t c = fread(data, 1, NUM_QUADRANTS, file);
-		if (!c) { break; } // end of file
-		if (c < NUM_QUADRANTS) { fclose(file); return (_result = META_TOO_SHORT); }
-		for (int j = 0; j < NUM_QUADRANTS; j++) {
-			_metatiles[i]->bin_collision((Quadrant)j, data[j]);
-		}
-		if (++i == _num_metatiles) { break; }
+	size_t n = file.size() / NUM_QUADRANTS;
+	for (size_t i = 0; i < n && i < _num_metatiles; i++) {
+		_metatiles[i]->bin_collisions(file.data() + i * NUM_QUADRANTS);
 	}
+	if (n < _num_metatiles && file.size() % NUM_QUADRANTS) { return (_result = META_TOO_SHORT); }
 
-	fclose(file);
 	_bin_collisions = true;
 	return (_result = META_OK);
 }
 
-bool Metatileset::write_asm_collisions(const char *f) {
-	FILE *file = fl_fopen(f, "wb");
-	if (!file) { return false; }
+void Metatileset::print_asm_collisions(std::vector<uint8_t> &data) const {
+	std::string text;
 	for (size_t i = 0; i < _num_metatiles; i++) {
-		Metatile *mt = _metatiles[i];
-		fprintf(file, "\ttilecoll %s, %s, %s, %s ; %02lx\n",
-			mt->collision(Quadrant::TOP_LEFT).c_str(), mt->collision(Quadrant::TOP_RIGHT).c_str(),
-			mt->collision(Quadrant::BOTTOM_LEFT).c_str(), mt->collision(Quadrant::BOTTOM_RIGHT).c_str(), i);
+		const Metatile *mt = _metatiles[i];
+		char index[16] = {};
+		sprintf(index, " ; %02x\n", (unsigned int)i);
+		text += "\ttilecoll ";
+		text += collision_name(mt->collision(Quadrant::TOP_LEFT));
+		text += ", ";
+		text += collision_name(mt->collision(Quadrant::TOP_RIGHT));
+		text += ", ";
+		text += collision_name(mt->collision(Quadrant::BOTTOM_LEFT));
+		text += ", ";
+		text += collision_name(mt->collision(Quadrant::BOTTOM_RIGHT));
+		text += index;
 	}
-	fclose(file);
-	return true;
+	data.assign(text.begin(), text.end());
 }
 
-bool Metatileset::write_bin_collisions(const char *f) {
-	FILE *file = fl_fopen(f, "wb");
-	if (!file) { return false; }
+void Metatileset::print_bin_collisions(std::vector<uint8_t> &data) const {
+	data.resize(_num_metatiles * NUM_QUADRANTS);
 	for (size_t i = 0; i < _num_metatiles; i++) {
-		Metatile *mt = _metatiles[i];
-		fwrite(mt->bin_collisions(), 1, NUM_QUADRANTS, file);
+		memcpy(data.data() + i * NUM_QUADRANTS, _metatiles[i]->bin_collisions(), NUM_QUADRANTS);
 	}
-	fclose(file);
-	return true;
+}
+
+bool Metatileset::write_collisions(const char *f) const {
+	std::vector<uint8_t> data;
+	print_collisions(data);
+	return write_file_atomic(f, data.data(), data.size());
 }
 
 const char *Metatileset::error_message(Result result) {
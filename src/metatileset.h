@@ -5,6 +5,7 @@
 #include "tileset.h"
 #include "map.h"
 #include "metatile.h"
+#include "symbol-table.h"
 
 #define EMPTY_RGB 0xAB, 0xCD, 0xEF // intentionally leave out parentheses or brackets
 
@@ -16,6 +17,7 @@ public:
 private:
 	Tileset _tileset;
 	Metatile *_metatiles[MAX_NUM_METATILES];
+	Symbol_Table _collision_names;
 	size_t _num_metatiles;
 	Result _result;
 	bool _modified, _bin_collisions;
@@ -27,6 +29,10 @@ public:
 	inline Tileset *tileset(void) { return &_tileset; }
 	inline const Tileset *const_tileset(void) const { return &_tileset; }
 	inline Metatile *metatile(uint8_t id) { return _metatiles[id]; }
+	inline const Metatile *const_metatile(uint8_t id) const { return _metatiles[id]; }
+	inline const Symbol_Table &collision_names(void) const { return _collision_names; }
+	inline const char *collision_name(uint16_t c) const { return _collision_names.name(c); }
+	inline uint16_t collision_id(const char *name) { return _collision_names.intern(name); }
 	inline Result result(void) const { return _result; }
 	inline bool modified(void) const { return _modified; }
 	inline void modified(bool m) { _modified = m; }
@@ -34,17 +40,26 @@ public:
 	inline void bin_collisions(bool b) { _bin_collisions = b; }
 	void clear(void);
 	void draw_metatile(int x, int y, uint8_t id, bool zoom, bool show_priority) const;
-	uchar *print_rgb(const Map &map) const;
+	void draw_metatile_priority(int x, int y, uint8_t id, bool zoom) const;
+	uchar *print_indexed(const Map &map) const;
+	size_t compaction(const bool *used, uint8_t *remap) const;
+	void compact(const bool *used, const uint8_t *remap);
 	Result read_metatiles(const char *f);
-	bool write_metatiles(const char *f);
+	// The contents write_metatiles and write_collisions would save
+	void print_metatiles(std::vector<uint8_t> &data) const;
+	inline void print_collisions(std::vector<uint8_t> &data) const {
+		if (_bin_collisions) { print_bin_collisions(data); } else { print_asm_collisions(data); }
+	}
+	bool write_metatiles(const char *f) const;
 	inline Result read_collisions(const char *f) { return _bin_collisions ? read_bin_collisions(f) : read_asm_collisions(f); }
-	inline bool write_collisions(const char *f) { return _bin_collisions ? write_bin_collisions(f) : write_asm_collisions(f); }
+	bool write_collisions(const char *f) const;
 	static const char *error_message(Result result);
 private:
 	Result read_asm_collisions(const char *f);
 	Result read_bin_collisions(const char *f);
-	bool write_asm_collisions(const char *f);
-	bool write_bin_collisions(const char *f);
+	void print_asm_collisions(std::vector<uint8_t> &data) const;
+	void print_bin_collisions(std::vector<uint8_t> &data) const;
+	static void print_row(size_t y, void *data);
 };
 
 #endif
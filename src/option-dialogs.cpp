@@ -1,7 +1,6 @@
 #include <cctype>
 #include <fstream>
 #include <sstream>
-#include <regex>
 #include <algorithm>
 #include <cstdlib>
 
@@ -156,14 +155,10 @@ bool Map_Options_Dialog::guess_map_size(const char *filename, const char *direct
 #endif
 	_map_size->copy_label(buffer);
 
-	std::cmatch cm;
-	std::regex rx(".+\\.([0-9]+)x([0-9]+)(?:\\.[A-Za-z0-9_-]+)?\\.[Bb][Ll][Kk]");
-	std::regex_match(filename, cm, rx);
-	size_t n = cm.size();
-	if (n == 3) {
-		std::string sw(cm[1]), sh(cm[2]);
-		_map_width->value(std::stoi(sw));
-		_map_height->value(std::stoi(sh));
+	Blk_Name bn;
+	if (parse_blk_name(filename, bn) && bn.dimensions) {
+		_map_width->value(bn.width);
+		_map_height->value(bn.height);
 		return true;
 	}
 
@@ -214,7 +209,7 @@ bool Map_Options_Dialog::guess_map_size(const char *filename, const char *direct
 		else {
 			lss >> h >> comma >> w;
 		}
-		if (1 <= w && w <= 255 && 1 <= h && h <= 255) {
+		if (1 <= w && w <= MAX_MAP_SIZE && 1 <= h && h <= MAX_MAP_SIZE) {
 			_map_width->value(w);
 			_map_height->value(h);
 			return true;
@@ -228,12 +223,9 @@ bool Map_Options_Dialog::guess_map_size(const char *filename, const char *direct
 std::string Map_Options_Dialog::guess_map_tileset(const char *filename, const char *directory, Map_Attributes &attrs) {
 	if (!filename) { return ""; }
 
-	std::cmatch cm;
-	std::regex rx(".+\\.([A-Za-z0-9_-]+)\\.[Bb][Ll][Kk]");
-	std::regex_match(filename, cm, rx);
-	size_t n = cm.size();
-	if (n == 2) {
-		return cm[1].str();
+	Blk_Name bn;
+	if (parse_blk_name(filename, bn) && bn.tileset) {
+		return std::string(bn.tileset, bn.tileset_length);
 	}
 
 	const char *name = fl_filename_name(filename);
@@ -494,9 +486,9 @@ void Map_Options_Dialog::initialize_content() {
 	_roof = new Dropdown(0, 0, 0, 0, "Roof:");
 	// Initialize content group's children
 	_map_width->align(FL_ALIGN_LEFT);
-	_map_width->range(1, 255);
+	_map_width->range(1, MAX_MAP_SIZE);
 	_map_height->align(FL_ALIGN_LEFT);
-	_map_height->range(1, 255);
+	_map_height->range(1, MAX_MAP_SIZE);
 	_tileset->align(FL_ALIGN_LEFT);
 	_roof->align(FL_ALIGN_LEFT);
 	// Initialize data
@@ -587,9 +579,9 @@ void Resize_Dialog::initialize_content() {
 	}
 	// Initialize content group's children
 	_map_width->align(FL_ALIGN_LEFT);
-	_map_width->range(1, 255);
+	_map_width->range(1, MAX_MAP_SIZE);
 	_map_height->align(FL_ALIGN_LEFT);
-	_map_height->range(1, 255);
+	_map_height->range(1, MAX_MAP_SIZE);
 	anchor(Preferences::get("resize-anchor", 4));
 }
 
@@ -59,15 +59,15 @@ public:
 	Map_Options_Dialog(const char *t);
 	~Map_Options_Dialog();
 	bool limit_blk_options(const char *filename, const char *directory, Map_Attributes &attrs);
-	inline uint8_t map_width(void) const { return (uint8_t)_map_width->value(); }
-	inline uint8_t map_height(void) const { return (uint8_t)_map_height->value(); }
+	inline uint16_t map_width(void) const { return (uint16_t)_map_width->value(); }
+	inline uint16_t map_height(void) const { return (uint16_t)_map_height->value(); }
 	const char *tileset(void) const;
 	const char *roof(void) const;
 	inline int num_roofs(void) const { return _roof->size() - 2; }
+	std::string guess_map_tileset(const char *filename, const char *directory, Map_Attributes &attrs);
 private:
 	const char *original_name(const char *pretty_name) const;
 	bool guess_map_size(const char *filename, const char *directory, Map_Attributes &attrs);
-	std::string guess_map_tileset(const char *filename, const char *directory, Map_Attributes &attrs);
 	void guess_tileset_names(const char *directory, Dictionary &pretty_names, Dictionary &guessable_names);
 	std::string add_tileset(const char *t, int ext_len, const Dictionary &pretty_names);
 	std::string add_roof(const char *r, int ext_len);
@@ -88,9 +88,9 @@ private:
 public:
 	Resize_Dialog(const char *t);
 	~Resize_Dialog();
-	inline uint8_t map_width(void) const { return (uint8_t)_map_width->value(); }
-	inline uint8_t map_height(void) const { return (uint8_t)_map_height->value(); }
-	inline void map_size(uint8_t w, uint8_t h) { initialize(); _map_width->value(w); _map_height->value(h); }
+	inline uint16_t map_width(void) const { return (uint16_t)_map_width->value(); }
+	inline uint16_t map_height(void) const { return (uint16_t)_map_height->value(); }
+	inline void map_size(uint16_t w, uint16_t h) { initialize(); _map_width->value(w); _map_height->value(h); }
 	Hor_Align horizontal_anchor(void) const;
 	Vert_Align vertical_anchor(void) const;
 	int anchor(void) const;
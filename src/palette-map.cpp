@@ -1,6 +1,4 @@
-#include <string>
-#include <fstream>
-#include <sstream>
+#include <cstring>
 #include <array>
 
 #pragma warning(push, 0)
@@ -9,6 +7,8 @@
 
 #include "utils.h"
 #include "config.h"
+#include "mapped-file.h"
+#include "tokenizer.h"
 #include "palette-map.h"
 
 Palette_Map::Palette_Map() : _palette(), _palette_size(0), _result(PALETTE_NULL) {
@@ -21,6 +21,28 @@ void Palette_Map::clear() {
 	_result = PALETTE_NULL;
 }
 
+static bool palette_from_name(const Token &t, Palette &p) {
+	// Perfect hash of the eight base names, which each PRIORITY_ name extends
+	static const char *names[16] = {
+		NULL, "GRAY", "GREEN", "ROOF", "RED", NULL, NULL, "TEXT",
+		NULL, NULL, NULL, NULL, NULL, "BROWN", "YELLOW", "WATER",
+	};
+	static const Palette palettes[16] = {
+		Palette::UNDEFINED, Palette::GRAY, Palette::GREEN, Palette::ROOF,
+		Palette::RED, Palette::UNDEFINED, Palette::UNDEFINED, Palette::TEXT,
+		Palette::UNDEFINED, Palette::UNDEFINED, Palette::UNDEFINED, Palette::UNDEFINED,
+		Palette::UNDEFINED, Palette::BROWN, Palette::YELLOW, Palette::WATER,
+	};
+	Token name(t);
+	bool priority = name.starts_with("PRIORITY_");
+	if (priority) { name.skip(strlen("PRIORITY_")); }
+	if (name.size() < 3) { return false; }
+	size_t h = ((size_t)name[0] + (size_t)name[1] * 3 + name.size()) & 15;
+	if (!names[h] || name != names[h]) { return false; }
+	p = priority ? (Palette)(palettes[h] | PRIORITY_GRAY) : palettes[h];
+	return true;
+}
+
 Palette_Map::Result Palette_Map::read_from(const char *f) {
 	clear();
 
@@ -30,37 +52,21 @@ Palette_Map::Result Palette_Map::read_from(const char *f) {
 		return (_result = PALETTE_OK);
 	}
 
-	std::ifstream ifs(f);
-	if (!ifs.good()) { return (_result = BAD_PALETTE_FILE); }
-	std::string prefix(Config::palette_macro());
-	while (ifs.good()) {
-		std::string line;
-		std::getline(ifs, line);
-		if (!starts_with(line, prefix)) { continue; }
-		remove_comment(line);
-		std::istringstream lss(line);
-		std::string token;
-		std::getline(lss, token, ','); // skip bank ID
-		while (std::getline(lss, token, ',')) {
+	Mapped_File file(f);
+	if (!file.is_open()) { return (_result = BAD_PALETTE_FILE); }
+	const char *prefix = Config::palette_macro();
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, token;
+	while (tokenizer.next_line(line)) {
+		if (!line.starts_with(prefix)) { continue; }
+		line.remove_comment();
+		line.split(',', token); // skip bank ID
+		while (line.split(',', token)) {
 			if (_palette_size == MAX_NUM_TILES) { return (_result = PALETTE_TOO_LONG); }
-			trim(token);
-			if      (token == "GRAY")            { _palette[_palette_size++] = Palette::GRAY; }
-			else if (token == "RED")             { _palette[_palette_size++] = Palette::RED; }
-			else if (token == "GREEN")           { _palette[_palette_size++] = Palette::GREEN; }
-			else if (token == "WATER")           { _palette[_palette_size++] = Palette::WATER; }
-			else if (token == "YELLOW")          { _palette[_palette_size++] = Palette::YELLOW; }
-			else if (token == "BROWN")           { _palette[_palette_size++] = Palette::BROWN; }
-			else if (token == "ROOF")            { _palette[_palette_size++] = Palette::ROOF; }
-			else if (token == "TEXT")            { _palette[_palette_size++] = Palette::TEXT; }
-			else if (token == "PRIORITY_GRAY")   { _palette[_palette_size++] = Palette::PRIORITY_GRAY; }
-			else if (token == "PRIORITY_RED")    { _palette[_palette_size++] = Palette::PRIORITY_RED; }
-			else if (token == "PRIORITY_GREEN")  { _palette[_palette_size++] = Palette::PRIORITY_GREEN; }
-			else if (token == "PRIORITY_WATER")  { _palette[_palette_size++] = Palette::PRIORITY_WATER; }
-			else if (token == "PRIORITY_YELLOW") { _palette[_palette_size++] = Palette::PRIORITY_YELLOW; }
-			else if (token == "PRIORITY_BROWN")  { _palette[_palette_size++] = Palette::PRIORITY_BROWN; }
-			else if (token == "PRIORITY_ROOF")   { _palette[_palette_size++] = Palette::PRIORITY_ROOF; }
-			else if (token == "PRIORITY_TEXT")   { _palette[_palette_size++] = Palette::PRIORITY_TEXT; }
-			else                                 { return (_result = BAD_PALETTE_NAME); }
+			token.trim();
+			Palette p;
+			if (!palette_from_name(token, p)) { return (_result = BAD_PALETTE_NAME); }
+			_palette[_palette_size++] = p;
 		}
 	}
 	return (_result = PALETTE_OK);
@@ -0,0 +1,110 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils.h"
+#include "parallel.h"
+
+static void parallel_worker(std::atomic<size_t> *next, size_t n, Parallel_Job job, void *data) {
+	for (size_t i = (*next)++; i < n; i = (*next)++) {
+		job(i, data);
+	}
+}
+
+// Threads are started the first time they are needed and then wait for
+// each later parallel_for, instead of being started and joined every call
+class Worker_Pool {
+private:
+	// Held for a whole parallel_for, so only one runs on the pool at a time
+	std::mutex _batch_mutex;
+	std::mutex _mutex;
+	std::condition_variable _work_cv, _done_cv;
+	std::vector<std::thread> _threads;
+	// The current batch; workers with an index below _wanted take part in it
+	size_t _generation, _wanted, _running, _n;
+	Parallel_Job _job;
+	void *_data;
+	std::atomic<size_t> _next;
+	bool _quit;
+public:
+	Worker_Pool() : _batch_mutex(), _mutex(), _work_cv(), _done_cv(), _threads(), _generation(0), _wanted(0), _running(0),
+		_n(0), _job(NULL), _data(NULL), _next(0), _quit(false) {}
+	~Worker_Pool();
+	void run(size_t n, Parallel_Job job, void *data, size_t num_workers);
+private:
+	void work(size_t w, size_t seen);
+	static void work_thread(Worker_Pool *pool, size_t w, size_t seen);
+};
+
+Worker_Pool::~Worker_Pool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_work_cv.notify_all();
+	for (std::thread &t : _threads) {
+		t.join();
+	}
+}
+
+void Worker_Pool::run(size_t n, Parallel_Job job, void *data, size_t num_workers) {
+	std::unique_lock<std::mutex> batch(_batch_mutex, std::try_to_lock);
+	if (!batch.owns_lock() || !num_workers) {
+		// A job that calls parallel_for, or another thread's call while the
+		// pool is busy, runs on the calling thread alone
+		std::atomic<size_t> next(0);
+		parallel_worker(&next, n, job, data);
+		return;
+	}
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (_threads.size() < num_workers) {
+		_threads.emplace_back(work_thread, this, _threads.size(), _generation);
+	}
+	_n = n;
+	_job = job;
+	_data = data;
+	_next = 0;
+	_wanted = _running = num_workers;
+	_generation++;
+	lock.unlock();
+	_work_cv.notify_all();
+	parallel_worker(&_next, n, job, data);
+	lock.lock();
+	while (_running) { _done_cv.wait(lock); }
+}
+
+void Worker_Pool::work(size_t w, size_t seen) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;) {
+		while (!_quit && _generation == seen) { _work_cv.wait(lock); }
+		if (_quit) { return; }
+		seen = _generation;
+		if (w >= _wanted) { continue; }
+		size_t n = _n;
+		Parallel_Job job = _job;
+		void *data = _data;
+		lock.unlock();
+		parallel_worker(&_next, n, job, data);
+		lock.lock();
+		if (!--_running) { _done_cv.notify_one(); }
+	}
+}
+
+void Worker_Pool::work_thread(Worker_Pool *pool, size_t w, size_t seen) {
+	pool->work(w, seen);
+}
+
+static Worker_Pool worker_pool;
+
+unsigned int num_cores() {
+	unsigned int n = std::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+void parallel_for(size_t n, Parallel_Job job, void *data, unsigned int max_threads) {
+	if (!max_threads) { max_threads = num_cores(); }
+	size_t num_workers = n ? MIN((size_t)max_threads, n) - 1 : 0;
+	worker_pool.run(n, job, data, num_workers);
+}
@@ -0,0 +1,15 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+
+typedef void (*Parallel_Job)(size_t i, void *data);
+
+unsigned int num_cores(void);
+// Runs job(i, data) for every i < n on up to max_threads threads (default:
+// one per core), including the calling one. Each thread claims the next
+// unclaimed index when it finishes one, so uneven jobs still balance out.
+// The extra threads are kept in a pool and reused by later calls.
+void parallel_for(size_t n, Parallel_Job job, void *data, unsigned int max_threads = 0);
+
+#endif
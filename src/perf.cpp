@@ -0,0 +1,90 @@
+#include <cstdio>
+#include <iostream>
+
+#pragma warning(push, 0)
+#include <FL/fl_utf8.h>
+#pragma warning(pop)
+
+#include "utils.h"
+#include "perf.h"
+
+// enough for a long profiling session without unbounded growth
+#define MAX_TRACE_EVENTS 2000000
+
+std::atomic<bool> Perf::_hud(false), Perf::_log(false);
+std::string Perf::_trace_file;
+std::atomic<size_t> Perf::_counters[NUM_COUNTERS];
+size_t Perf::_last_counters[NUM_COUNTERS] = {};
+double Perf::_last_frame_ms = 0.0;
+size_t Perf::_num_frames = 0;
+Perf::Clock::time_point Perf::_epoch = Perf::Clock::now(), Perf::_frame_start;
+std::mutex Perf::_events_mutex;
+std::vector<Perf::Trace_Event> Perf::_events;
+
+static double percent(size_t hits, size_t misses) {
+	return hits + misses ? 100.0 * hits / (hits + misses) : 100.0;
+}
+
+void Perf::begin_frame() {
+	if (!enabled()) { return; }
+	_frame_start = Clock::now();
+}
+
+void Perf::end_frame() {
+	if (!enabled()) { return; }
+	Clock::time_point end = Clock::now();
+	_last_frame_ms = std::chrono::duration<double, std::milli>(end - _frame_start).count();
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		_last_counters[i] = _counters[i].exchange(0, std::memory_order_relaxed);
+	}
+	_num_frames++;
+	record("frame", _frame_start, end);
+	if (_num_frames == 1) {
+		// _epoch is set during static initialization, so this is the cold-start time
+		record("startup", _epoch, end);
+		if (_log) {
+			std::cerr << "startup: " << std::chrono::duration<double, std::milli>(end - _epoch).count()
+				<< " ms to first frame" << std::endl;
+		}
+	}
+	if (_log) {
+		std::cerr << "frame " << _num_frames << ": " << summary() << std::endl;
+	}
+}
+
+void Perf::record(const char *name, Clock::time_point start, Clock::time_point end) {
+	if (_trace_file.empty()) { return; }
+	std::lock_guard<std::mutex> lock(_events_mutex);
+	if (_events.size() >= MAX_TRACE_EVENTS) { return; }
+	Trace_Event e;
+	e.name = name;
+	e.ts = (long long)std::chrono::duration_cast<std::chrono::microseconds>(start - _epoch).count();
+	e.dur = (long long)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	_events.push_back(e);
+}
+
+std::string Perf::summary() {
+	char buffer[256] = {};
+	sprintf(buffer, "%.2f ms, %u draw calls, %u blocks, %u tiles, %u px uploaded, "
+		"framebuffer %.0f%% hits, lighting %.0f%% hits",
+		_last_frame_ms, (uint32_t)last(DRAW_IMAGE_CALLS), (uint32_t)last(BLOCKS_DRAWN), (uint32_t)last(TILES_DRAWN),
+		(uint32_t)last(PIXELS_UPLOADED), percent(last(FRAMEBUFFER_HITS), last(FRAMEBUFFER_MISSES)),
+		percent(last(LIGHTING_HITS), last(LIGHTING_MISSES)));
+	return buffer;
+}
+
+bool Perf::write_trace() {
+	if (_trace_file.empty()) { return true; }
+	FILE *file = fl_fopen(_trace_file.c_str(), "w");
+	if (!file) { return false; }
+	fputs("{\"traceEvents\":[\n", file);
+	std::lock_guard<std::mutex> lock(_events_mutex);
+	for (size_t i = 0; i < _events.size(); i++) {
+		const Trace_Event &e = _events[i];
+		fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":1}%s\n",
+			e.name, e.ts, e.dur, i + 1 < _events.size() ? "," : "");
+	}
+	fputs("],\"displayTimeUnit\":\"ms\"}\n", file);
+	fclose(file);
+	return true;
+}
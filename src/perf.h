@@ -0,0 +1,67 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-frame drawing statistics, scoped timers, and Chrome trace output
+// (load the JSON in chrome://tracing or Perfetto)
+class Perf {
+public:
+	enum Counter { DRAW_IMAGE_CALLS, BLOCKS_DRAWN, TILES_DRAWN, FRAMEBUFFER_HITS, FRAMEBUFFER_MISSES,
+		LIGHTING_HITS, LIGHTING_MISSES, PIXELS_UPLOADED, NUM_COUNTERS };
+	typedef std::chrono::steady_clock Clock;
+private:
+	struct Trace_Event {
+		const char *name;
+		long long ts, dur;
+	};
+	// Counters and switches may be read and updated from worker threads
+	static std::atomic<bool> _hud, _log;
+	static std::string _trace_file;
+	static std::atomic<size_t> _counters[NUM_COUNTERS];
+	static size_t _last_counters[NUM_COUNTERS];
+	static double _last_frame_ms;
+	static size_t _num_frames;
+	static Clock::time_point _epoch, _frame_start;
+	// Scopes may end on worker threads, so recording is locked
+	static std::mutex _events_mutex;
+	static std::vector<Trace_Event> _events;
+public:
+	inline static bool enabled(void) {
+		return _hud.load(std::memory_order_relaxed) || _log.load(std::memory_order_relaxed) || !_trace_file.empty();
+	}
+	inline static bool hud(void) { return _hud.load(std::memory_order_relaxed); }
+	inline static void hud(bool h) { _hud = h; }
+	inline static void log(bool l) { _log = l; }
+	inline static void trace_file(const char *f) { _trace_file = f; }
+	inline static void count(Counter c, size_t n = 1) {
+		if (enabled()) { _counters[c].fetch_add(n, std::memory_order_relaxed); }
+	}
+	inline static size_t last(Counter c) { return _last_counters[c]; }
+	inline static double last_frame_ms(void) { return _last_frame_ms; }
+	static void begin_frame(void);
+	static void end_frame(void);
+	static void record(const char *name, Clock::time_point start, Clock::time_point end);
+	static std::string summary(void);
+	static bool write_trace(void);
+};
+
+class Perf_Scope {
+private:
+	const char *_name;
+	bool _active;
+	Perf::Clock::time_point _start;
+public:
+	inline Perf_Scope(const char *name) : _name(name), _active(Perf::enabled()), _start() {
+		if (_active) { _start = Perf::Clock::now(); }
+	}
+	inline ~Perf_Scope() {
+		if (_active) { Perf::record(_name, _start, Perf::Clock::now()); }
+	}
+};
+
+#endif
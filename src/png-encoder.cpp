@@ -0,0 +1,216 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <zlib.h>
+
+#include "parallel.h"
+#include "png-encoder.h"
+
+#define PNG_CHUNK_SIZE (1 << 17)
+#define PNG_IDAT_SIZE (1 << 18)
+#define DEFLATE_WINDOW (1 << MAX_WBITS)
+
+static const uchar png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+static void put_uint32(std::vector<uchar> &v, uint32_t n) {
+	v.push_back((uchar)(n >> 24));
+	v.push_back((uchar)(n >> 16));
+	v.push_back((uchar)(n >> 8));
+	v.push_back((uchar)n);
+}
+
+static void put_chunk(std::vector<uchar> &png, const char *type, const uchar *data, size_t n) {
+	put_uint32(png, (uint32_t)n);
+	size_t start = png.size();
+	png.insert(png.end(), type, type + 4);
+	if (n) { png.insert(png.end(), data, data + n); }
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, png.data() + start, (uInt)(n + 4));
+	put_uint32(png, (uint32_t)crc);
+}
+
+static uchar paeth_predictor(uchar a, uchar b, uchar c) {
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+static void filter_row(Png_Encoder::Filter f, const uchar *row, const uchar *prev, size_t n, uchar *out) {
+	// every format written here has one byte per complete pixel (or less)
+	out[0] = (uchar)f;
+	for (size_t i = 0; i < n; i++) {
+		uchar a = i ? row[i-1] : 0, b = prev[i], c = i ? prev[i-1] : 0;
+		uchar x = row[i];
+		switch (f) {
+		case Png_Encoder::Filter::FILTER_SUB:     x -= a; break;
+		case Png_Encoder::Filter::FILTER_UP:      x -= b; break;
+		case Png_Encoder::Filter::FILTER_AVERAGE: x -= (uchar)((a + b) / 2); break;
+		case Png_Encoder::Filter::FILTER_PAETH:   x -= paeth_predictor(a, b, c); break;
+		default: break;
+		}
+		out[i+1] = x;
+	}
+}
+
+static size_t filter_cost(const uchar *out, size_t n) {
+	// minimum sum of absolute differences heuristic
+	size_t sum = 0;
+	for (size_t i = 1; i <= n; i++) {
+		sum += (size_t)abs((int)(signed char)out[i]);
+	}
+	return sum;
+}
+
+Png_Encoder::Png_Encoder(size_t w, size_t h, int depth, bool gray, const uchar *palette, size_t num_colors) :
+	_width(w), _height(h), _depth(depth), _gray(gray), _palette(), _level(Z_DEFAULT_COMPRESSION),
+	_strategy(Z_DEFAULT_STRATEGY), _filter(Filter::FILTER_ADAPTIVE), _chunk_size(PNG_CHUNK_SIZE),
+	_num_threads(num_cores()) {
+	if (palette) { _palette.assign(palette, palette + num_colors * 3); }
+}
+
+bool Png_Encoder::encode(const uchar *pixels, std::vector<uchar> &png) const {
+	png.clear();
+	std::vector<uchar> filtered, zdata;
+	filter_scanlines(pixels, filtered);
+	if (!deflate_chunks(filtered, zdata)) { return false; }
+	png.reserve(zdata.size() + _palette.size() + 128);
+	png.insert(png.end(), png_signature, png_signature + sizeof(png_signature));
+	// Write the IHDR chunk
+	std::vector<uchar> ihdr;
+	put_uint32(ihdr, (uint32_t)_width);
+	put_uint32(ihdr, (uint32_t)_height);
+	ihdr.push_back((uchar)_depth);
+	ihdr.push_back(_gray ? 0 : 3); // grayscale or indexed-color
+	ihdr.push_back(0); // deflate compression
+	ihdr.push_back(0); // adaptive filtering
+	ihdr.push_back(0); // no interlace
+	put_chunk(png, "IHDR", ihdr.data(), ihdr.size());
+	// Write the PLTE chunk
+	if (!_gray) {
+		put_chunk(png, "PLTE", _palette.data(), _palette.size());
+	}
+	// Write the IDAT chunks
+	for (size_t i = 0; i < zdata.size(); i += PNG_IDAT_SIZE) {
+		put_chunk(png, "IDAT", zdata.data() + i, MIN(zdata.size() - i, (size_t)PNG_IDAT_SIZE));
+	}
+	put_chunk(png, "IEND", NULL, 0);
+	return true;
+}
+
+void Png_Encoder::filter_scanlines(const uchar *pixels, std::vector<uchar> &filtered) const {
+	// Pack pixels (one per byte) into scanlines of the given bit depth
+	size_t row_bytes = (_width * _depth + 7) / 8;
+	size_t per_byte = 8 / _depth;
+	std::vector<uchar> row(row_bytes), prev(row_bytes), best(row_bytes + 1), trial(row_bytes + 1);
+	filtered.resize((row_bytes + 1) * _height);
+	for (size_t y = 0; y < _height; y++) {
+		const uchar *src = pixels + y * _width;
+		if (_depth == 8) {
+			memcpy(row.data(), src, row_bytes);
+		}
+		else {
+			std::fill(row.begin(), row.end(), (uchar)0);
+			for (size_t x = 0; x < _width; x++) {
+				row[x / per_byte] |= (uchar)(src[x] << (8 - _depth * (x % per_byte + 1)));
+			}
+		}
+		uchar *out = filtered.data() + y * (row_bytes + 1);
+		if (_filter != Filter::FILTER_ADAPTIVE) {
+			filter_row(_filter, row.data(), prev.data(), row_bytes, out);
+		}
+		else {
+			size_t best_cost = 0;
+			for (int f = Filter::FILTER_NONE; f <= Filter::FILTER_PAETH; f++) {
+				filter_row((Filter)f, row.data(), prev.data(), row_bytes, trial.data());
+				size_t cost = filter_cost(trial.data(), row_bytes);
+				if (f == Filter::FILTER_NONE || cost < best_cost) {
+					best_cost = cost;
+					best.swap(trial);
+				}
+			}
+			memcpy(out, best.data(), row_bytes + 1);
+		}
+		row.swap(prev);
+	}
+}
+
+bool Png_Encoder::deflate_chunk(const std::vector<uchar> &filtered, size_t start, size_t end,
+	std::vector<uchar> &out, uint32_t &adler) const {
+	adler = (uint32_t)adler32(adler32(0L, Z_NULL, 0), filtered.data() + start, (uInt)(end - start));
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, _level, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, _strategy) != Z_OK) { return false; }
+	// Prime with the end of the previous chunk so matches can reach across
+	if (start > 0) {
+		size_t n = MIN(start, (size_t)DEFLATE_WINDOW);
+		deflateSetDictionary(&zs, filtered.data() + start - n, (uInt)n);
+	}
+	// The last chunk finishes the stream; the others end on a byte boundary
+	// with an empty stored block so they can simply be concatenated
+	bool last = end == filtered.size();
+	int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+	out.resize(deflateBound(&zs, (uLong)(end - start)) + 16);
+	zs.next_in = const_cast<Bytef *>(filtered.data() + start);
+	zs.avail_in = (uInt)(end - start);
+	zs.next_out = out.data();
+	zs.avail_out = (uInt)out.size();
+	int r;
+	do {
+		if (!zs.avail_out) {
+			size_t used = out.size();
+			out.resize(used * 2);
+			zs.next_out = out.data() + used;
+			zs.avail_out = (uInt)(out.size() - used);
+		}
+		r = deflate(&zs, flush);
+	} while (r == Z_OK && (last || !zs.avail_out));
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+	return last ? r == Z_STREAM_END : r == Z_OK;
+}
+
+struct Deflate_Job {
+	const Png_Encoder *encoder;
+	const std::vector<uchar> *filtered;
+	std::vector<std::vector<uchar>> *outs;
+	std::vector<uint32_t> *adlers;
+	std::atomic<bool> ok;
+};
+
+void Png_Encoder::deflate_job(size_t i, void *data) {
+	Deflate_Job *job = (Deflate_Job *)data;
+	const Png_Encoder *pe = job->encoder;
+	size_t start = i * pe->_chunk_size, end = MIN(start + pe->_chunk_size, job->filtered->size());
+	if (!pe->deflate_chunk(*job->filtered, start, end, (*job->outs)[i], (*job->adlers)[i])) { job->ok = false; }
+}
+
+bool Png_Encoder::deflate_chunks(const std::vector<uchar> &filtered, std::vector<uchar> &zdata) const {
+	size_t n = filtered.size();
+	size_t num_chunks = MAX((n + _chunk_size - 1) / _chunk_size, (size_t)1);
+	std::vector<std::vector<uchar>> outs(num_chunks);
+	std::vector<uint32_t> adlers(num_chunks);
+	// Compress chunks on worker threads, with this thread helping out
+	Deflate_Job job;
+	job.encoder = this;
+	job.filtered = &filtered;
+	job.outs = &outs;
+	job.adlers = &adlers;
+	job.ok = true;
+	parallel_for(num_chunks, deflate_job, &job, _num_threads);
+	if (!job.ok) { return false; }
+	// Wrap the raw deflate data in a zlib header and Adler-32 trailer
+	int flevel = _level < 0 ? 2 : _level < 2 ? 0 : _level < 6 ? 1 : _level == 6 ? 2 : 3;
+	uint32_t header = (0x78 << 8) | (flevel << 6);
+	if (header % 31) { header += 31 - header % 31; }
+	zdata.clear();
+	zdata.push_back((uchar)(header >> 8));
+	zdata.push_back((uchar)header);
+	uLong adler = adler32(0L, Z_NULL, 0);
+	for (size_t i = 0; i < num_chunks; i++) {
+		zdata.insert(zdata.end(), outs[i].begin(), outs[i].end());
+		size_t start = i * _chunk_size, end = MIN(start + _chunk_size, n);
+		adler = adler32_combine(adler, adlers[i], (z_off_t)(end - start));
+	}
+	put_uint32(zdata, (uint32_t)adler);
+	return true;
+}
@@ -0,0 +1,43 @@
+#ifndef PNG_ENCODER_H
+#define PNG_ENCODER_H
+
+#include <vector>
+
+#pragma warning(push, 0)
+#include <FL/fl_types.h>
+#pragma warning(pop)
+
+#include "utils.h"
+
+// Writes grayscale or palette-indexed PNGs, deflating the image data in
+// independent chunks on worker threads (like pigz) and joining them into
+// one zlib stream
+class Png_Encoder {
+public:
+	enum Filter { FILTER_NONE, FILTER_SUB, FILTER_UP, FILTER_AVERAGE, FILTER_PAETH, FILTER_ADAPTIVE };
+private:
+	size_t _width, _height;
+	int _depth;
+	bool _gray;
+	std::vector<uchar> _palette;
+	int _level, _strategy;
+	Filter _filter;
+	size_t _chunk_size;
+	unsigned int _num_threads;
+public:
+	Png_Encoder(size_t w, size_t h, int depth, bool gray, const uchar *palette = NULL, size_t num_colors = 0);
+	inline void level(int l) { _level = l; }
+	inline void strategy(int s) { _strategy = s; }
+	inline void filter(Filter f) { _filter = f; }
+	inline void chunk_size(size_t n) { _chunk_size = n; }
+	inline void num_threads(unsigned int n) { _num_threads = n; }
+	bool encode(const uchar *pixels, std::vector<uchar> &png) const;
+private:
+	void filter_scanlines(const uchar *pixels, std::vector<uchar> &filtered) const;
+	bool deflate_chunk(const std::vector<uchar> &filtered, size_t start, size_t end, std::vector<uchar> &out,
+		uint32_t &adler) const;
+	static void deflate_job(size_t i, void *data);
+	bool deflate_chunks(const std::vector<uchar> &filtered, std::vector<uchar> &zdata) const;
+};
+
+#endif
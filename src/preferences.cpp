@@ -16,3 +16,7 @@ int Preferences::get(const char *key, int default_) {
 void Preferences::set(const char *key, int value) {
 	global_prefs.set(key, value);
 }
+
+bool Preferences::userdata_path(char *dest, int n) {
+	return global_prefs.getUserdataPath(dest, n) != 0;
+}
@@ -9,6 +9,7 @@ class Preferences {
 public:
 	static int get(const char *key, int default_ = 0);
 	static void set(const char *key, int value);
+	static bool userdata_path(char *dest, int n);
 
 };
 
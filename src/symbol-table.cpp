@@ -0,0 +1,23 @@
+#include "symbol-table.h"
+
+Symbol_Table::Symbol_Table() : _names(), _ids() {
+	clear();
+}
+
+uint16_t Symbol_Table::intern(const char *s, size_t n) {
+	std::string name(s, n);
+	auto it = _ids.find(name);
+	if (it != _ids.end()) { return it->second; }
+	// a full table maps any new names to the empty one
+	if (_names.size() == MAX_NUM_SYMBOLS) { return 0; }
+	uint16_t id = (uint16_t)_names.size();
+	_names.push_back(name);
+	_ids.emplace(name, id);
+	return id;
+}
+
+void Symbol_Table::clear() {
+	_names.assign(1, "");
+	_ids.clear();
+	_ids.emplace("", (uint16_t)0);
+}
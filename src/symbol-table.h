@@ -0,0 +1,28 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "utils.h"
+
+#define MAX_NUM_SYMBOLS 0x10000
+
+// Interns names (like collision constants) so they can be stored and compared
+// as 16-bit ids; id 0 is always the empty name
+class Symbol_Table {
+private:
+	std::vector<std::string> _names;
+	std::unordered_map<std::string, uint16_t> _ids;
+public:
+	Symbol_Table();
+	inline size_t size(void) const { return _names.size(); }
+	inline const char *name(uint16_t id) const { return id < _names.size() ? _names[id].c_str() : ""; }
+	uint16_t intern(const char *s, size_t n);
+	inline uint16_t intern(const char *s) { return intern(s, strlen(s)); }
+	void clear(void);
+};
+
+#endif
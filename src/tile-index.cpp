@@ -0,0 +1,107 @@
+#include "config.h"
+#include "tile-index.h"
+
+size_t Tile_Index::Tile_Key_Hash::operator()(const Tile_Key &k) const {
+	// 64-bit mix of both halves and the palette
+	uint64_t h = k.hi * 0x9E3779B97F4A7C15ULL;
+	h ^= k.lo + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+	h ^= (uint64_t)k.palette * 0xC2B2AE3D27D4EB4FULL;
+	h ^= h >> 29;
+	return (size_t)h;
+}
+
+Tile_Index::Tile_Index() : _exact(), _canonical(), _originals(), _flips(), _num_exact(0), _num_flipped(0) {
+	clear();
+}
+
+void Tile_Index::clear() {
+	_exact.clear();
+	_canonical.clear();
+	for (size_t i = 0; i < MAX_NUM_TILES; i++) {
+		_originals[i] = (uint8_t)i;
+		_flips[i] = Flip::NO_FLIP;
+	}
+	_num_exact = _num_flipped = 0;
+}
+
+Tile_Index::Tile_Key Tile_Index::key(const Tile *t, Flip f) {
+	Tile_Key k = {0, 0, t->palette()};
+	bool fx = f == Flip::X_FLIP || f == Flip::XY_FLIP, fy = f == Flip::Y_FLIP || f == Flip::XY_FLIP;
+	for (int y = 0; y < TILE_SIZE; y++) {
+		for (int x = 0; x < TILE_SIZE; x++) {
+			uint64_t h = (uint64_t)t->hue(fx ? TILE_SIZE - 1 - x : x, fy ? TILE_SIZE - 1 - y : y);
+			uint64_t &half = y < TILE_SIZE / 2 ? k.hi : k.lo;
+			half = (half << 2) | h;
+		}
+	}
+	return k;
+}
+
+void Tile_Index::add(const Tile *t) {
+	uint8_t id = t->id();
+	Tile_Key exact = key(t, Flip::NO_FLIP);
+	auto it = _exact.find(exact);
+	if (it != _exact.end()) {
+		_originals[id] = it->second.id;
+		_flips[id] = Flip::NO_FLIP;
+		_num_exact++;
+		return;
+	}
+	_exact.insert(std::make_pair(exact, Entry{id, Flip::NO_FLIP}));
+	// the canonical key is the least of the four orientations
+	Tile_Key canonical = exact;
+	Flip canonical_flip = Flip::NO_FLIP;
+	for (int i = Flip::X_FLIP; i <= Flip::XY_FLIP; i++) {
+		Flip f = (Flip)i;
+		Tile_Key k = key(t, f);
+		if (k.hi < canonical.hi || (k.hi == canonical.hi && k.lo < canonical.lo)) {
+			canonical = k;
+			canonical_flip = f;
+		}
+	}
+	auto jt = _canonical.find(canonical);
+	if (jt != _canonical.end()) {
+		// flips compose like XOR on their X and Y bits
+		_originals[id] = jt->second.id;
+		_flips[id] = (Flip)(canonical_flip ^ jt->second.flip);
+		_num_flipped++;
+		return;
+	}
+	_canonical.insert(std::make_pair(canonical, Entry{id, canonical_flip}));
+}
+
+void Tile_Index::add_tileset(const Tileset &ts) {
+	for (int i = 0; i < MAX_NUM_TILES; i++) {
+		uint8_t id = (uint8_t)i;
+		if (!indexable(id)) { continue; }
+		const Tile *t = ts.const_tile(id);
+		if (t->palette() == Palette::UNDEFINED) { continue; }
+		add(t);
+	}
+}
+
+size_t Tile_Index::remap(Metatileset &ms) const {
+	// blocks cannot flip tiles, so only exact duplicates are remapped
+	size_t n = 0;
+	for (size_t i = 0; i < ms.size(); i++) {
+		Metatile *mt = ms.metatile((uint8_t)i);
+		for (int y = 0; y < METATILE_SIZE; y++) {
+			for (int x = 0; x < METATILE_SIZE; x++) {
+				uint8_t id = mt->tile_id(x, y);
+				if (duplicate(id) && _flips[id] == Flip::NO_FLIP) {
+					mt->tile_id(x, y, _originals[id]);
+					n++;
+				}
+			}
+		}
+	}
+	if (n) { ms.modified(true); }
+	return n;
+}
+
+bool Tile_Index::indexable(uint8_t id) {
+	// roof tiles get swapped out per map group, so they must keep their IDs
+	if (id >= FIRST_ROOF_TILE_ID && id < FIRST_ROOF_TILE_ID + NUM_ROOF_TILES) { return false; }
+	if (!Config::allow_256_tiles() && ((id >= 0x60 && id < 0x80) || id >= 0xE0)) { return false; }
+	return true;
+}
@@ -0,0 +1,48 @@
+#ifndef TILE_INDEX_H
+#define TILE_INDEX_H
+
+#include <unordered_map>
+
+#include "utils.h"
+#include "tile.h"
+#include "tileset.h"
+#include "metatileset.h"
+
+enum Flip { NO_FLIP, X_FLIP, Y_FLIP, XY_FLIP };
+
+class Tile_Index {
+private:
+	struct Tile_Key {
+		uint64_t hi, lo;
+		Palette palette;
+		inline bool operator==(const Tile_Key &k) const { return hi == k.hi && lo == k.lo && palette == k.palette; }
+	};
+	struct Tile_Key_Hash {
+		size_t operator()(const Tile_Key &k) const;
+	};
+	struct Entry {
+		uint8_t id;
+		Flip flip;
+	};
+	std::unordered_map<Tile_Key, Entry, Tile_Key_Hash> _exact, _canonical;
+	// the earlier tile each tile duplicates, and the flip relating them
+	uint8_t _originals[MAX_NUM_TILES];
+	Flip _flips[MAX_NUM_TILES];
+	size_t _num_exact, _num_flipped;
+public:
+	Tile_Index();
+	void clear(void);
+	void add(const Tile *t);
+	void add_tileset(const Tileset &ts);
+	inline bool duplicate(uint8_t id) const { return _originals[id] != id; }
+	inline uint8_t original(uint8_t id) const { return _originals[id]; }
+	inline Flip flip(uint8_t id) const { return _flips[id]; }
+	inline size_t num_exact(void) const { return _num_exact; }
+	inline size_t num_flipped(void) const { return _num_flipped; }
+	size_t remap(Metatileset &ms) const;
+	static bool indexable(uint8_t id);
+private:
+	static Tile_Key key(const Tile *t, Flip f);
+};
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "utils.h"
 #include "tile.h"
+#include "perf.h"
 
 // 8x8 translucent zigzag pattern for tile priority
 static uchar small_priority_png_buffer[119] = {
@@ -51,54 +52,73 @@ static uchar chip_priority_png_buffer[158] = {
 
 static Fl_PNG_Image chip_priority_png(NULL, chip_priority_png_buffer, 158);
 
-Tile::Tile(uint8_t id) : _id(id), _palette(Palette::UNDEFINED), _hues(), _rgb() {}
+Tile::Tile(uint8_t id) : _id(id), _palette(Palette::UNDEFINED), _hues(), _lighting(Lighting::DAY), _rgb(),
+	_lit(0) {}
 
 void Tile::pixel(int x, int y, Hue h, uchar r, uchar g, uchar b) {
 	_hues[y * TILE_SIZE + x] = h;
+	_lit = 1 << _lighting; // the other lightings are now stale
+	uchar *rgb = _rgb[_lighting];
 	int i = (y * LINE_BYTES + x * NUM_CHANNELS) * ZOOM_FACTOR;
 	// red
-	_rgb[i] = r;
-	_rgb[i + NUM_CHANNELS] = r;
-	_rgb[i + LINE_BYTES] = r;
-	_rgb[i + LINE_BYTES + NUM_CHANNELS] = r;
+	rgb[i] = r;
+	rgb[i + NUM_CHANNELS] = r;
+	rgb[i + LINE_BYTES] = r;
+	rgb[i + LINE_BYTES + NUM_CHANNELS] = r;
 	i++;
 	// green
-	_rgb[i] = g;
-	_rgb[i + NUM_CHANNELS] = g;
-	_rgb[i + LINE_BYTES] = g;
-	_rgb[i + LINE_BYTES + NUM_CHANNELS] = g;
+	rgb[i] = g;
+	rgb[i + NUM_CHANNELS] = g;
+	rgb[i + LINE_BYTES] = g;
+	rgb[i + LINE_BYTES + NUM_CHANNELS] = g;
 	i++;
 	// blue
-	_rgb[i] = b;
-	_rgb[i + NUM_CHANNELS] = b;
-	_rgb[i + LINE_BYTES] = b;
-	_rgb[i + LINE_BYTES + NUM_CHANNELS] = b;
+	rgb[i] = b;
+	rgb[i + NUM_CHANNELS] = b;
+	rgb[i + LINE_BYTES] = b;
+	rgb[i + LINE_BYTES + NUM_CHANNELS] = b;
 }
 
 void Tile::clear() {
 	FILL(_hues, Hue::WHITE, TILE_SIZE * TILE_SIZE);
-	FILL(_rgb, 0xff, LINE_PX * LINE_PX * NUM_CHANNELS);
+	FILL(_rgb[_lighting], 0xff, TILE_RGB_BYTES);
+	_lit = 0;
 }
 
 void Tile::copy(const Tile *t) {
 	_palette = t->_palette;
 	memcpy(_hues, t->_hues, TILE_SIZE * TILE_SIZE * sizeof(Hue));
-	memcpy(_rgb, t->_rgb, LINE_PX * LINE_PX * NUM_CHANNELS);
+	_lighting = t->_lighting;
+	_lit = t->_lit;
+	for (int l = 0; l < NUM_LIGHTINGS; l++) {
+		if (_lit & (1 << l) || l == _lighting) {
+			memcpy(_rgb[l], t->_rgb[l], TILE_RGB_BYTES);
+		}
+	}
 }
 
-void Tile::update_lighting(Lighting l) {
+void Tile::update_lighting(Lighting l, const Palette_Colors *colors) {
+	_lighting = l;
+	if (_lit & (1 << l)) { Perf::count(Perf::LIGHTING_HITS); return; } // already rendered for this lighting
+	Perf::count(Perf::LIGHTING_MISSES);
+	uint8_t lit = _lit;
 	for (int ty = 0; ty < TILE_SIZE; ty++) {
 		for (int tx = 0; tx < TILE_SIZE; tx++) {
 			Hue h = hue(tx, ty);
-			const uchar *rgb = Color::color(l, _palette, h);
+			const uchar *rgb = colors ? Color::color(*colors, _palette, h) : Color::color(l, _palette, h);
 			pixel(tx, ty, h, rgb[0], rgb[1], rgb[2]);
 		}
 	}
+	_lit = lit | (1 << l);
 }
 
 void Tile::draw_with_priority(int x, int y, int s, bool show_priority) const {
-	const uchar *rgb = _rgb;
+	Perf_Scope scope("Tile::draw_with_priority");
+	const uchar *rgb = _rgb[_lighting];
 	show_priority &= priority();
+	Perf::count(Perf::TILES_DRAWN);
+	Perf::count(Perf::DRAW_IMAGE_CALLS);
+	Perf::count(Perf::PIXELS_UPLOADED, s * s);
 	if (s == CHIP_PX_SIZE) {
 		uchar chip[CHIP_PX_SIZE * CHIP_PX_SIZE * NUM_CHANNELS] = {};
 		for (int ty = 0; ty < TILE_SIZE; ty++) {
@@ -133,3 +153,16 @@ void Tile::draw_with_priority(int x, int y, int s, bool show_priority) const {
 		}
 	}
 }
+
+void Tile::draw_priority(int x, int y, int s) const {
+	if (!priority()) { return; }
+	if (s == CHIP_PX_SIZE) {
+		chip_priority_png.draw(x, y, CHIP_PX_SIZE, CHIP_PX_SIZE);
+	}
+	else if (s == TILE_PX_SIZE) {
+		large_priority_png.draw(x, y, TILE_PX_SIZE, TILE_PX_SIZE);
+	}
+	else {
+		small_priority_png.draw(x, y, TILE_SIZE, TILE_SIZE);
+	}
+}
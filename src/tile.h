@@ -23,28 +23,39 @@
 #define CHIP_PX_SIZE (TILE_SIZE * CHIP_ZOOM_FACTOR)
 #define CHIP_LINE_BYTES (CHIP_PX_SIZE * NUM_CHANNELS)
 
+#define TILE_RGB_BYTES (LINE_PX * LINE_BYTES)
+
 class Tile {
 protected:
 	uint8_t _id;
 	Palette _palette;
 	Hue _hues[TILE_SIZE * TILE_SIZE];
-	uchar _rgb[LINE_PX * LINE_PX * NUM_CHANNELS];
+	Lighting _lighting;
+	// one rendering per lighting, so switching lighting does not recolor
+	uchar _rgb[NUM_LIGHTINGS][TILE_RGB_BYTES];
+	// bitmask of lightings whose rendering matches the hues and palette
+	uint8_t _lit;
 public:
 	Tile(uint8_t id);
 	inline uint8_t id(void) const { return _id; }
 	inline void id(uint8_t id) { _id = id; }
 	inline Palette palette(void) const { return _palette; }
-	inline void palette(Palette p) { _palette = p; }
+	inline void palette(Palette p) { _palette = p; _lit = 0; }
+	inline Lighting lighting(void) const { return _lighting; }
 	inline bool priority(void) const { return _palette >= PRIORITY_GRAY; }
-	inline const uchar *rgb(void) const { return _rgb; }
+	inline const uchar *rgb(void) const { return _rgb[_lighting]; }
 	inline Hue hue(int x, int y) const { return _hues[y * TILE_SIZE + x]; }
-	inline uchar *pixel(int x, int y) { return _rgb + (y * LINE_BYTES + x * NUM_CHANNELS) * ZOOM_FACTOR; }
-	inline const uchar *const_pixel(int x, int y) const { return _rgb + (y * LINE_BYTES + x * NUM_CHANNELS) * ZOOM_FACTOR; }
+	inline void hue(int x, int y, Hue h) { _hues[y * TILE_SIZE + x] = h; _lit = 0; }
+	inline bool same_hues(const Tile *t) const { return !memcmp(_hues, t->_hues, sizeof(_hues)); }
+	inline uchar *pixel(int x, int y) { return _rgb[_lighting] + (y * LINE_BYTES + x * NUM_CHANNELS) * ZOOM_FACTOR; }
+	inline const uchar *const_pixel(int x, int y) const { return _rgb[_lighting] + (y * LINE_BYTES + x * NUM_CHANNELS) * ZOOM_FACTOR; }
 	void pixel(int x, int y, Hue h, uchar r, uchar g, uchar b);
 	void clear(void);
 	void copy(const Tile *t);
-	void update_lighting(Lighting l);
+	void update_lighting(Lighting l, const Palette_Colors *colors = NULL);
+	inline void invalidate_lighting(void) { _lit = 0; }
 	void draw_with_priority(int x, int y, int s, bool show_priority) const;
+	void draw_priority(int x, int y, int s) const;
 };
 
 #endif
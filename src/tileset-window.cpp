@@ -25,14 +25,16 @@ int Tile_Window::handle(int event) {
 }
 
 Tileset_Window::Tileset_Window(int x, int y) : _dx(x), _dy(y), _tileset(NULL), _canceled(false), _show_priority(false),
-	_window(NULL), _tileset_heading(NULL), _tile_heading(NULL), _tileset_group(NULL), _tile_group(NULL),
+	_window(NULL), _tileset_heading(NULL), _tile_heading(NULL), _usage(NULL), _tileset_group(NULL), _tile_group(NULL),
 	_deep_tile_buttons(), _selected(NULL), _pixels(), _swatch1(NULL), _swatch2(NULL), _swatch3(NULL), _swatch4(NULL),
-	_chosen(NULL), _palette(NULL), _priority(NULL), _ok_button(NULL), _cancel_button(NULL), _copied(false), _clipboard(0) {}
+	_chosen(NULL), _palette(NULL), _priority(NULL), _ok_button(NULL), _cancel_button(NULL), _copied(false), _clipboard(0),
+	_tile_index(), _usage_index(NULL), _dependencies(NULL) {}
 
 Tileset_Window::~Tileset_Window() {
 	delete _window;
 	delete _tileset_heading;
 	delete _tile_heading;
+	delete _usage;
 	delete _tileset_group;
 	delete _tile_group;
 	delete _swatch1;
@@ -66,6 +68,7 @@ void Tileset_Window::initialize() {
 	int off = text_width("Color:", 3);
 	_palette = new Dropdown(278 + off, 192, 146 - off, 22, "Color:");
 	_priority = new OS_Check_Button(278, 218, 178, 22, "Priority (above sprites)");
+	_usage = new Label(278, 244, 178, 22);
 	_ok_button = new Default_Button(282, 272, 80, 22, "OK");
 	_cancel_button = new OS_Button(376, 272, 80, 22, "Cancel");
 	_window->end();
@@ -142,9 +145,6 @@ void Tileset_Window::tileset(Tileset *t) {
 		_tileset_heading->label(NULL);
 		return;
 	}
-	std::string label("Tileset: ");
-	label = label + t->name();
-	_tileset_heading->copy_label(label.c_str());
 	for (int i = 0; i < MAX_NUM_TILES; i++) {
 		const Tile *t = _tileset->const_tile((uint8_t)i);
 		_deep_tile_buttons[i]->copy(t);
@@ -175,6 +175,11 @@ void Tileset_Window::tileset(Tileset *t) {
 	}
 }
 
+void Tileset_Window::usage(const Usage_Index *u, const Dependency_Index *d) {
+	_usage_index = u;
+	_dependencies = d;
+}
+
 void Tileset_Window::show(const Fl_Widget *p, bool show_priority) {
 	initialize();
 	refresh();
@@ -192,12 +197,16 @@ void Tileset_Window::draw_tile(int x, int y, uint8_t id) const {
 	t->draw_with_priority(x, y, TILE_PX_SIZE, _show_priority);
 }
 
-void Tileset_Window::apply_modifications() {
+void Tileset_Window::apply_modifications(std::vector<uint8_t> &changed) {
 	Palette_Map &palette_map = _tileset->palette_map();
 	for (int i = 0; i < MAX_NUM_TILES; i++) {
 		const Tile *t = _deep_tile_buttons[i];
 		uint8_t id = (uint8_t)i;
-		_tileset->tile(id)->copy(t);
+		Tile *tt = _tileset->tile(id);
+		if (tt->palette() != t->palette() || !tt->same_hues(t)) {
+			changed.push_back(id);
+		}
+		tt->copy(t);
 		palette_map.palette(id, t->palette());
 		Tile *rt = _tileset->roof_tile(id);
 		if (rt) {
@@ -212,9 +221,8 @@ void Tileset_Window::select(Deep_Tile_Button *dtb) {
 	_selected = dtb;
 	_selected->setonly();
 
-	char buffer[32];
-	sprintf(buffer, "Tile: $%02X", _selected->id());
-	_tile_heading->copy_label(buffer);
+	update_duplicates();
+	update_usage();
 
 	Lighting l = _tileset->lighting();
 	Palette p = _selected->palette();
@@ -239,6 +247,65 @@ void Tileset_Window::select(Deep_Tile_Button *dtb) {
 	}
 }
 
+void Tileset_Window::update_duplicates() {
+	_tile_index.clear();
+	for (int i = 0; i < MAX_NUM_TILES; i++) {
+		const Deep_Tile_Button *dtb = _deep_tile_buttons[i];
+		if (dtb->palette() == Palette::UNDEFINED || !Tile_Index::indexable(dtb->id())) { continue; }
+		_tile_index.add(dtb);
+	}
+
+	std::string label("Tileset: ");
+	label = label + _tileset->name();
+	size_t n = _tile_index.num_exact() + _tile_index.num_flipped();
+	if (n) {
+		label = label + " (" + std::to_string(n) + (n == 1 ? " duplicate)" : " duplicates)");
+	}
+	_tileset_heading->copy_label(label.c_str());
+
+	if (!_selected) { return; }
+	char buffer[32];
+	uint8_t id = _selected->id();
+	if (_tile_index.duplicate(id)) {
+		static const char *flips[] = {"", " X", " Y", " XY"};
+		sprintf(buffer, "Tile: $%02X = $%02X%s", id, _tile_index.original(id), flips[_tile_index.flip(id)]);
+	}
+	else {
+		sprintf(buffer, "Tile: $%02X", id);
+	}
+	_tile_heading->copy_label(buffer);
+}
+
+void Tileset_Window::update_usage() {
+	// Count the project's maps whose blocks show the selected tile
+	if (!_selected || !_usage_index || !_dependencies) {
+		_usage->label(NULL);
+		_usage->copy_tooltip(NULL);
+		return;
+	}
+	std::vector<uint8_t> mids = _dependencies->metatiles_using(std::vector<uint8_t>(1, _selected->id()));
+	std::vector<Map_Usage> uses;
+	size_t total = _usage_index->usage(_tileset->name(), mids, uses);
+	if (uses.empty()) {
+		_usage->copy_label(mids.empty() ? "Not used by any blocks" : "Not used by any maps");
+		_usage->copy_tooltip(NULL);
+		return;
+	}
+	std::string label = "Used in " + std::to_string(uses.size()) + (uses.size() == 1 ? " map (" : " maps (") +
+		std::to_string(total) + (total == 1 ? " cell)" : " cells)");
+	_usage->copy_label(label.c_str());
+	std::string tip;
+	size_t shown = uses.size() > BLOCK_USAGE_LINES ? BLOCK_USAGE_LINES - 1 : uses.size();
+	for (size_t i = 0; i < shown; i++) {
+		const Map_Usage &u = uses[i];
+		tip = tip + (i ? "\n" : "") + _usage_index->map(u.map).label + ": " + std::to_string(u.count);
+	}
+	if (shown < uses.size()) {
+		tip = tip + "\n(and " + std::to_string(uses.size() - shown) + " more)";
+	}
+	_usage->copy_tooltip(tip.c_str());
+}
+
 void Tileset_Window::choose(Swatch *swatch) {
 	_chosen = swatch;
 	_chosen->setonly();
@@ -283,6 +350,7 @@ void Tileset_Window::palette(Palette p) {
 	_swatch3->coloring(l, p, Hue::DARK);
 	_swatch4->coloring(l, p, Hue::BLACK);
 	_selected->copy_pixels(_pixels);
+	update_duplicates();
 	_window->redraw();
 }
 
@@ -332,6 +400,7 @@ void Tileset_Window::change_pixel_cb(Pixel_Button *pb, Tileset_Window *tw) {
 			tw->_selected->copy_pixel(pb);
 			tw->_selected->redraw();
 		}
+		tw->update_duplicates();
 	}
 	else if (Fl::event_button() == FL_RIGHT_MOUSE) {
 		// Right-click to choose
@@ -381,6 +450,7 @@ void Tileset_Window::swap_tiles_cb(Fl_Widget *, Tileset_Window *tw) {
 	temp.copy(tw->_selected);
 	tw->_selected->copy(copied);
 	copied->copy(&temp);
+	tw->update_duplicates();
 	tw->_window->redraw();
 }
 
@@ -2,6 +2,7 @@
 #define TILESET_WINDOW_H
 
 #include <string>
+#include <vector>
 
 #pragma warning(push, 0)
 #include <FL/Fl_Double_Window.H>
@@ -14,6 +15,9 @@
 #include "metatile.h"
 #include "widgets.h"
 #include "block-window.h"
+#include "tile-index.h"
+#include "dependency-index.h"
+#include "usage-index.h"
 
 #define PIXEL_ZOOM_FACTOR 18
 #define ZOOMED_TILE_PX_SIZE (TILE_SIZE * PIXEL_ZOOM_FACTOR)
@@ -31,7 +35,7 @@ private:
 	bool _canceled;
 	bool _show_priority;
 	Tile_Window *_window;
-	Label *_tileset_heading, *_tile_heading;
+	Label *_tileset_heading, *_tile_heading, *_usage;
 	Fl_Group *_tileset_group, *_tile_group;
 	Deep_Tile_Button *_deep_tile_buttons[MAX_NUM_TILES], *_selected;
 	Pixel_Button *_pixels[TILE_SIZE * TILE_SIZE];
@@ -43,6 +47,9 @@ private:
 	friend class Tile_Window;
 	bool _copied;
 	Tile _clipboard;
+	Tile_Index _tile_index;
+	const Usage_Index *_usage_index;
+	const Dependency_Index *_dependencies;
 public:
 	Tileset_Window(int x, int y);
 	~Tileset_Window();
@@ -51,13 +58,16 @@ private:
 	void refresh(void);
 public:
 	void tileset(Tileset *t);
+	void usage(const Usage_Index *u, const Dependency_Index *d);
 	inline bool canceled(void) const { return _canceled; }
 	inline void canceled(bool c) { _canceled = c; }
 	inline bool show_priority(void) const { return _show_priority; }
 	void show(const Fl_Widget *p, bool show_priority);
 	void draw_tile(int x, int y, uint8_t id) const;
-	void apply_modifications(void);
+	void apply_modifications(std::vector<uint8_t> &changed);
 	void select(Deep_Tile_Button *dtb);
+	void update_duplicates(void);
+	void update_usage(void);
 	void choose(Swatch *swatch);
 	void flood_fill(Pixel_Button *pb, Hue f, Hue t);
 	void substitute_hue(Hue f, Hue t);
@@ -2,7 +2,7 @@
 #include "tileset.h"
 #include "image.h"
 
-Tileset::Tileset() : _name(), _lighting(), _palette_map(), _tiles(), _num_tiles(0), _num_roof_tiles(0),
+Tileset::Tileset() : _name(), _lighting(), _colors(NULL), _palette_map(), _tiles(), _num_tiles(0), _num_roof_tiles(0),
 	_result(GFX_NULL), _modified(false), _modified_roof(false) {
 	for (size_t i = 0; i < MAX_NUM_TILES; i++) {
 		_tiles[i] = new Tile((uint8_t)i);
@@ -43,32 +43,40 @@ void Tileset::update_lighting(Lighting l) {
 	bool allow_256_tiles = Config::allow_256_tiles();
 	for (int i = 0; i < MAX_NUM_TILES; i++) {
 		int j = (!allow_256_tiles && i >= 0x60) ? (i >= 0xE0 ? i - 0x80 : i + 0x20) : i;
-		_tiles[j]->update_lighting(l);
-		_roof_tiles[j]->update_lighting(l);
+		_tiles[j]->update_lighting(l, _colors);
+		_roof_tiles[j]->update_lighting(l, _colors);
 	}
 }
 
-uchar *Tileset::print_rgb(size_t w, size_t h, size_t n) const {
-	uchar *buffer = new uchar[w * h * NUM_CHANNELS]();
-	FILL(buffer, 0xff, w * h * NUM_CHANNELS);
+void Tileset::invalidate_lighting() {
+	for (int i = 0; i < MAX_NUM_TILES; i++) {
+		_tiles[i]->invalidate_lighting();
+		_roof_tiles[i]->invalidate_lighting();
+	}
+}
+
+uchar *Tileset::print_gray(size_t w, size_t h, size_t n) const {
+	// one 2-bit gray level (0 = black, 3 = white) per byte
+	uchar *buffer = new uchar[w * h]();
+	FILL(buffer, 3, w * h);
 	bool allow_256_tiles = Config::allow_256_tiles();
 	for (size_t i = 0; i < n; i++) {
 		if (!allow_256_tiles && i == 0x60) { i += 0x1f; continue; }
 		const Tile *t = _tiles[i];
 		int ty = (i / TILES_PER_ROW) * TILE_SIZE, tx = (i % TILES_PER_ROW) * TILE_SIZE;
 		if (!allow_256_tiles && i >= 0x80) { ty -= 2 * TILE_SIZE; }
-		print_tile_rgb(t, tx, ty, TILES_PER_ROW, buffer);
+		print_tile_gray(t, tx, ty, TILES_PER_ROW, buffer);
 	}
 	return buffer;
 }
 
-uchar *Tileset::print_roof_rgb(size_t w, size_t h) const {
-	uchar *buffer = new uchar[w * h * NUM_CHANNELS]();
-	FILL(buffer, 0xff, w * h * NUM_CHANNELS);
+uchar *Tileset::print_roof_gray(size_t w, size_t h) const {
+	uchar *buffer = new uchar[w * h]();
+	FILL(buffer, 3, w * h);
 	for (size_t i = 0; i < NUM_ROOF_TILES; i++) {
 		const Tile *t = _roof_tiles[i + FIRST_ROOF_TILE_ID];
 		int ty = (i / ROOF_TILES_PER_ROW) * TILE_SIZE, tx = (i % ROOF_TILES_PER_ROW) * TILE_SIZE;
-		print_tile_rgb(t, tx, ty, ROOF_TILES_PER_ROW, buffer);
+		print_tile_gray(t, tx, ty, ROOF_TILES_PER_ROW, buffer);
 	}
 	return buffer;
 }
@@ -78,28 +86,24 @@ void Tileset::read_tile(Tile *t, const Tiled_Image &ti, uint8_t i, size_t j) {
 	t->palette(p);
 	for (int ty = 0; ty < TILE_SIZE; ty++) {
 		for (int tx = 0; tx < TILE_SIZE; tx++) {
-			Hue h = ti.tile_hue(j, tx, ty);
-			const uchar *rgb = Color::color(_lighting, p, h);
-			t->pixel(tx, ty, h, rgb[0], rgb[1], rgb[2]);
+			t->hue(tx, ty, ti.tile_hue(j, tx, ty));
 		}
 	}
+	t->update_lighting(_lighting, _colors);
 }
 
-void Tileset::print_tile_rgb(const Tile *t, int tx, int ty, int n, uchar *buffer) const {
+void Tileset::print_tile_gray(const Tile *t, int tx, int ty, int n, uchar *buffer) const {
 	for (int py = 0; py < TILE_SIZE; py++) {
 		for (int px = 0; px < TILE_SIZE; px++) {
 			Hue h = t->hue(px, py);
 			uchar c;
 			switch (h) {
-			case Hue::BLACK: c = 0x00; break;
-			case Hue::DARK:  c = 0x55; break;
-			case Hue::LIGHT: c = 0xAA; break;
-			case Hue::WHITE: default: c = 0xFF;
+			case Hue::BLACK: c = 0; break;
+			case Hue::DARK:  c = 1; break;
+			case Hue::LIGHT: c = 2; break;
+			case Hue::WHITE: default: c = 3;
 			}
-			size_t j = ((ty + py) * n * TILE_SIZE + tx + px) * NUM_CHANNELS;
-			buffer[j++] = c;
-			buffer[j++] = c;
-			buffer[j] = c;
+			buffer[(ty + py) * n * TILE_SIZE + tx + px] = c;
 		}
 	}
 }
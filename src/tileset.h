@@ -23,6 +23,8 @@ public:
 private:
 	std::string _name, _roof_name;
 	Lighting _lighting;
+	// Tiles are colored from here instead of the current lighting's colors, if set
+	const Palette_Colors *_colors;
 	Palette_Map _palette_map;
 	Tile *_tiles[MAX_NUM_TILES], *_roof_tiles[MAX_NUM_TILES];
 	size_t _num_tiles, _num_roof_tiles;
@@ -37,6 +39,7 @@ public:
 	inline void roof_name(const char *m) { _roof_name = m ? m : ""; }
 	inline bool has_roof(void) const { return !_roof_name.empty(); }
 	inline Lighting lighting(void) const { return _lighting; }
+	inline void colors(const Palette_Colors *c) { _colors = c; }
 	inline Palette_Map &palette_map(void) { return _palette_map; }
 	inline Tile *tile(uint8_t i) { return _tiles[i]; }
 	inline Tile *roof_tile(uint8_t i) { return _roof_tiles[i]; }
@@ -54,13 +57,14 @@ public:
 	inline void modified_roof(bool m) { _modified_roof = m; }
 private:
 	void read_tile(Tile *t, const Tiled_Image &ti, uint8_t i, size_t j);
-	void print_tile_rgb(const Tile *t, int tx, int ty, int n, uchar *buffer) const;
+	void print_tile_gray(const Tile *t, int tx, int ty, int n, uchar *buffer) const;
 public:
 	void clear(void);
 	void clear_roof_graphics(void);
 	void update_lighting(Lighting l);
-	uchar *print_rgb(size_t w, size_t h, size_t n) const;
-	uchar *print_roof_rgb(size_t w, size_t h) const;
+	void invalidate_lighting(void);
+	uchar *print_gray(size_t w, size_t h, size_t n) const;
+	uchar *print_roof_gray(size_t w, size_t h) const;
 	inline Palette_Map::Result read_palette_map(const char *f) { return _palette_map.read_from(f); }
 	Result read_graphics(const char *f, Lighting l);
 	Result read_roof_graphics(const char *f);
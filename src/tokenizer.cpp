@@ -0,0 +1,83 @@
+#include <climits>
+#include <cstring>
+
+#include "tokenizer.h"
+
+static inline bool is_whitespace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool Token::operator==(const char *s) const {
+	// strncmp would stop early at a NUL inside the token and then read past s
+	return strlen(s) == _size && !memcmp(_data, s, _size);
+}
+
+bool Token::starts_with(const char *p) const {
+	size_t n = strlen(p);
+	return n <= _size && !memcmp(_data, p, n);
+}
+
+void Token::skip(size_t n) {
+	n = MIN(n, _size);
+	_data += n;
+	_size -= n;
+}
+
+void Token::trim() {
+	while (_size && is_whitespace(*_data)) { _data++; _size--; }
+	while (_size && is_whitespace(_data[_size-1])) { _size--; }
+}
+
+void Token::remove_comment(char c) {
+	const char *p = (const char *)memchr(_data, c, _size);
+	if (p) { _size = (size_t)(p - _data); }
+}
+
+bool Token::split(char sep, Token &field) {
+	// Take the text before the next separator (or all the rest) as the field,
+	// like std::getline
+	if (!_size) { return false; }
+	const char *p = (const char *)memchr(_data, sep, _size);
+	size_t n = p ? (size_t)(p - _data) : _size;
+	field = Token(_data, n);
+	skip(p ? n + 1 : n);
+	return true;
+}
+
+bool Token::split_word(Token &word) {
+	// Take the first run of non-whitespace characters, like operator>> does
+	trim();
+	if (!_size) { return false; }
+	size_t n = 0;
+	while (n < _size && !is_whitespace(_data[n])) { n++; }
+	word = Token(_data, n);
+	skip(n);
+	return true;
+}
+
+bool Token::to_uint(unsigned int &v) const {
+	if (!_size) { return false; }
+	unsigned int n = 0;
+	for (size_t i = 0; i < _size; i++) {
+		char c = _data[i];
+		if (c < '0' || c > '9') { return false; }
+		unsigned int d = (unsigned int)(c - '0');
+		if (n > (UINT_MAX - d) / 10) { return false; } // overflow
+		n = n * 10 + d;
+	}
+	v = n;
+	return true;
+}
+
+Tokenizer::Tokenizer(const uchar *data, size_t n) : _p((const char *)data), _end((const char *)data + n) {}
+
+bool Tokenizer::next_line(Token &line) {
+	if (_p >= _end) { return false; }
+	const char *nl = (const char *)memchr(_p, '\n', (size_t)(_end - _p));
+	const char *end = nl ? nl : _end;
+	size_t n = (size_t)(end - _p);
+	if (n && end[-1] == '\r') { n--; }
+	line = Token(_p, n);
+	_p = nl ? nl + 1 : _end;
+	return true;
+}
@@ -0,0 +1,46 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <string>
+
+#pragma warning(push, 0)
+#include <FL/fl_types.h>
+#pragma warning(pop)
+
+#include "utils.h"
+
+// A run of characters inside a larger buffer, which is neither copied nor
+// NUL-terminated (like C++17's std::string_view)
+class Token {
+private:
+	const char *_data;
+	size_t _size;
+public:
+	inline Token() : _data(NULL), _size(0) {}
+	inline Token(const char *d, size_t n) : _data(d), _size(n) {}
+	inline const char *data(void) const { return _data; }
+	inline size_t size(void) const { return _size; }
+	inline bool empty(void) const { return !_size; }
+	inline char operator[](size_t i) const { return _data[i]; }
+	inline std::string str(void) const { return std::string(_data, _size); }
+	bool operator==(const char *s) const;
+	inline bool operator!=(const char *s) const { return !(*this == s); }
+	bool starts_with(const char *p) const;
+	void skip(size_t n);
+	void trim(void);
+	void remove_comment(char c = ';');
+	bool split(char sep, Token &field);
+	bool split_word(Token &word);
+	bool to_uint(unsigned int &v) const;
+};
+
+// Splits a buffer (usually a Mapped_File) into lines without copying them
+class Tokenizer {
+private:
+	const char *_p, *_end;
+public:
+	Tokenizer(const uchar *data, size_t n);
+	bool next_line(Token &line);
+};
+
+#endif
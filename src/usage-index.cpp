@@ -0,0 +1,126 @@
+#include <cstring>
+#include <algorithm>
+
+#pragma warning(push, 0)
+#include <FL/filename.H>
+#pragma warning(pop)
+
+#include "parallel.h"
+#include "mapped-file.h"
+#include "usage-index.h"
+
+static bool more_uses(const Map_Usage &a, const Map_Usage &b) {
+	return a.count > b.count;
+}
+
+Usage_Index::Usage_Index() : _directory(), _catalog(), _maps(), _tilesets() {}
+
+void Usage_Index::clear() {
+	_directory.clear();
+	_catalog.clear();
+	_maps.clear();
+	_tilesets.clear();
+}
+
+struct Count_Job {
+	std::vector<Indexed_Map> *maps;
+	const std::vector<size_t> *stale;
+};
+
+void Usage_Index::count_map(size_t i, void *data) {
+	Count_Job *job = (Count_Job *)data;
+	Indexed_Map &m = (*job->maps)[(*job->stale)[i]];
+	std::fill(m.counts, m.counts + MAX_NUM_METATILES, 0);
+	Mapped_File file(m.blk_file.c_str());
+	if (!file.is_open()) { return; }
+	const uchar *ids = file.data();
+	for (size_t j = 0, n = MIN(file.size(), m.area); j < n; j++) {
+		m.counts[ids[j]]++;
+	}
+}
+
+size_t Usage_Index::update(const char *directory) {
+	// Only maps that are new or changed since the last update are counted
+	if (_directory != directory) { clear(); }
+	_directory = directory;
+	if (_catalog.directory() != _directory || _catalog.sources_changed()) {
+		_catalog.read_catalog(directory);
+	}
+	std::unordered_map<std::string, size_t> previous;
+	for (size_t i = 0; i < _maps.size(); i++) {
+		previous.emplace(_maps[i].blk_file, i);
+	}
+
+	size_t n = _catalog.size();
+	std::vector<Indexed_Map> maps(n);
+	std::vector<size_t> stale;
+	for (size_t i = 0; i < n; i++) {
+		const World_Map_Entry &e = _catalog.map(i);
+		Indexed_Map &m = maps[i];
+		m.label = e.label;
+		m.blk_file = e.blk_file;
+		if (e.tileset != NO_WORLD_TILESET) { m.tileset = _catalog.tileset(e.tileset).name; }
+		m.modified = file_modified(m.blk_file.c_str());
+		m.size = file_size(m.blk_file.c_str());
+		m.area = (size_t)e.width * e.height;
+		auto it = previous.find(m.blk_file);
+		if (it != previous.end() && _maps[it->second].modified == m.modified && _maps[it->second].size == m.size &&
+			_maps[it->second].area == m.area) {
+			std::copy(_maps[it->second].counts, _maps[it->second].counts + MAX_NUM_METATILES, m.counts);
+		}
+		else {
+			stale.push_back(i);
+		}
+	}
+	Count_Job job = {&maps, &stale};
+	parallel_for(stale.size(), count_map, &job);
+
+	_maps.swap(maps);
+	_tilesets.clear();
+	for (size_t i = 0; i < _maps.size(); i++) {
+		if (!_maps[i].tileset.empty()) { _tilesets[_maps[i].tileset].push_back(i); }
+	}
+	return stale.size();
+}
+
+void Usage_Index::recount(const char *blk_file, const Map &map) {
+	// Count the open map's blocks from memory, since it may have unsaved changes
+	char absolute[FL_PATH_MAX] = {};
+	for (Indexed_Map &m : _maps) {
+		fl_filename_absolute(absolute, m.blk_file.c_str());
+		if (strcmp(absolute, blk_file)) { continue; }
+		std::fill(m.counts, m.counts + MAX_NUM_METATILES, 0);
+		std::vector<uint8_t> ids(map.size());
+		map.copy_ids(ids.data());
+		for (uint8_t id : ids) {
+			m.counts[id]++;
+		}
+		// Count the file again next time, in case the changes are not saved
+		m.modified = 0;
+		return;
+	}
+}
+
+const std::vector<size_t> &Usage_Index::maps_using(const char *tileset) const {
+	static const std::vector<size_t> none;
+	auto it = _tilesets.find(tileset);
+	return it != _tilesets.end() ? it->second : none;
+}
+
+size_t Usage_Index::usage(const char *tileset, const std::vector<uint8_t> &ids, std::vector<Map_Usage> &uses) const {
+	// List the maps with the tileset that use any of the blocks, most uses first, and return the total
+	uses.clear();
+	size_t total = 0;
+	for (size_t i : maps_using(tileset)) {
+		size_t count = 0;
+		for (uint8_t id : ids) {
+			count += _maps[i].counts[id];
+		}
+		if (!count) { continue; }
+		Map_Usage u = {i, count};
+		uses.push_back(u);
+		total += count;
+	}
+	std::stable_sort(uses.begin(), uses.end(), more_uses);
+	return total;
+}
@@ -0,0 +1,56 @@
+#ifndef USAGE_INDEX_H
+#define USAGE_INDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "utils.h"
+#include "metatileset.h"
+#include "map.h"
+#include "world-map.h"
+
+// Usage lists show at most this many maps
+#define BLOCK_USAGE_LINES 20
+
+struct Indexed_Map {
+	std::string label, blk_file, tileset;
+	// A map is counted again when its .blk file's size or modification time, or its area, changes
+	int64_t modified;
+	size_t size;
+	// Only the first width * height bytes of the .blk file are blocks;
+	// maps of unknown size are not counted
+	size_t area;
+	// How many cells show each block
+	uint32_t counts[MAX_NUM_METATILES];
+};
+
+struct Map_Usage {
+	size_t map;
+	size_t count;
+};
+
+// How many times every .blk file in a project uses each block of its tileset
+class Usage_Index {
+private:
+	std::string _directory;
+	// Read again only when the directory or the files it was read from change
+	World_Map _catalog;
+	std::vector<Indexed_Map> _maps;
+	// The maps using each tileset
+	std::unordered_map<std::string, std::vector<size_t>> _tilesets;
+public:
+	Usage_Index(void);
+	inline size_t size(void) const { return _maps.size(); }
+	inline const Indexed_Map &map(size_t i) const { return _maps[i]; }
+	inline const char *directory(void) const { return _directory.c_str(); }
+	void clear(void);
+	size_t update(const char *directory);
+	void recount(const char *blk_file, const Map &map);
+	const std::vector<size_t> &maps_using(const char *tileset) const;
+	size_t usage(const char *tileset, const std::vector<uint8_t> &ids, std::vector<Map_Usage> &uses) const;
+private:
+	static void count_map(size_t i, void *data);
+};
+
+#endif
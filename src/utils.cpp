@@ -1,7 +1,12 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <sys/stat.h>
 
 #ifdef _WIN32
 #include <io.h>
+#include <process.h>
 #else
 #include <unistd.h>
 #include <libgen.h>
@@ -11,6 +16,7 @@
 #pragma warning(push, 0)
 #include <FL/fl_draw.H>
 #include <FL/filename.H>
+#include <FL/fl_utf8.h>
 #pragma warning(pop)
 
 #include "utils.h"
@@ -63,3 +69,123 @@ size_t file_size(const char *f) {
 	int r = stat64(f, &s);
 	return r ? 0 : (size_t)s.st_size;
 }
+
+int64_t file_modified(const char *f) {
+	struct stat64 s;
+	int r = stat64(f, &s);
+	return r ? 0 : (int64_t)s.st_mtime;
+}
+
+bool replace_file(const char *src, const char *dest) {
+#ifdef _WIN32
+	// rename() will not overwrite an existing file on Windows; ReplaceFile
+	// swaps it in one step and keeps the original's attributes
+	wchar_t wsrc[FL_PATH_MAX] = {}, wdest[FL_PATH_MAX] = {};
+	fl_utf8towc(src, (unsigned int)strlen(src), wsrc, FL_PATH_MAX);
+	fl_utf8towc(dest, (unsigned int)strlen(dest), wdest, FL_PATH_MAX);
+	if (GetFileAttributesW(wdest) != INVALID_FILE_ATTRIBUTES &&
+		ReplaceFileW(wdest, wsrc, NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL)) {
+		return true;
+	}
+	return !!MoveFileExW(wsrc, wdest, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	return !fl_rename(src, dest);
+#endif
+}
+
+bool write_file_atomic(const char *f, const void *data, size_t n) {
+	// Write everything to a temporary file and then rename it over the
+	// destination, so a failed save never leaves a truncated file behind
+	std::string target(f);
+#ifndef _WIN32
+	// Replace a symlink's target instead of the link itself
+	if (char *resolved = realpath(f, NULL)) {
+		target = resolved;
+		free(resolved);
+	}
+#endif
+	// Each call writes its own temporary file, so threads or other instances
+	// saving the same file at once cannot write into each other's copy
+	static std::atomic<unsigned int> num_temps(0);
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = (int)getpid();
+#endif
+	std::string temp = target + "." + std::to_string(pid) + "-" + std::to_string(num_temps++) + ".tmp";
+	FILE *file = fl_fopen(temp.c_str(), "wb");
+	if (!file) { return false; }
+	setvbuf(file, NULL, _IONBF, 0); // one write, without copying through a stdio buffer
+	bool ok = !n || fwrite(data, 1, n, file) == n;
+	ok = !fclose(file) && ok;
+#ifndef _WIN32
+	// Keep the original file's permissions
+	struct stat s;
+	if (ok && !stat(target.c_str(), &s)) {
+		ok = !chmod(temp.c_str(), s.st_mode & 07777);
+	}
+#endif
+	if (!ok || !replace_file(temp.c_str(), target.c_str())) {
+		fl_unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+static bool is_name_char(char c) {
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+static const char *name_part_before(const char *f, const char *end) {
+	// Find the start of the [A-Za-z0-9_-]+ part ending at end, which must
+	// follow a dot with something before it
+	const char *p = end;
+	while (p > f && is_name_char(p[-1])) { p--; }
+	return p < end && p - f >= 2 && p[-1] == '.' ? p : NULL;
+}
+
+static bool parse_dimension(const char *&p, const char *end, uint16_t &n) {
+	uint32_t v = 0;
+	const char *start = p;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		v = v * 10 + (uint32_t)(*p - '0');
+		if (v > 0xFFFF) { return false; }
+	}
+	n = (uint16_t)v;
+	return p > start && v > 0;
+}
+
+static bool parse_dimensions(const char *p, const char *end, Blk_Name &bn) {
+	uint16_t w, h;
+	if (!parse_dimension(p, end, w) || p == end || *p++ != 'x' || !parse_dimension(p, end, h) || p != end) {
+		return false;
+	}
+	bn.width = w;
+	bn.height = h;
+	return true;
+}
+
+bool parse_blk_name(const char *f, Blk_Name &bn) {
+	// Scan backwards from the extension, taking the last name part as the
+	// tileset and whichever of the last two parts is "WxH" as the dimensions
+	bn.dimensions = bn.tileset = NULL;
+	bn.tileset_length = 0;
+	bn.width = bn.height = 0;
+	size_t n = strlen(f);
+	if (n < 4) { return false; }
+	const char *ext = f + n - 4;
+	if (ext[0] != '.' || (ext[1] | 0x20) != 'b' || (ext[2] | 0x20) != 'l' || (ext[3] | 0x20) != 'k') { return false; }
+	const char *last = name_part_before(f, ext);
+	if (!last) { return true; }
+	bn.tileset = last;
+	bn.tileset_length = (size_t)(ext - last);
+	if (parse_dimensions(last, ext, bn)) {
+		bn.dimensions = last;
+		return true;
+	}
+	const char *prev = name_part_before(f, last - 1);
+	if (prev && parse_dimensions(prev, last - 1, bn)) {
+		bn.dimensions = prev;
+	}
+	return true;
+}
@@ -81,5 +81,18 @@ int text_width(const char *l, int pad);
 int text_width(const char *l, int pad = 0);
 bool file_exists(const char *f);
 size_t file_size(const char *f);
+int64_t file_modified(const char *f);
+bool replace_file(const char *src, const char *dest);
+bool write_file_atomic(const char *f, const void *data, size_t n);
+
+// The optional ".WxH" and ".tileset" suffixes of a "MapName.WxH.tileset.blk"
+// filename, pointing into the filename itself
+struct Blk_Name {
+	const char *dimensions, *tileset;
+	size_t tileset_length;
+	uint16_t width, height;
+};
+
+bool parse_blk_name(const char *f, Blk_Name &bn);
 
 #endif
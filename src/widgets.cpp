@@ -310,7 +310,10 @@ int Workspace::handle(int event) {
 		int nx = _ox + (_cx - dx), ny = _oy + (_cy - dy);
 		int max_x = _content_w - w() + (scrollbar.visible() ? Fl::scrollbar_size() : 0);
 		int max_y = _content_h - h() + (hscrollbar.visible() ? Fl::scrollbar_size() : 0);
-		scroll_to(MAX(MIN(nx, max_x), 0), MAX(MIN(ny, max_y), 0));
+		nx = MAX(MIN(nx, max_x), 0);
+		ny = MAX(MIN(ny, max_y), 0);
+		// only scroll when the view moves, so each step blits at most once
+		if (nx != xposition() || ny != yposition()) { scroll_to(nx, ny); }
 		return 1;
 	}
 	return Fl_Scroll::handle(event);
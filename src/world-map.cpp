@@ -0,0 +1,412 @@
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#pragma warning(push, 0)
+#include <FL/filename.H>
+#pragma warning(pop)
+
+#include "config.h"
+#include "mapped-file.h"
+#include "tokenizer.h"
+#include "map-connections.h"
+#include "world-map.h"
+
+struct Map_Header {
+	std::string label, constant, tileset;
+	std::vector<Map_Connection> connections;
+};
+
+struct World_Link {
+	size_t to;
+	int dx, dy;
+};
+
+static std::string tileset_name(Token t) {
+	// Like Map_Options_Dialog::guess_map_tileset
+	char buffer[16] = {};
+	if (t.starts_with("TILESET_")) {
+		t.skip(strlen("TILESET_"));
+	}
+	else if (t.starts_with("$")) {
+		t.skip(1);
+		std::string hex(t.str());
+		sprintf(buffer, "%02d", (int)strtol(hex.c_str(), NULL, 16));
+		return buffer;
+	}
+	else {
+		unsigned int n;
+		if (t.to_uint(n)) {
+			sprintf(buffer, "%02u", n);
+			return buffer;
+		}
+	}
+	std::string name(t.str());
+	std::transform(name.begin(), name.end(), name.begin(), tolower);
+	return name;
+}
+
+static void read_map_headers(const char *f, std::vector<Map_Header> &headers) {
+	// "map_attributes Label, CONSTANT, border, connections" (pokecrystal) or
+	// "map_header Label, CONSTANT, TILESET, connections" (pokered), each followed by its connections
+	Mapped_File file(f);
+	if (!file.is_open()) { return; }
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, macro, field;
+	Map_Header *header = NULL;
+	while (tokenizer.next_line(line)) {
+		line.remove_comment();
+		if (!line.split_word(macro)) { continue; }
+		bool pokered = macro == "map_header";
+		if (pokered || macro == "map_attributes") {
+			headers.push_back(Map_Header());
+			header = &headers.back();
+			line.split(',', field);
+			field.trim();
+			header->label = field.str();
+			line.split(',', field);
+			field.trim();
+			header->constant = field.str();
+			if (pokered && line.split(',', field)) {
+				field.trim();
+				header->tileset = tileset_name(field);
+			}
+			continue;
+		}
+		Map_Connection c = {};
+		if (header && macro == "connection" && Map_Connections::parse_connection(line, c)) {
+			header->connections.push_back(c);
+		}
+	}
+}
+
+static void read_map_tilesets(const char *f, std::unordered_map<std::string, std::string> &tilesets) {
+	// "map Label, TILESET, ..." in data/maps/maps.asm, or "map_header" in older maps/map_headers.asm
+	Mapped_File file(f);
+	if (!file.is_open()) { return; }
+	Tokenizer tokenizer(file.data(), file.size());
+	Token line, macro, label, tileset;
+	while (tokenizer.next_line(line)) {
+		line.remove_comment();
+		if (!line.split_word(macro) || (macro != "map" && macro != "map_header")) { continue; }
+		if (!line.split(',', label) || !line.split(',', tileset)) { continue; }
+		label.trim();
+		tileset.trim();
+		tilesets[label.str()] = tileset_name(tileset);
+	}
+}
+
+static void read_project_maps(const char *directory, std::vector<Map_Header> &headers,
+	std::unordered_map<std::string, std::string> &tilesets,
+	std::unordered_map<std::string, std::pair<uint16_t, uint16_t>> &dimensions, std::vector<std::string> &sources) {
+	// Read every map's header and connections, from one file or one per map
+	char buffer[FL_PATH_MAX] = {};
+	if (Config::map_attributes_path(buffer, directory, "")) {
+		read_map_headers(buffer, headers);
+		sources.push_back(buffer);
+	}
+	else {
+		char headers_directory[FL_PATH_MAX] = {};
+		sprintf(headers_directory, "%sdata" DIR_SEP "maps" DIR_SEP "headers" DIR_SEP, directory);
+		sources.push_back(headers_directory);
+		dirent **list;
+		int n = fl_filename_list(headers_directory, &list);
+		for (int i = 0; i < n; i++) {
+			const char *name = list[i]->d_name;
+			if (!ends_with(name, ".asm")) { continue; }
+			sprintf(buffer, "%s%s", headers_directory, name);
+			read_map_headers(buffer, headers);
+			sources.push_back(buffer);
+		}
+		if (n >= 0) { fl_filename_free_list(&list, n); }
+	}
+
+	// pokecrystal keeps each map's tileset apart from its attributes
+	if (Config::map_headers_path(buffer, directory)) {
+		read_map_tilesets(buffer, tilesets);
+		sources.push_back(buffer);
+	}
+
+	Config::map_constants_path(buffer, directory);
+	sources.push_back(buffer);
+	Mapped_File constants(buffer);
+	if (constants.is_open()) {
+		Tokenizer tokenizer(constants.data(), constants.size());
+		Token line, macro, constant;
+		uint16_t w, h;
+		while (tokenizer.next_line(line)) {
+			line.remove_comment();
+			if (line.split_word(macro) && Map_Connections::parse_map_constant(macro, line, constant, w, h)) {
+				dimensions[constant.str()] = std::make_pair(w, h);
+			}
+		}
+	}
+}
+
+static std::string header_tileset(const Map_Header &header, const std::unordered_map<std::string, std::string> &tilesets) {
+	if (!header.tileset.empty()) { return header.tileset; }
+	auto it = tilesets.find(header.label);
+	return it != tilesets.end() ? it->second : std::string();
+}
+
+World_Map::World_Map() : _maps(), _tilesets(), _directory(), _sources(), _width(0), _height(0), _result(WORLD_NULL) {}
+
+void World_Map::clear() {
+	_maps.clear();
+	_tilesets.clear();
+	_directory.clear();
+	_sources.clear();
+	_width = _height = 0;
+	_result = WORLD_NULL;
+}
+
+World_Map::Result World_Map::read_world(const char *directory, const char *map_name) {
+	clear();
+	_directory = directory;
+
+	std::vector<Map_Header> headers;
+	std::unordered_map<std::string, std::string> tilesets;
+	std::unordered_map<std::string, std::pair<uint16_t, uint16_t>> dimensions;
+	std::vector<std::string> sources;
+	read_project_maps(directory, headers, tilesets, dimensions, sources);
+	for (const std::string &f : sources) {
+		add_source(f.c_str());
+	}
+	if (headers.empty()) { return (_result = NO_MAP_ATTRIBUTES); }
+
+	// Keep the maps whose size and blocks can be found
+	size_t n = headers.size();
+	std::vector<World_Map_Entry> maps(n);
+	std::vector<bool> valid(n, false);
+	char buffer[FL_PATH_MAX] = {};
+	std::unordered_map<std::string, size_t> labels;
+	for (size_t i = 0; i < n; i++) {
+		const Map_Header &header = headers[i];
+		World_Map_Entry &m = maps[i];
+		m.label = header.label;
+		m.constant = header.constant;
+		m.tileset = NO_WORLD_TILESET;
+		m.width = m.height = 0;
+		m.x = m.y = 0;
+		m.region = 0;
+		auto dim = dimensions.find(header.constant);
+		if (dim == dimensions.end()) { continue; }
+		m.width = dim->second.first;
+		m.height = dim->second.second;
+		sprintf(buffer, "%s%s%s.blk", directory, Config::maps_dir(), header.label.c_str());
+		if (!file_exists(buffer)) { continue; }
+		m.blk_file = buffer;
+		valid[i] = true;
+		labels.emplace(header.label, i);
+	}
+
+	// Link the maps both ways, since a connection may only be listed on one side
+	std::vector<std::vector<World_Link>> links(n);
+	for (size_t i = 0; i < n; i++) {
+		if (!valid[i]) { continue; }
+		for (const Map_Connection &c : headers[i].connections) {
+			auto it = labels.find(c.label);
+			if (it == labels.end() || it->second == i) { continue; }
+			size_t j = it->second;
+			int dx = c.offset, dy = c.offset;
+			switch (c.direction) {
+			case NORTH_CONNECTION: dy = -(int)maps[j].height; break;
+			case SOUTH_CONNECTION: dy = maps[i].height; break;
+			case WEST_CONNECTION: dx = -(int)maps[j].width; break;
+			case EAST_CONNECTION: dx = maps[i].width; break;
+			}
+			World_Link forward = {j, dx, dy}, backward = {i, -dx, -dy};
+			links[i].push_back(forward);
+			links[j].push_back(backward);
+		}
+	}
+
+	// Lay out each region breadth-first, starting from the current map's
+	std::vector<size_t> order;
+	order.reserve(n);
+	auto current = labels.find(map_name);
+	if (current != labels.end()) { order.push_back(current->second); }
+	for (size_t i = 0; i < n; i++) {
+		if (current == labels.end() || i != current->second) { order.push_back(i); }
+	}
+	std::vector<bool> placed(n, false);
+	std::vector<size_t> queue;
+	int row_x = 0, row_y = 0, row_h = 0;
+	size_t num_regions = 0;
+	for (size_t start : order) {
+		if (!valid[start] || placed[start] || links[start].empty()) { continue; }
+		queue.clear();
+		queue.push_back(start);
+		placed[start] = true;
+		maps[start].x = maps[start].y = 0;
+		int x0 = 0, y0 = 0, x1 = maps[start].width, y1 = maps[start].height;
+		for (size_t q = 0; q < queue.size(); q++) {
+			const World_Map_Entry &m = maps[queue[q]];
+			for (const World_Link &link : links[queue[q]]) {
+				if (placed[link.to]) { continue; }
+				World_Map_Entry &neighbor = maps[link.to];
+				neighbor.x = m.x + link.dx;
+				neighbor.y = m.y + link.dy;
+				placed[link.to] = true;
+				queue.push_back(link.to);
+				x0 = MIN(x0, neighbor.x);
+				y0 = MIN(y0, neighbor.y);
+				x1 = MAX(x1, neighbor.x + (int)neighbor.width);
+				y1 = MAX(y1, neighbor.y + (int)neighbor.height);
+			}
+		}
+		// Pack the regions left to right in rows
+		int rw = x1 - x0, rh = y1 - y0;
+		if (row_x > 0 && row_x + rw > WORLD_ROW_WIDTH) {
+			row_x = 0;
+			row_y += row_h + WORLD_REGION_GAP;
+			row_h = 0;
+		}
+		for (size_t i : queue) {
+			World_Map_Entry &m = maps[i];
+			m.x += row_x - x0;
+			m.y += row_y - y0;
+			m.region = num_regions;
+			m.tileset = add_tileset(header_tileset(headers[i], tilesets));
+			_maps.push_back(m);
+		}
+		_width = MAX(_width, row_x + rw);
+		_height = MAX(_height, row_y + rh);
+		row_x += rw + WORLD_REGION_GAP;
+		row_h = MAX(row_h, rh);
+		num_regions++;
+	}
+
+	return (_result = _maps.empty() ? NO_MAP_CONNECTIONS : WORLD_OK);
+}
+
+World_Map::Result World_Map::read_catalog(const char *directory) {
+	clear();
+	_directory = directory;
+
+	// Headers are optional here, since a .blk file's name may give its size and tileset
+	std::vector<Map_Header> headers;
+	std::unordered_map<std::string, std::string> tilesets;
+	std::unordered_map<std::string, std::pair<uint16_t, uint16_t>> dimensions;
+	std::vector<std::string> sources;
+	read_project_maps(directory, headers, tilesets, dimensions, sources);
+	for (const std::string &f : sources) {
+		add_source(f.c_str());
+	}
+	std::unordered_map<std::string, size_t> labels;
+	for (size_t i = 0; i < headers.size(); i++) {
+		labels.emplace(headers[i].label, i);
+	}
+
+	char maps_directory[FL_PATH_MAX] = {};
+	sprintf(maps_directory, "%s%s", directory, Config::maps_dir());
+	// Adding, removing, or renaming a .blk file changes the directory's modification time
+	add_source(maps_directory);
+	dirent **list;
+	int n = fl_filename_list(maps_directory, &list, fl_casenumericsort);
+	for (int i = 0; i < n; i++) {
+		const char *name = list[i]->d_name;
+		if (!ends_with(name, ".blk")) { continue; }
+		World_Map_Entry m;
+		m.label.assign(name, strlen(name) - strlen(".blk"));
+		m.blk_file = std::string(maps_directory) + name;
+		m.tileset = NO_WORLD_TILESET;
+		m.width = m.height = 0;
+		m.x = m.y = 0;
+		m.region = 0;
+		// "Label.WxH.tileset.blk" names override the headers
+		Blk_Name bn = {};
+		parse_blk_name(name, bn);
+		auto it = labels.find(m.label.substr(0, m.label.find('.')));
+		if (it != labels.end()) {
+			const Map_Header &header = headers[it->second];
+			m.constant = header.constant;
+			auto dim = dimensions.find(header.constant);
+			if (dim != dimensions.end()) {
+				m.width = dim->second.first;
+				m.height = dim->second.second;
+			}
+			m.tileset = add_tileset(header_tileset(header, tilesets));
+		}
+		if (bn.dimensions) {
+			m.width = (uint16_t)bn.width;
+			m.height = (uint16_t)bn.height;
+		}
+		if (bn.tileset && bn.tileset != bn.dimensions) {
+			m.tileset = add_tileset(std::string(bn.tileset, bn.tileset_length));
+		}
+		_maps.push_back(m);
+	}
+	if (n >= 0) { fl_filename_free_list(&list, n); }
+
+	return (_result = _maps.empty() ? NO_MAP_FILES : WORLD_OK);
+}
+
+void World_Map::add_source(const char *path) {
+	// stat() fails for directories with a trailing separator on Windows
+	std::string f(path);
+	while (f.size() > 1 && (f.back() == '/' || f.back() == '\\')) { f.pop_back(); }
+	int64_t modified = file_modified(f.c_str());
+	_sources.push_back(std::make_pair(f, modified));
+}
+
+bool World_Map::sources_changed() const {
+	for (const auto &s : _sources) {
+		if (file_modified(s.first.c_str()) != s.second) { return true; }
+	}
+	return false;
+}
+
+size_t World_Map::add_tileset(const std::string &name) {
+	if (name.empty()) { return NO_WORLD_TILESET; }
+	for (size_t i = 0; i < _tilesets.size(); i++) {
+		if (_tilesets[i].name == name) { return i; }
+	}
+	// Resolve every path here, so rendering does not need Config
+	char buffer[FL_PATH_MAX] = {};
+	const char *directory = _directory.c_str();
+	World_Tileset ts;
+	ts.name = name;
+	Config::palette_map_path(buffer, directory, name.c_str());
+	ts.palette_map_file = buffer;
+	Config::tileset_path(buffer, directory, name.c_str());
+	ts.tileset_file = buffer;
+	Config::metatileset_path(buffer, directory, name.c_str());
+	ts.metatileset_file = buffer;
+	_tilesets.push_back(ts);
+	return _tilesets.size() - 1;
+}
+
+size_t World_Map::find(const char *label) const {
+	for (size_t i = 0; i < _maps.size(); i++) {
+		if (_maps[i].label == label) { return i; }
+	}
+	return _maps.size();
+}
+
+size_t World_Map::map_at(int x, int y) const {
+	for (size_t i = 0; i < _maps.size(); i++) {
+		const World_Map_Entry &m = _maps[i];
+		if (x >= m.x && x < m.x + m.width && y >= m.y && y < m.y + m.height) { return i; }
+	}
+	return _maps.size();
+}
+
+const char *World_Map::error_message(Result result) {
+	switch (result) {
+	case WORLD_OK:
+		return "OK.";
+	case NO_MAP_ATTRIBUTES:
+		return "No map attributes or headers found.";
+	case NO_MAP_CONNECTIONS:
+		return "No connected maps found.";
+	case NO_MAP_FILES:
+		return "No .blk files found.";
+	case WORLD_NULL:
+		return "No project opened.";
+	default:
+		return "Unspecified error.";
+	}
+}
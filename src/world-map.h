@@ -0,0 +1,65 @@
+#ifndef WORLD_MAP_H
+#define WORLD_MAP_H
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Blocks of empty space left between separate regions
+#define WORLD_REGION_GAP 8
+// Regions are packed into rows no wider than this many blocks (unless one is wider)
+#define WORLD_ROW_WIDTH 320
+
+#define NO_WORLD_TILESET ((size_t)-1)
+
+struct World_Tileset {
+	std::string name, palette_map_file, tileset_file, metatileset_file;
+};
+
+struct World_Map_Entry {
+	std::string label, constant, blk_file;
+	size_t tileset;
+	uint16_t width, height;
+	// Position of the top-left block in the world, and which region it is part of
+	int x, y;
+	size_t region;
+};
+
+// Every map in the project that is connected to another one, laid out by
+// following the connections outward from one map in each region; or, as a
+// catalog, every .blk file in the maps directory, with no layout
+class World_Map {
+public:
+	enum Result { WORLD_OK, NO_MAP_ATTRIBUTES, NO_MAP_CONNECTIONS, NO_MAP_FILES, WORLD_NULL };
+private:
+	std::vector<World_Map_Entry> _maps;
+	std::vector<World_Tileset> _tilesets;
+	std::string _directory;
+	// The files and directories the maps were read from, with their modification times
+	std::vector<std::pair<std::string, int64_t>> _sources;
+	int _width, _height;
+	Result _result;
+public:
+	World_Map(void);
+	inline size_t size(void) const { return _maps.size(); }
+	inline const World_Map_Entry &map(size_t i) const { return _maps[i]; }
+	inline size_t num_tilesets(void) const { return _tilesets.size(); }
+	inline const World_Tileset &tileset(size_t i) const { return _tilesets[i]; }
+	inline const char *directory(void) const { return _directory.c_str(); }
+	inline int width(void) const { return _width; }
+	inline int height(void) const { return _height; }
+	inline Result result(void) const { return _result; }
+	void clear(void);
+	Result read_world(const char *directory, const char *map_name);
+	Result read_catalog(const char *directory);
+	bool sources_changed(void) const;
+	size_t find(const char *label) const;
+	size_t map_at(int x, int y) const;
+	static const char *error_message(Result result);
+private:
+	size_t add_tileset(const std::string &name);
+	void add_source(const char *path);
+};
+
+#endif
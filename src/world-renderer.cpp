@@ -0,0 +1,358 @@
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+#pragma warning(push, 0)
+#include <FL/filename.H>
+#include <FL/fl_utf8.h>
+#pragma warning(pop)
+
+#include "config.h"
+#include "parallel.h"
+#include "mapped-file.h"
+#include "map-framebuffer.h"
+#include "world-renderer.h"
+
+static const uchar empty_rgb[NUM_CHANNELS] = {EMPTY_RGB};
+
+static uint64_t fnv1a(const void *data, size_t n, uint64_t h = 0xCBF29CE484222325ULL) {
+	const uchar *p = (const uchar *)data;
+	for (size_t i = 0; i < n; i++) {
+		h = (h ^ p[i]) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static int image_ppb(const World_Map_Entry &m, int ppb) {
+	// The most pixels per block, up to ppb, that fit in WORLD_IMAGE_BYTES, or 0 if none do
+	size_t bytes = (size_t)m.width * m.height * NUM_CHANNELS;
+	while (ppb > 0 && bytes * ppb * ppb > WORLD_IMAGE_BYTES) { ppb--; }
+	return ppb;
+}
+
+World_Renderer::World_Renderer() : _world(NULL), _lighting(), _colors(), _settings(0), _tilesets(NULL), _workers(), _mutex(), _wake(), _jobs(),
+	_done(), _quit(false), _disk_cache(), _cache(), _pending(), _cache_bytes(0), _frame(0) {}
+
+World_Renderer::~World_Renderer() {
+	stop();
+}
+
+void World_Renderer::start(const World_Map *world, Lighting l) {
+	stop();
+	_world = world;
+	_lighting = l;
+	Color::copy_colors(l, _colors);
+	uchar options[2] = {(uchar)Config::monochrome(), (uchar)Config::allow_256_tiles()};
+	_settings = fnv1a(options, sizeof(options), fnv1a(_colors, sizeof(_colors)));
+	if (!_disk_cache.empty()) { prune_disk_cache(); }
+	_tilesets = new Tileset_Cache[world->num_tilesets()]();
+	_quit = false;
+	// Leave a core for the main thread, which keeps drawing while maps render
+	unsigned int n = MAX(num_cores(), 2) - 1;
+	for (unsigned int i = 0; i < n; i++) {
+		_workers.emplace_back(work, this);
+	}
+}
+
+void World_Renderer::stop() {
+	if (!running()) { return; }
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+		_jobs.clear();
+	}
+	_wake.notify_all();
+	for (std::thread &t : _workers) {
+		t.join();
+	}
+	_workers.clear();
+	for (auto &it : _done) {
+		delete it.second;
+	}
+	_done.clear();
+	for (auto &it : _cache) {
+		delete it.second;
+	}
+	_cache.clear();
+	_pending.clear();
+	_cache_bytes = 0;
+	for (size_t i = 0; i < _world->num_tilesets(); i++) {
+		delete _tilesets[i].metatileset;
+	}
+	delete [] _tilesets;
+	_tilesets = NULL;
+	_world = NULL;
+}
+
+void World_Renderer::begin_frame() {
+	// Jobs that have not started yet are dropped, so panning away from a
+	// map stops it from holding up the ones that are visible now
+	_frame++;
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (const Job &job : _jobs) {
+		_pending.erase(key(job.map, job.ppb));
+	}
+	_jobs.clear();
+}
+
+const World_Image *World_Renderer::cached(size_t map, int ppb) {
+	auto it = _cache.find(key(map, ppb));
+	if (it == _cache.end()) { return NULL; }
+	it->second->last_used = _frame;
+	return it->second;
+}
+
+const World_Image *World_Renderer::image(size_t map, int ppb) {
+	const World_Image *cached_image = cached(map, ppb);
+	if (cached_image) { return cached_image; }
+	if (running() && _pending.insert(key(map, ppb)).second) {
+		Job job = {map, ppb};
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobs.push_back(job);
+		}
+		_wake.notify_one();
+	}
+	return NULL;
+}
+
+bool World_Renderer::collect() {
+	std::vector<std::pair<uint64_t, World_Image *>> done;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		done.swap(_done);
+	}
+	for (auto &it : done) {
+		_pending.erase(it.first);
+		it.second->last_used = _frame;
+		World_Image *&image = _cache[it.first];
+		if (image) {
+			_cache_bytes -= image->rgb.size();
+			delete image;
+		}
+		image = it.second;
+		_cache_bytes += image->rgb.size();
+	}
+	evict();
+	return !done.empty();
+}
+
+void World_Renderer::evict() {
+	// A linear scan is enough for the few images that fit in the budget
+	while (_cache_bytes > WORLD_CACHE_BYTES) {
+		auto oldest = _cache.end();
+		for (auto it = _cache.begin(); it != _cache.end(); ++it) {
+			if (it->second->last_used < _frame && (oldest == _cache.end() ||
+				it->second->last_used < oldest->second->last_used)) {
+				oldest = it;
+			}
+		}
+		// Everything left was drawn this frame
+		if (oldest == _cache.end()) { break; }
+		_cache_bytes -= oldest->second->rgb.size();
+		delete oldest->second;
+		_cache.erase(oldest);
+	}
+}
+
+void World_Renderer::render(const Job &job, World_Image &image) {
+	image.w = image.h = 0;
+	const World_Map_Entry &m = _world->map(job.map);
+	if (m.tileset == NO_WORLD_TILESET) { return; }
+	// The image is still cached under the requested ppb
+	int ppb = image_ppb(m, job.ppb);
+	if (!ppb) { return; }
+	Job scaled = {job.map, ppb};
+	if (!_disk_cache.empty() && read_disk_cache(scaled, image)) { return; }
+	Tileset_Cache *tc = &_tilesets[m.tileset];
+	std::call_once(tc->read, read_tileset, tc, &_world->tileset(m.tileset), _lighting, &_colors);
+	if (!tc->metatileset) { return; }
+	Mapped_File file(m.blk_file.c_str());
+	size_t n = (size_t)m.width * m.height;
+	if (!file.is_open() || file.size() < n) { return; }
+
+	image.w = m.width * ppb;
+	image.h = m.height * ppb;
+	size_t lb = (size_t)image.w * NUM_CHANNELS;
+	image.rgb.resize(lb * image.h);
+	const uchar *ids = file.data();
+	for (int y = 0; y < m.height; y++) {
+		for (int x = 0; x < m.width; x++) {
+			uint8_t id = ids[(size_t)y * m.width + x];
+			uchar *dst = image.rgb.data() + (size_t)y * ppb * lb + (size_t)x * ppb * NUM_CHANNELS;
+			if (ppb >= WORLD_DETAIL_PPB) {
+				Map_Framebuffer::render_block(dst, lb, ppb, *tc->metatileset, id);
+				continue;
+			}
+			for (int py = 0; py < ppb; py++) {
+				for (int px = 0; px < ppb; px++) {
+					memcpy(dst + py * lb + px * NUM_CHANNELS, tc->averages[id], NUM_CHANNELS);
+				}
+			}
+		}
+	}
+	if (!_disk_cache.empty()) { write_disk_cache(scaled, image); }
+}
+
+std::string World_Renderer::disk_file(const World_Map_Entry &m, int ppb) const {
+	// One file per map, zoom and lighting, named after the map's path
+	uint64_t h = fnv1a(m.blk_file.data(), m.blk_file.size());
+	char name[48] = {};
+	sprintf(name, "%08x%08x-%d-%d.thumb", (unsigned int)(h >> 32), (unsigned int)h, ppb, (int)_lighting);
+	return _disk_cache + name;
+}
+
+std::string World_Renderer::disk_key(const World_Map_Entry &m, int ppb) const {
+	// Everything the image depends on, so any change to it is a cache miss
+	const World_Tileset &ts = _world->tileset(m.tileset);
+	char buffer[160] = {};
+	sprintf(buffer, "\n%ux%u %d %d %016llx %lld %lld %lld %lld", m.width, m.height, ppb, (int)_lighting,
+		(unsigned long long)_settings, (long long)file_modified(m.blk_file.c_str()), (long long)file_modified(ts.palette_map_file.c_str()),
+		(long long)file_modified(ts.tileset_file.c_str()), (long long)file_modified(ts.metatileset_file.c_str()));
+	return m.blk_file + "\n" + ts.name + buffer;
+}
+
+struct Cache_File {
+	int64_t modified;
+	size_t size;
+	std::string path;
+	inline bool operator<(const Cache_File &other) const { return modified < other.modified; }
+};
+
+void World_Renderer::prune_disk_cache() const {
+	// Delete the least recently written images until the rest fit in WORLD_DISK_CACHE_BYTES
+	dirent **list;
+	int n = fl_filename_list(_disk_cache.c_str(), &list);
+	if (n < 0) { return; }
+	std::vector<Cache_File> files;
+	size_t total = 0;
+	for (int i = 0; i < n; i++) {
+		const char *name = list[i]->d_name;
+		if (!fl_filename_match(name, "*.thumb")) { continue; }
+		Cache_File cf;
+		cf.path = _disk_cache + name;
+		cf.modified = file_modified(cf.path.c_str());
+		cf.size = file_size(cf.path.c_str());
+		total += cf.size;
+		files.push_back(cf);
+	}
+	fl_filename_free_list(&list, n);
+	if (total <= WORLD_DISK_CACHE_BYTES) { return; }
+	std::sort(files.begin(), files.end());
+	for (size_t i = 0; i < files.size() && total > WORLD_DISK_CACHE_BYTES; i++) {
+		if (!fl_unlink(files[i].path.c_str())) { total -= files[i].size; }
+	}
+}
+
+bool World_Renderer::read_disk_cache(const Job &job, World_Image &image) const {
+	// WORLD_DISK_CACHE_MAGIC, key length (4 bytes), key, width and height (2 bytes each), RGB
+	const World_Map_Entry &m = _world->map(job.map);
+	Mapped_File file(disk_file(m, job.ppb).c_str());
+	if (!file.is_open()) { return false; }
+	std::string key = disk_key(m, job.ppb);
+	const uchar *data = file.data();
+	size_t n = file.size(), k = key.size(), p = 4 + 4 + k;
+	if (n < p + 4 || memcmp(data, WORLD_DISK_CACHE_MAGIC, 4)) { return false; }
+	if ((size_t)(data[4] | data[5] << 8 | data[6] << 16 | data[7] << 24) != k || memcmp(data + 8, key.data(), k)) {
+		return false;
+	}
+	int w = data[p] | data[p + 1] << 8, h = data[p + 2] | data[p + 3] << 8;
+	size_t size = (size_t)w * h * NUM_CHANNELS;
+	if (w != m.width * job.ppb || h != m.height * job.ppb || n != p + 4 + size) { return false; }
+	image.rgb.assign(data + p + 4, data + n);
+	image.w = w;
+	image.h = h;
+	return true;
+}
+
+void World_Renderer::write_disk_cache(const Job &job, const World_Image &image) const {
+	const World_Map_Entry &m = _world->map(job.map);
+	std::string key = disk_key(m, job.ppb);
+	size_t k = key.size();
+	std::vector<uchar> data;
+	data.reserve(4 + 4 + k + 4 + image.rgb.size());
+	data.insert(data.end(), WORLD_DISK_CACHE_MAGIC, WORLD_DISK_CACHE_MAGIC + 4);
+	uchar header[4] = {(uchar)k, (uchar)(k >> 8), (uchar)(k >> 16), (uchar)(k >> 24)};
+	data.insert(data.end(), header, header + 4);
+	data.insert(data.end(), key.begin(), key.end());
+	uchar size[4] = {(uchar)image.w, (uchar)(image.w >> 8), (uchar)image.h, (uchar)(image.h >> 8)};
+	data.insert(data.end(), size, size + 4);
+	data.insert(data.end(), image.rgb.begin(), image.rgb.end());
+	// A failed write only means rendering the map again next time
+	write_file_atomic(disk_file(m, job.ppb).c_str(), data.data(), data.size());
+}
+
+void World_Renderer::read_tileset(Tileset_Cache *tc, const World_Tileset *ts, Lighting l, const Palette_Colors *colors) {
+	// The same files as Main_Window::read_metatile_data, without collisions or roofs
+	Metatileset *mt = new Metatileset();
+	Tileset *tileset = mt->tileset();
+	tileset->name(ts->name.c_str());
+	tileset->colors(colors);
+	Palette_Map::Result rp = tileset->read_palette_map(ts->palette_map_file.c_str());
+	Metatileset::Result rm = Metatileset::Result::META_NULL;
+	if ((!rp || rp == Palette_Map::Result::PALETTE_TOO_LONG) && !tileset->read_graphics(ts->tileset_file.c_str(), l)) {
+		rm = mt->read_metatiles(ts->metatileset_file.c_str());
+	}
+	if (rm != Metatileset::Result::META_OK && rm != Metatileset::Result::META_TOO_SHORT &&
+		rm != Metatileset::Result::META_TOO_LONG) {
+		delete mt;
+		return;
+	}
+	tc->metatileset = mt;
+
+	// Thumbnails fill each block with the average of its tiles' colors
+	unsigned int tile_sums[MAX_NUM_TILES][NUM_CHANNELS] = {};
+	for (int i = 0; i < MAX_NUM_TILES; i++) {
+		const uchar *rgb = tileset->const_tile_or_roof((uint8_t)i)->rgb();
+		for (int p = 0; p < LINE_PX * LINE_PX; p++) {
+			for (int c = 0; c < NUM_CHANNELS; c++) {
+				tile_sums[i][c] += rgb[p * NUM_CHANNELS + c];
+			}
+		}
+	}
+	for (size_t id = 0; id < MAX_NUM_METATILES; id++) {
+		if (id >= mt->size()) {
+			memcpy(tc->averages[id], empty_rgb, NUM_CHANNELS);
+			continue;
+		}
+		const Metatile *m = mt->const_metatile((uint8_t)id);
+		unsigned int sums[NUM_CHANNELS] = {};
+		for (int ty = 0; ty < METATILE_SIZE; ty++) {
+			for (int tx = 0; tx < METATILE_SIZE; tx++) {
+				for (int c = 0; c < NUM_CHANNELS; c++) {
+					sums[c] += tile_sums[m->tile_id(tx, ty)][c];
+				}
+			}
+		}
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			tc->averages[id][c] = (uchar)(sums[c] / (METATILE_SIZE * METATILE_SIZE * LINE_PX * LINE_PX));
+		}
+	}
+}
+
+void World_Renderer::work(World_Renderer *wr) {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(wr->_mutex);
+			while (!wr->_quit && wr->_jobs.empty()) {
+				wr->_wake.wait(lock);
+			}
+			if (wr->_quit) { return; }
+			job = wr->_jobs.front();
+			wr->_jobs.pop_front();
+		}
+		World_Image *image = new World_Image();
+		try {
+			wr->render(job, *image);
+		}
+		catch (const std::bad_alloc &) {
+			// Leave the map blank instead of ending the program
+			std::vector<uchar>().swap(image->rgb);
+			image->w = image->h = 0;
+		}
+		std::lock_guard<std::mutex> lock(wr->_mutex);
+		wr->_done.push_back(std::make_pair(key(job.map, job.ppb), image));
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef WORLD_RENDERER_H
+#define WORLD_RENDERER_H
+
+#include <deque>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+
+#pragma warning(push, 0)
+#include <FL/fl_types.h>
+#pragma warning(pop)
+
+#include "utils.h"
+#include "colors.h"
+#include "metatileset.h"
+#include "world-map.h"
+
+// Rendered maps are evicted, least recently drawn first, past this many bytes
+#define WORLD_CACHE_BYTES (96 * 1024 * 1024)
+// Maps too large to render within this many bytes get fewer pixels per block,
+// and are scaled up when drawn
+#define WORLD_IMAGE_BYTES (WORLD_CACHE_BYTES / 8)
+// Maps drawn with fewer pixels per block than this are thumbnails, with
+// each block filled with its average color instead of rendered from tiles
+#define WORLD_DETAIL_PPB 4
+
+#define WORLD_DISK_CACHE_MAGIC "PMTH"
+// The oldest saved images are deleted past this many bytes
+#define WORLD_DISK_CACHE_BYTES (256 * 1024 * 1024)
+
+struct World_Image {
+	std::vector<uchar> rgb;
+	// Zero if the map's blocks or tileset could not be read
+	int w, h;
+	size_t last_used;
+};
+
+// Renders the world's maps on background threads, reading each tileset the
+// first time a map needs it, and keeps the results in a bounded cache
+class World_Renderer {
+private:
+	struct Job {
+		size_t map;
+		int ppb;
+	};
+	struct Tileset_Cache {
+		std::once_flag read;
+		Metatileset *metatileset;
+		uchar averages[MAX_NUM_METATILES][NUM_CHANNELS];
+	};
+	const World_Map *_world;
+	Lighting _lighting;
+	// Copied in start(), since the lighting windows may change the originals
+	Palette_Colors _colors;
+	// Hash of _colors and the Config options that change rendering, taken in start()
+	uint64_t _settings;
+	Tileset_Cache *_tilesets;
+	std::vector<std::thread> _workers;
+	// _mutex guards the jobs waiting to start and the images waiting to be collected
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::deque<Job> _jobs;
+	std::vector<std::pair<uint64_t, World_Image *>> _done;
+	bool _quit;
+	// Images are also saved here, and read back before rendering, if it is not empty
+	std::string _disk_cache;
+	// Only used on the main thread
+	std::unordered_map<uint64_t, World_Image *> _cache;
+	std::unordered_set<uint64_t> _pending;
+	size_t _cache_bytes, _frame;
+public:
+	World_Renderer(void);
+	~World_Renderer();
+	inline bool running(void) const { return !_workers.empty(); }
+	inline bool busy(void) const { return !_pending.empty(); }
+	inline Lighting lighting(void) const { return _lighting; }
+	inline size_t cache_bytes(void) const { return _cache_bytes; }
+	// Set before start(), since the workers read it
+	inline void disk_cache(const char *directory) { _disk_cache = directory ? directory : ""; }
+	void start(const World_Map *world, Lighting l);
+	void stop(void);
+	void begin_frame(void);
+	const World_Image *cached(size_t map, int ppb);
+	const World_Image *image(size_t map, int ppb);
+	bool collect(void);
+private:
+	inline static uint64_t key(size_t map, int ppb) { return ((uint64_t)map << 8) | (uint64_t)ppb; }
+	void evict(void);
+	void render(const Job &job, World_Image &image);
+	std::string disk_file(const World_Map_Entry &m, int ppb) const;
+	std::string disk_key(const World_Map_Entry &m, int ppb) const;
+	void prune_disk_cache(void) const;
+	bool read_disk_cache(const Job &job, World_Image &image) const;
+	void write_disk_cache(const Job &job, const World_Image &image) const;
+	static void read_tileset(Tileset_Cache *tc, const World_Tileset *ts, Lighting l, const Palette_Colors *colors);
+	static void work(World_Renderer *wr);
+};
+
+#endif
@@ -0,0 +1,342 @@
+#include <cstdio>
+#include <cstring>
+
+#pragma warning(push, 0)
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/fl_draw.H>
+#pragma warning(pop)
+
+#include "themes.h"
+#include "perf.h"
+#include "world-window.h"
+
+// Pixels per block at each zoom level; below WORLD_DETAIL_PPB, maps are thumbnails
+static const int world_zoom_levels[NUM_WORLD_ZOOM_LEVELS] = {1, 2, 4, 8, 16, 32};
+
+static inline int floor_div(int a, int b) {
+	return a < 0 ? (a - b + 1) / b : a / b;
+}
+
+void draw_world_image(const World_Image *image, int x, int y, int w, int h, int cx, int cy, int cw, int ch,
+	std::vector<uchar> &scratch) {
+	if (w == image->w && h == image->h) {
+		// Only the visible part of the image is uploaded
+		const uchar *rgb = image->rgb.data() + (size_t)(cy - y) * image->w * NUM_CHANNELS + (size_t)(cx - x) * NUM_CHANNELS;
+		fl_draw_image(rgb, cx, cy, cw, ch, NUM_CHANNELS, image->w * NUM_CHANNELS);
+	}
+	else {
+		size_t lb = (size_t)cw * NUM_CHANNELS;
+		scratch.resize(lb * ch);
+		for (int py = 0; py < ch; py++) {
+			int sy = (int)((long long)(cy + py - y) * image->h / h);
+			const uchar *src = image->rgb.data() + (size_t)sy * image->w * NUM_CHANNELS;
+			uchar *dst = scratch.data() + (size_t)py * lb;
+			for (int px = 0; px < cw; px++) {
+				int sx = (int)((long long)(cx + px - x) * image->w / w);
+				memcpy(dst + px * NUM_CHANNELS, src + sx * NUM_CHANNELS, NUM_CHANNELS);
+			}
+		}
+		fl_draw_image(scratch.data(), cx, cy, cw, ch, NUM_CHANNELS, (int)lb);
+	}
+	Perf::count(Perf::DRAW_IMAGE_CALLS);
+	Perf::count(Perf::PIXELS_UPLOADED, (size_t)cw * ch);
+}
+
+World_View::World_View(int x, int y, int w, int h) : Fl_Widget(x, y, w, h), _world(NULL), _renderer(NULL), _current(0),
+	_hovered(0), _zoom(DEFAULT_WORLD_ZOOM_LEVEL), _ox(0), _oy(0), _drag_x(0), _drag_y(0), _drag_ox(0), _drag_oy(0),
+	_polling(false), _scratch() {
+	labeltype(FL_NO_LABEL);
+	box(FL_NO_BOX);
+	color(FL_INACTIVE_COLOR);
+}
+
+World_View::~World_View() {
+	Fl::remove_timeout((Fl_Timeout_Handler)poll_cb, this);
+}
+
+void World_View::world(const World_Map *w, World_Renderer *r, size_t current) {
+	Fl::remove_timeout((Fl_Timeout_Handler)poll_cb, this);
+	_polling = false;
+	_world = w;
+	_renderer = r;
+	_current = current;
+	_hovered = w ? w->size() : 0;
+	_scratch.clear();
+	_scratch.shrink_to_fit();
+	redraw();
+}
+
+int World_View::ppb() const {
+	return world_zoom_levels[_zoom];
+}
+
+void World_View::center_on(size_t map) {
+	if (!_world || map >= _world->size()) { return; }
+	const World_Map_Entry &m = _world->map(map);
+	int s = ppb();
+	_ox = (m.x * 2 + m.width) * s / 2 - w() / 2;
+	_oy = (m.y * 2 + m.height) * s / 2 - h() / 2;
+	clamp();
+	redraw();
+}
+
+void World_View::zoom(int level, int mx, int my) {
+	// Keep the point under (mx, my) in place
+	level = MAX(0, MIN(level, NUM_WORLD_ZOOM_LEVELS - 1));
+	if (level == _zoom) { return; }
+	int s0 = ppb();
+	_zoom = level;
+	int s1 = ppb();
+	_ox = (int)((long long)(_ox + mx) * s1 / s0) - mx;
+	_oy = (int)((long long)(_oy + my) * s1 / s0) - my;
+	clamp();
+	redraw();
+	do_callback();
+}
+
+void World_View::pan(int dx, int dy) {
+	_ox += dx;
+	_oy += dy;
+	clamp();
+	redraw();
+}
+
+void World_View::clamp() {
+	// Allow panning until the world's edge reaches the middle of the view
+	if (!_world) { return; }
+	int s = ppb();
+	_ox = MAX(-w() / 2, MIN(_ox, _world->width() * s - w() / 2));
+	_oy = MAX(-h() / 2, MIN(_oy, _world->height() * s - h() / 2));
+}
+
+bool World_View::hover(int ex, int ey) {
+	size_t h = _world ? _world->size() : 0;
+	if (_world && Fl::event_inside(this)) {
+		int s = ppb();
+		h = _world->map_at(floor_div(ex - x() + _ox, s), floor_div(ey - y() + _oy, s));
+	}
+	if (h == _hovered) { return false; }
+	_hovered = h;
+	redraw();
+	do_callback();
+	return true;
+}
+
+void World_View::draw() {
+	fl_push_clip(x(), y(), w(), h());
+	fl_rectf(x(), y(), w(), h(), color());
+	if (!_world || !_renderer || !_renderer->running()) {
+		fl_pop_clip();
+		return;
+	}
+	int s = ppb();
+	_renderer->begin_frame();
+	for (size_t i = 0; i < _world->size(); i++) {
+		const World_Map_Entry &m = _world->map(i);
+		int mx = x() + m.x * s - _ox, my = y() + m.y * s - _oy, mw = m.width * s, mh = m.height * s;
+		int cx0 = MAX(mx, x()), cy0 = MAX(my, y());
+		int cx1 = MIN(mx + mw, x() + w()), cy1 = MIN(my + mh, y() + h());
+		if (cx0 >= cx1 || cy0 >= cy1) { continue; }
+		const World_Image *image = _renderer->image(i, s);
+		if (image && image->w) {
+			draw_world_image(image, mx, my, mw, mh, cx0, cy0, cx1 - cx0, cy1 - cy0, _scratch);
+		}
+		else if (image) {
+			// The map's blocks or tileset could not be read
+			fl_rectf(cx0, cy0, cx1 - cx0, cy1 - cy0, FL_DARK3);
+		}
+		else {
+			// Stretch another zoom level's rendering, if there is one, until this one is done
+			const World_Image *other = NULL;
+			for (int d = 1; !other && d < NUM_WORLD_ZOOM_LEVELS; d++) {
+				if (_zoom - d >= 0) { other = _renderer->cached(i, world_zoom_levels[_zoom - d]); }
+				if (!other && _zoom + d < NUM_WORLD_ZOOM_LEVELS) { other = _renderer->cached(i, world_zoom_levels[_zoom + d]); }
+			}
+			if (other && other->w) {
+				draw_world_image(other, mx, my, mw, mh, cx0, cy0, cx1 - cx0, cy1 - cy0, _scratch);
+			}
+			else {
+				fl_rectf(cx0, cy0, cx1 - cx0, cy1 - cy0, FL_DARK2);
+			}
+		}
+		if (i == _current || i == _hovered) {
+			fl_color(i == _current ? FL_SELECTION_COLOR : FL_FOREGROUND_COLOR);
+			fl_rect(mx, my, mw, mh);
+		}
+	}
+	fl_pop_clip();
+	if (_renderer->busy() && !_polling) {
+		_polling = true;
+		Fl::add_timeout(1.0 / 30.0, (Fl_Timeout_Handler)poll_cb, this);
+	}
+}
+
+int World_View::handle(int event) {
+	int ex = Fl::event_x(), ey = Fl::event_y();
+	switch (event) {
+	case FL_ENTER:
+	case FL_MOVE:
+	case FL_LEAVE:
+		hover(ex, ey);
+		return 1;
+	case FL_FOCUS:
+	case FL_UNFOCUS:
+		return 1;
+	case FL_PUSH:
+		take_focus();
+		_drag_x = ex;
+		_drag_y = ey;
+		_drag_ox = _ox;
+		_drag_oy = _oy;
+		fl_cursor(FL_CURSOR_MOVE);
+		return 1;
+	case FL_DRAG:
+		_ox = _drag_ox - (ex - _drag_x);
+		_oy = _drag_oy - (ey - _drag_y);
+		clamp();
+		redraw();
+		return 1;
+	case FL_RELEASE:
+		fl_cursor(FL_CURSOR_DEFAULT);
+		hover(ex, ey);
+		return 1;
+	case FL_MOUSEWHEEL:
+		zoom(_zoom - Fl::event_dy(), ex - x(), ey - y());
+		hover(ex, ey);
+		return 1;
+	case FL_KEYBOARD:
+		switch (Fl::event_key()) {
+		case FL_Left:
+			pan(-w() / 4, 0);
+			return 1;
+		case FL_Right:
+			pan(w() / 4, 0);
+			return 1;
+		case FL_Up:
+			pan(0, -h() / 4);
+			return 1;
+		case FL_Down:
+			pan(0, h() / 4);
+			return 1;
+		case '=':
+		case FL_KP + '+':
+			zoom(_zoom + 1, w() / 2, h() / 2);
+			return 1;
+		case '-':
+		case FL_KP + '-':
+			zoom(_zoom - 1, w() / 2, h() / 2);
+			return 1;
+		case FL_Home:
+			center_on(_current);
+			return 1;
+		}
+		return 0;
+	}
+	return Fl_Widget::handle(event);
+}
+
+void World_View::poll_cb(World_View *wv) {
+	if (!wv->_renderer) {
+		wv->_polling = false;
+		return;
+	}
+	if (wv->_renderer->collect()) {
+		wv->redraw();
+	}
+	if (wv->_renderer->busy()) {
+		Fl::repeat_timeout(1.0 / 30.0, (Fl_Timeout_Handler)poll_cb, wv);
+	}
+	else {
+		wv->_polling = false;
+	}
+}
+
+World_Window::World_Window(int x, int y, int w, int h) : _dx(x), _dy(y), _width(w), _height(h), _window(NULL),
+	_view(NULL), _status(NULL), _world(), _renderer() {}
+
+World_Window::~World_Window() {
+	close();
+	delete _window;
+	delete _view;
+	delete _status;
+}
+
+void World_Window::initialize() {
+	if (_window) { return; }
+	Fl_Group *prev_current = Fl_Group::current();
+	Fl_Group::current(NULL);
+	// Populate window
+	_window = new Fl_Double_Window(_dx, _dy, _width, _height, "World Map");
+	_view = new World_View(0, 0, _width, _height - 22);
+	_status = new Label(4, _height - 22, _width - 8, 22);
+	_window->end();
+	// Initialize window
+	_window->resizable(_view);
+	_window->callback((Fl_Callback *)close_cb, this);
+	// Initialize window's children
+	_view->callback((Fl_Callback *)view_cb, this);
+	Fl_Group::current(prev_current);
+}
+
+void World_Window::update_status() {
+	char buffer[256] = {};
+	size_t i = _view->hovered();
+	if (i < _world.size()) {
+		const World_Map_Entry &m = _world.map(i);
+		const char *tileset = m.tileset == NO_WORLD_TILESET ? "(unknown tileset)" : _world.tileset(m.tileset).name.c_str();
+		sprintf(buffer, "%s: %u x %u, %s", m.label.c_str(), m.width, m.height, tileset);
+	}
+	else {
+		sprintf(buffer, "%d maps (%d px per block): drag to pan, scroll to zoom, Home to return", (int)_world.size(),
+			_view->ppb());
+	}
+	_status->copy_label(buffer);
+	_status->redraw();
+}
+
+World_Map::Result World_Window::show(const Fl_Widget *p, const char *directory, const char *map_name, Lighting l) {
+	initialize();
+	close();
+	World_Map::Result r = _world.read_world(directory, map_name);
+	if (r != World_Map::Result::WORLD_OK) { return r; }
+	_renderer.start(&_world, l);
+	size_t current = _world.find(map_name);
+	_view->world(&_world, &_renderer, current);
+	update_status();
+	Fl_Window *prev_grab = Fl::grab();
+	if (!_window->shown()) {
+		_window->position(p->x() + _dx, p->y() + _dy);
+	}
+	Fl::grab(NULL);
+	_window->show();
+	Fl::grab(prev_grab);
+	_view->center_on(current < _world.size() ? current : 0);
+	return r;
+}
+
+void World_Window::lighting(Lighting l) {
+	// Tilesets are read with one lighting, so switching it starts over
+	if (!_renderer.running() || l == _renderer.lighting()) { return; }
+	size_t current = _view->current();
+	_view->world(NULL, NULL, 0);
+	_renderer.start(&_world, l);
+	_view->world(&_world, &_renderer, current);
+	update_status();
+}
+
+void World_Window::close() {
+	// Stop rendering and free the rendered maps and tilesets
+	if (_view) { _view->world(NULL, NULL, 0); }
+	_renderer.stop();
+	_world.clear();
+}
+
+void World_Window::close_cb(Fl_Widget *, World_Window *ww) {
+	ww->close();
+	ww->_window->hide();
+}
+
+void World_Window::view_cb(World_View *, World_Window *ww) {
+	ww->update_status();
+}
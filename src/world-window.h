@@ -0,0 +1,76 @@
+#ifndef WORLD_WINDOW_H
+#define WORLD_WINDOW_H
+
+#include <vector>
+
+#pragma warning(push, 0)
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Widget.H>
+#pragma warning(pop)
+
+#include "colors.h"
+#include "widgets.h"
+#include "world-map.h"
+#include "world-renderer.h"
+
+#define NUM_WORLD_ZOOM_LEVELS 6
+#define DEFAULT_WORLD_ZOOM_LEVEL 2
+
+// Draws the part of an image inside (cx, cy, cw, ch), stretched to fill (x, y, w, h)
+void draw_world_image(const World_Image *image, int x, int y, int w, int h, int cx, int cy, int cw, int ch,
+	std::vector<uchar> &scratch);
+
+// Draws the world's maps at one of several zoom levels, requesting each
+// visible map from the renderer and filling in the ones still rendering
+class World_View : public Fl_Widget {
+private:
+	const World_Map *_world;
+	World_Renderer *_renderer;
+	size_t _current, _hovered;
+	int _zoom, _ox, _oy;
+	int _drag_x, _drag_y, _drag_ox, _drag_oy;
+	bool _polling;
+	std::vector<uchar> _scratch;
+public:
+	World_View(int x, int y, int w, int h);
+	~World_View();
+	void world(const World_Map *w, World_Renderer *r, size_t current);
+	inline size_t current(void) const { return _current; }
+	int ppb(void) const;
+	inline size_t hovered(void) const { return _hovered; }
+	void center_on(size_t map);
+	void zoom(int level, int mx, int my);
+	void pan(int dx, int dy);
+	void draw(void);
+	int handle(int event);
+private:
+	void clamp(void);
+	bool hover(int ex, int ey);
+	static void poll_cb(World_View *wv);
+};
+
+// A read-only view of every connected map in the project
+class World_Window {
+private:
+	int _dx, _dy, _width, _height;
+	Fl_Double_Window *_window;
+	World_View *_view;
+	Label *_status;
+	World_Map _world;
+	World_Renderer _renderer;
+public:
+	World_Window(int x, int y, int w, int h);
+	~World_Window();
+private:
+	void initialize(void);
+	void update_status(void);
+public:
+	World_Map::Result show(const Fl_Widget *p, const char *directory, const char *map_name, Lighting l);
+	void lighting(Lighting l);
+	void close(void);
+private:
+	static void close_cb(Fl_Widget *w, World_Window *ww);
+	static void view_cb(World_View *wv, World_Window *ww);
+};
+
+#endif